@@ -14,11 +14,28 @@
 #include "detail/asn1_parser_read.hpp"
 #include "detail/asn1_parser_write.hpp"
 #include "detail/asn1_parser_error.hpp"
+#include "detail/asn1_parser_compressed.hpp"
+#include "detail/asn1_parser_async.hpp"
+#include "detail/asn1_parser_mapped.hpp"
 #include "detail/tap3_parser_read.hpp"
+#include "detail/tap3_parser_write.hpp"
+#include "detail/tap3_validate.hpp"
+#include "detail/tap3_index.hpp"
+#include "detail/tap3_aggregate.hpp"
+#include "detail/tap3_bind.hpp"
+#include "detail/tap3_time.hpp"
+#include "detail/tap3_references.hpp"
+#include "detail/tap3_money.hpp"
+#include "detail/tap3_filter.hpp"
+#include "detail/tap3_fingerprint.hpp"
+#include "detail/tap3_tree.hpp"
+#include "detail/tap3_snapshot.hpp"
+#include "detail/tap3_decoder.hpp"
 
 #include <fstream>
 #include <string>
 #include <locale>
+#include <vector>
 
 
 namespace boost { namespace property_tree { namespace asn1_parser
@@ -45,6 +62,72 @@ namespace boost { namespace property_tree { namespace asn1_parser
         stream.imbue(loc);
         read_asn1_internal(stream, pt, filename);
     }
+
+    //! Reads a file, skipping call events and other groups that cannot be decoded.
+    //! Skipped groups are left out of pt and listed in failures with their offsets.
+    //! \return true if the whole file was decoded, false if parsing had to stop early.
+    template<class Ptree>
+    bool read_asn1(const std::string &filename,
+                   Ptree &pt,
+                   std::vector<detail::rapidasn1::parse_failure> &failures)
+    {
+        std::basic_ifstream<typename Ptree::key_type::value_type>
+            stream(filename.c_str());
+        if (!stream)
+            BOOST_PROPERTY_TREE_THROW(asn1_parser_error(
+                "cannot open file", filename, 0));
+        return read_asn1_internal(stream, pt, filename, failures);
+    }
+
+    //! Reads from a buffer owned by the caller.
+    //! With an asn1_view_ptree no value is copied; the buffer must then outlive pt.
+    template<class Ptree, class Byte>
+    void read_asn1(const Byte *data,
+                   std::size_t size,
+                   Ptree &pt)
+    {
+        read_asn1_internal(data, size, pt, std::string());
+    }
+
+    //! Reads from a buffer owned by the caller, reporting malformed data through result
+    //! instead of an exception.
+    //! \return true on success; otherwise pt is left untouched.
+    template<class Ptree, class Byte>
+    bool read_asn1(const Byte *data,
+                   std::size_t size,
+                   Ptree &pt,
+                   detail::rapidasn1::parse_result &result)
+    {
+        return read_asn1_internal(data, size, pt, result);
+    }
+
+    //! Reads a file compressed with gzip, zlib, zip (first entry), xz or zstd, or not compressed.
+    //! The file is decompressed on a separate thread while call events are parsed.
+    //! Each format needs its library, see asn1_parser_compressed.hpp.
+    template<class Ptree>
+    void read_asn1_compressed(const std::string &filename,
+                              Ptree &pt)
+    {
+        read_asn1_compressed_internal(filename, pt);
+    }
+
+    //! Reads the next file of an async_reader; its following files are read meanwhile.
+    //! <br><code>
+    //! <br>async_reader reader(filenames);
+    //! <br>ptree pt;
+    //! <br>while (read_asn1(reader, pt)) ...
+    //! </code><br>
+    //! With an asn1_view_ptree, pt refers to the buffer of the reader until the next call.
+    //! \return false when every file has been read.
+    template<class Ptree>
+    bool read_asn1(async_reader &reader,
+                   Ptree &pt)
+    {
+        if (!reader.next())
+            return false;
+        read_asn1_internal(reader.data(), reader.size(), pt, reader.filename());
+        return true;
+    }
 /*
     template<class Ptree>
     void write_asn1(std::basic_ostream<
@@ -0,0 +1,484 @@
+// ----------------------------------------------------------------------------
+// Copyright (C) 2015-2016 zunceng@gmail.com
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+// For more information, see www.boost.org
+// ----------------------------------------------------------------------------
+#ifndef BOOST_PROPERTY_TREE_DETAIL_ASN1_PARSER_ASYNC_HPP_INCLUDED
+#define BOOST_PROPERTY_TREE_DETAIL_ASN1_PARSER_ASYNC_HPP_INCLUDED
+
+//! \file asn1_parser_async.hpp Read-ahead of a list of files on a separate thread, so that
+//! reading file k+1 overlaps parsing file k. On Linux the reads of a file are queued together
+//! through io_uring when the kernel allows it, and issued with pread() otherwise.
+//! Define <code>BOOST_PROPERTY_TREE_ASN1_NO_IO_URING</code> to always use pread().
+//! The reading thread is a boost::thread, so the program links with -lboost_thread.
+
+#include "asn1_parser_error.hpp"
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/lock_guard.hpp>
+#include <boost/thread/lock_types.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#if defined(__unix__)
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define BOOST_PROPERTY_TREE_ASN1_HAS_PREAD
+#endif
+
+#if defined(__linux__) && !defined(BOOST_PROPERTY_TREE_ASN1_NO_IO_URING) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define BOOST_PROPERTY_TREE_ASN1_HAS_IO_URING
+#endif
+#endif
+#endif
+
+#ifndef BOOST_PROPERTY_TREE_ASN1_READ_CHUNK_SIZE
+    // Size of the chunks read from files.
+    // Define BOOST_PROPERTY_TREE_ASN1_READ_CHUNK_SIZE before including asn1_parser.hpp if you want to override the default value.
+    #define BOOST_PROPERTY_TREE_ASN1_READ_CHUNK_SIZE (1024 * 1024)
+#endif
+
+#ifndef BOOST_PROPERTY_TREE_ASN1_IO_DEPTH
+    // Number of chunk reads of one file queued at once with io_uring.
+    // Define BOOST_PROPERTY_TREE_ASN1_IO_DEPTH before including asn1_parser.hpp if you want to override the default value.
+    #define BOOST_PROPERTY_TREE_ASN1_IO_DEPTH 8
+#endif
+
+namespace boost { namespace property_tree { namespace asn1_parser
+{
+    //! I/O backends of async_reader
+    enum async_backend
+    {
+        async_stream,       //!< std::ifstream, where pread() is not available
+        async_pread,        //!< pread() of consecutive chunks
+        async_io_uring,     //!< io_uring with BOOST_PROPERTY_TREE_ASN1_IO_DEPTH chunks in flight
+    };
+
+    //! \cond internal
+    namespace internal
+    {
+    #if defined(BOOST_PROPERTY_TREE_ASN1_HAS_IO_URING)
+        // Minimal io_uring over the raw system calls, for queued reads of one file at a time
+        class io_ring
+        {
+        public:
+            io_ring()
+                : m_fd(-1)
+                , m_sq(MAP_FAILED)
+                , m_cq(MAP_FAILED)
+                , m_sqes(MAP_FAILED)
+            {
+                struct io_uring_params params;
+                std::memset(&params, 0, sizeof(params));
+                m_fd = static_cast<int>(syscall(__NR_io_uring_setup, BOOST_PROPERTY_TREE_ASN1_IO_DEPTH, &params));
+                if (m_fd < 0)
+                    return;
+                m_sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+                m_cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+                bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+                if (single)
+                    m_sq_size = m_cq_size = std::max(m_sq_size, m_cq_size);
+                m_sq = mmap(0, m_sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+                if (m_sq == MAP_FAILED)
+                {
+                    close();
+                    return;
+                }
+                m_cq = single ? m_sq : mmap(0, m_cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+                if (m_cq == MAP_FAILED)
+                {
+                    close();
+                    return;
+                }
+                m_sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+                m_sqes = mmap(0, m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+                if (m_sqes == MAP_FAILED)
+                {
+                    close();
+                    return;
+                }
+
+                char *sq = static_cast<char *>(m_sq);
+                char *cq = static_cast<char *>(m_cq);
+                m_sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+                m_sq_mask = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+                m_sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+                m_cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+                m_cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+                m_cq_mask = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+                m_cqes = reinterpret_cast<struct io_uring_cqe *>(cq + params.cq_off.cqes);
+            }
+
+            ~io_ring()
+            {
+                close();
+            }
+
+            bool ok() const
+            {
+                return m_fd >= 0;
+            }
+
+            // Reads size bytes at offset of fd into data, queuing up to BOOST_PROPERTY_TREE_ASN1_IO_DEPTH chunks
+            const char *read(int fd, unsigned char *data, std::size_t size)
+            {
+                const std::size_t chunk = BOOST_PROPERTY_TREE_ASN1_READ_CHUNK_SIZE;
+                struct iovec iov[BOOST_PROPERTY_TREE_ASN1_IO_DEPTH];
+                std::size_t next = 0;           // Next offset to queue
+                std::size_t done = 0;           // Bytes read
+                unsigned pending = 0;
+                std::size_t free_slots[BOOST_PROPERTY_TREE_ASN1_IO_DEPTH];
+                std::size_t free_count = BOOST_PROPERTY_TREE_ASN1_IO_DEPTH;
+                for (std::size_t i = 0; i < free_count; ++i)
+                    free_slots[i] = i;
+
+                while (done < size)
+                {
+                    // Queue as many chunks as there are free slots
+                    unsigned queued = 0;
+                    while (next < size && free_count)
+                    {
+                        std::size_t slot = free_slots[--free_count];
+                        iov[slot].iov_base = data + next;
+                        iov[slot].iov_len = std::min(chunk, size - next);
+                        submit(fd, slot, &iov[slot], next);
+                        next += iov[slot].iov_len;
+                        ++queued;
+                    }
+                    if (syscall(__NR_io_uring_enter, m_fd, queued, 1, IORING_ENTER_GETEVENTS, 0, 0) < 0)
+                        return "io_uring_enter failed";
+                    pending += queued;
+
+                    // Reap completions; short reads are queued again for their remainder
+                    unsigned head = *m_cq_head;
+                    unsigned tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+                    for (; head != tail; ++head)
+                    {
+                        const struct io_uring_cqe &cqe = m_cqes[head & m_cq_mask];
+                        std::size_t slot = static_cast<std::size_t>(cqe.user_data);
+                        --pending;
+                        if (cqe.res <= 0)
+                        {
+                            __atomic_store_n(m_cq_head, head + 1, __ATOMIC_RELEASE);
+                            drain(pending);
+                            return cqe.res < 0 ? "read error" : "unexpected end of file";
+                        }
+                        done += cqe.res;
+                        if (static_cast<std::size_t>(cqe.res) < iov[slot].iov_len)
+                        {
+                            iov[slot].iov_base = static_cast<char *>(iov[slot].iov_base) + cqe.res;
+                            iov[slot].iov_len -= cqe.res;
+                            submit(fd, slot, &iov[slot], static_cast<unsigned char *>(iov[slot].iov_base) - data);
+                            syscall(__NR_io_uring_enter, m_fd, 1, 0, 0, 0, 0);
+                            ++pending;
+                        }
+                        else
+                            free_slots[free_count++] = slot;
+                    }
+                    __atomic_store_n(m_cq_head, head, __ATOMIC_RELEASE);
+                }
+                return 0;
+            }
+
+        private:
+
+            void submit(int fd, std::size_t slot, struct iovec *iov, std::size_t offset)
+            {
+                unsigned tail = *m_sq_tail;
+                unsigned index = tail & m_sq_mask;
+                struct io_uring_sqe &sqe = static_cast<struct io_uring_sqe *>(m_sqes)[index];
+                std::memset(&sqe, 0, sizeof(sqe));
+                sqe.opcode = IORING_OP_READV;
+                sqe.fd = fd;
+                sqe.addr = reinterpret_cast<unsigned long>(iov);
+                sqe.len = 1;
+                sqe.off = offset;
+                sqe.user_data = slot;
+                m_sq_array[index] = index;
+                __atomic_store_n(m_sq_tail, tail + 1, __ATOMIC_RELEASE);
+            }
+
+            // Waits for reads still in flight after an error, since they target the caller's buffer
+            void drain(unsigned pending)
+            {
+                while (pending)
+                {
+                    if (syscall(__NR_io_uring_enter, m_fd, 0, 1, IORING_ENTER_GETEVENTS, 0, 0) < 0)
+                        return;
+                    unsigned head = *m_cq_head;
+                    unsigned tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+                    pending -= std::min(pending, tail - head);
+                    __atomic_store_n(m_cq_head, tail, __ATOMIC_RELEASE);
+                }
+            }
+
+            void close()
+            {
+                if (m_sqes != MAP_FAILED)
+                    munmap(m_sqes, m_sqes_size);
+                if (m_cq != MAP_FAILED && m_cq != m_sq)
+                    munmap(m_cq, m_cq_size);
+                if (m_sq != MAP_FAILED)
+                    munmap(m_sq, m_sq_size);
+                if (m_fd >= 0)
+                    ::close(m_fd);
+                m_sq = m_cq = m_sqes = MAP_FAILED;
+                m_fd = -1;
+            }
+
+            int m_fd;
+            void *m_sq;
+            void *m_cq;
+            void *m_sqes;
+            std::size_t m_sq_size;
+            std::size_t m_cq_size;
+            std::size_t m_sqes_size;
+            unsigned *m_sq_tail;
+            unsigned m_sq_mask;
+            unsigned *m_sq_array;
+            unsigned *m_cq_head;
+            unsigned *m_cq_tail;
+            unsigned m_cq_mask;
+            struct io_uring_cqe *m_cqes;
+        };
+    #endif
+    }
+    //! \endcond
+
+    //! Reads a list of files ahead of the parser, on a separate thread.
+    //! Up to depth files are held in memory at once, the one being parsed included,
+    //! so that reading the next files overlaps parsing the current one.
+    //! Pass it to read_asn1(async_reader &, Ptree &) in a loop, or use next() directly.
+    class async_reader
+    {
+    public:
+
+        //! Starts reading filenames in order.
+        //! \param depth Number of file buffers in flight, at least 2 for any overlap.
+        explicit async_reader(const std::vector<std::string> &filenames, std::size_t depth = 2)
+            : m_filenames(filenames)
+            , m_depth(depth ? depth : 1)
+            , m_backend(async_stream)
+            , m_in_use(0)
+            , m_next(0)
+            , m_stop(false)
+        {
+            m_current.size = 0;
+            m_current.error = 0;
+            m_thread = boost::thread(&async_reader::run, this);
+        }
+
+        //! Stops reading and waits for the thread
+        ~async_reader()
+        {
+            {
+                boost::lock_guard<boost::mutex> lock(m_mutex);
+                m_stop = true;
+                m_changed.notify_all();
+            }
+            m_thread.join();
+        }
+
+        //! Releases the current file and waits for the next one.
+        //! Throws asn1_parser_error if the next file cannot be read.
+        //! \return false when all files have been returned.
+        bool next()
+        {
+            boost::unique_lock<boost::mutex> lock(m_mutex);
+            if (m_in_use)
+            {
+                m_free.push_back(std::vector<unsigned char>());
+                m_free.back().swap(m_current.data);
+                m_in_use = 0;
+                m_changed.notify_all();
+            }
+            while (m_ready.empty() && m_next < m_filenames.size())
+                m_changed.wait(lock);
+            if (m_ready.empty())
+                return false;
+            m_current.filename.swap(m_ready.front().filename);
+            m_current.data.swap(m_ready.front().data);
+            m_current.size = m_ready.front().size;
+            m_current.error = m_ready.front().error;
+            m_ready.pop_front();
+            m_in_use = 1;
+            m_changed.notify_all();
+            if (m_current.error)
+                BOOST_PROPERTY_TREE_THROW(asn1_parser_error(m_current.error, m_current.filename, 0));
+            return true;
+        }
+
+        //! Name of the current file
+        const std::string &filename() const
+        {
+            return m_current.filename;
+        }
+
+        //! Contents of the current file, valid until the next call to next()
+        const unsigned char *data() const
+        {
+            return m_current.size ? &m_current.data[0] : 0;
+        }
+
+        std::size_t size() const
+        {
+            return m_current.size;
+        }
+
+        //! Backend used for the reads, known once the first file has been returned
+        async_backend backend() const
+        {
+            return m_backend;
+        }
+
+    private:
+
+        struct file
+        {
+            std::string filename;
+            std::vector<unsigned char> data;
+            std::size_t size;
+            const char *error;
+        };
+
+        void run()
+        {
+        #if defined(BOOST_PROPERTY_TREE_ASN1_HAS_IO_URING)
+            internal::io_ring ring;
+            m_backend = ring.ok() ? async_io_uring : async_pread;
+        #elif defined(BOOST_PROPERTY_TREE_ASN1_HAS_PREAD)
+            m_backend = async_pread;
+        #endif
+            std::size_t index = 0;
+            while (1)
+            {
+                file f;
+                {
+                    // Wait for a free buffer
+                    boost::unique_lock<boost::mutex> lock(m_mutex);
+                    while (!m_stop && m_ready.size() + m_in_use >= m_depth)
+                        m_changed.wait(lock);
+                    if (m_stop || index == m_filenames.size())
+                        return;
+                    if (!m_free.empty())
+                    {
+                        f.data.swap(m_free.back());
+                        m_free.pop_back();
+                    }
+                }
+                f.filename = m_filenames[index];
+                f.size = 0;
+                try
+                {
+                #if defined(BOOST_PROPERTY_TREE_ASN1_HAS_IO_URING)
+                    f.error = read_file(f, ring.ok() ? &ring : 0);
+                #else
+                    f.error = read_file(f);
+                #endif
+                }
+                catch (std::bad_alloc &)
+                {
+                    f.error = "out of memory";
+                }
+
+                boost::lock_guard<boost::mutex> lock(m_mutex);
+                m_ready.push_back(file());
+                m_ready.back().filename.swap(f.filename);
+                m_ready.back().data.swap(f.data);
+                m_ready.back().size = f.size;
+                m_ready.back().error = f.error;
+                m_next = ++index;
+                m_changed.notify_all();
+            }
+        }
+
+    #if defined(BOOST_PROPERTY_TREE_ASN1_HAS_PREAD)
+    #if defined(BOOST_PROPERTY_TREE_ASN1_HAS_IO_URING)
+        const char *read_file(file &f, internal::io_ring *ring)
+    #else
+        const char *read_file(file &f)
+    #endif
+        {
+            int fd = ::open(f.filename.c_str(), O_RDONLY);
+            if (fd < 0)
+                return "cannot open file";
+            struct stat st;
+            if (fstat(fd, &st) != 0)
+            {
+                ::close(fd);
+                return "read error";
+            }
+            f.size = static_cast<std::size_t>(st.st_size);
+            if (f.data.size() < f.size)
+                f.data.resize(f.size);
+            const char *error = 0;
+        #if defined(BOOST_PROPERTY_TREE_ASN1_HAS_IO_URING)
+            if (ring && f.size)
+                error = ring->read(fd, &f.data[0], f.size);
+            else
+        #endif
+            {
+                std::size_t done = 0;
+                while (done < f.size && !error)
+                {
+                    ssize_t n = ::pread(fd, &f.data[done], std::min<std::size_t>(BOOST_PROPERTY_TREE_ASN1_READ_CHUNK_SIZE, f.size - done), done);
+                    if (n < 0)
+                        error = "read error";
+                    else if (n == 0)
+                        error = "unexpected end of file";
+                    done += n > 0 ? n : 0;
+                }
+            }
+            ::close(fd);
+            return error;
+        }
+    #else
+        const char *read_file(file &f)
+        {
+            std::ifstream stream(f.filename.c_str(), std::ios::in | std::ios::binary);
+            if (!stream)
+                return "cannot open file";
+            stream.seekg(0, std::ios::end);
+            f.size = static_cast<std::size_t>(stream.tellg());
+            stream.seekg(0, std::ios::beg);
+            if (f.data.size() < f.size)
+                f.data.resize(f.size);
+            if (f.size && !stream.read(reinterpret_cast<char *>(&f.data[0]), f.size))
+                return "read error";
+            return 0;
+        }
+    #endif
+
+        std::vector<std::string> m_filenames;
+        std::size_t m_depth;
+        async_backend m_backend;
+        file m_current;
+        std::deque<file> m_ready;                       // Files read, not yet returned
+        std::vector<std::vector<unsigned char> > m_free; // Buffers to reuse
+        std::size_t m_in_use;                           // 1 while the current file is held
+        std::size_t m_next;                             // Number of files read so far
+        bool m_stop;
+        boost::mutex m_mutex;
+        boost::condition_variable m_changed;
+        boost::thread m_thread;
+    };
+
+} } }
+
+#endif
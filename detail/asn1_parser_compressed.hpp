@@ -0,0 +1,643 @@
+// ----------------------------------------------------------------------------
+// Copyright (C) 2015-2016 zunceng@gmail.com
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+// For more information, see www.boost.org
+// ----------------------------------------------------------------------------
+#ifndef BOOST_PROPERTY_TREE_DETAIL_ASN1_PARSER_COMPRESSED_HPP_INCLUDED
+#define BOOST_PROPERTY_TREE_DETAIL_ASN1_PARSER_COMPRESSED_HPP_INCLUDED
+
+//! \file asn1_parser_compressed.hpp Reading of compressed files, decompressed on a separate thread while being parsed.
+//! Decoders are enabled by defining, before inclusion, the macros of the libraries the program links with:
+//! <code>BOOST_PROPERTY_TREE_ASN1_USE_ZLIB</code> (gzip, zlib and zip, -lz),
+//! <code>BOOST_PROPERTY_TREE_ASN1_USE_LZMA</code> (xz, -llzma) and
+//! <code>BOOST_PROPERTY_TREE_ASN1_USE_ZSTD</code> (zstd, -lzstd).
+//! Uncompressed files are always accepted.
+//! The decompressing thread is a boost::thread, so the program links with -lboost_thread.
+
+#include "asn1_parser_error.hpp"
+#include "asn1_parser_read.hpp"
+#include "rapidasn1.hpp"
+#include <boost/cstdint.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/lock_guard.hpp>
+#include <boost/thread/lock_types.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#if defined(BOOST_PROPERTY_TREE_ASN1_USE_ZLIB)
+#include <zlib.h>
+#endif
+#if defined(BOOST_PROPERTY_TREE_ASN1_USE_LZMA)
+#include <lzma.h>
+#endif
+#if defined(BOOST_PROPERTY_TREE_ASN1_USE_ZSTD)
+#include <zstd.h>
+#endif
+
+#ifndef BOOST_PROPERTY_TREE_ASN1_READ_CHUNK_SIZE
+    // Size of the chunks read from compressed files.
+    // Define BOOST_PROPERTY_TREE_ASN1_READ_CHUNK_SIZE before including asn1_parser.hpp if you want to override the default value.
+    #define BOOST_PROPERTY_TREE_ASN1_READ_CHUNK_SIZE (1024 * 1024)
+#endif
+
+#ifndef BOOST_PROPERTY_TREE_ASN1_MAX_PRESIZE
+    // Largest buffer allocated up front from the length declared by the first BER node;
+    // a larger node is parsed once decompressed, in a buffer that grows with the data.
+    // Define BOOST_PROPERTY_TREE_ASN1_MAX_PRESIZE before including asn1_parser.hpp if you want to override the default value.
+    #define BOOST_PROPERTY_TREE_ASN1_MAX_PRESIZE (256 * 1024 * 1024)
+#endif
+
+namespace boost { namespace property_tree { namespace asn1_parser
+{
+    //! Compression formats recognized by their magic numbers
+    enum compression
+    {
+        compression_none,
+        compression_gzip,
+        compression_zlib,
+        compression_zip,
+        compression_xz,
+        compression_zstd,
+    };
+
+    //! \cond internal
+    namespace internal
+    {
+        inline compression detect_compression(const unsigned char *data, std::size_t size)
+        {
+            if (size >= 2 && data[0] == 0x1F && data[1] == 0x8B)
+                return compression_gzip;
+            if (size >= 4 && data[0] == 'P' && data[1] == 'K' && data[2] == 3 && data[3] == 4)
+                return compression_zip;
+            if (size >= 6 && std::memcmp(data, "\xFD" "7zXZ\0", 6) == 0)
+                return compression_xz;
+            if (size >= 4 && data[0] == 0x28 && data[1] == 0xB5 && data[2] == 0x2F && data[3] == 0xFD)
+                return compression_zstd;
+            if (size >= 2 && (data[0] & 0x0F) == 8 && ((data[0] << 8) | data[1]) % 31 == 0)
+                return compression_zlib;
+            return compression_none;
+        }
+
+        // Streaming decoder of one format.
+        // decode() consumes input and produces output, setting end at the end of the compressed data;
+        // it returns an error message, or 0.
+        class decoder
+        {
+        public:
+            decoder()
+                : m_format(compression_none)
+                , m_started(false)
+            {
+            #if defined(BOOST_PROPERTY_TREE_ASN1_USE_LZMA)
+                lzma_stream init = LZMA_STREAM_INIT;
+                m_lzma = init;
+            #endif
+            #if defined(BOOST_PROPERTY_TREE_ASN1_USE_ZSTD)
+                m_zstd = 0;
+            #endif
+            }
+
+            ~decoder()
+            {
+                if (!m_started)
+                    return;
+            #if defined(BOOST_PROPERTY_TREE_ASN1_USE_ZLIB)
+                if (m_format == compression_gzip || m_format == compression_zlib || m_format == compression_zip)
+                    inflateEnd(&m_zlib);
+            #endif
+            #if defined(BOOST_PROPERTY_TREE_ASN1_USE_LZMA)
+                if (m_format == compression_xz)
+                    lzma_end(&m_lzma);
+            #endif
+            #if defined(BOOST_PROPERTY_TREE_ASN1_USE_ZSTD)
+                if (m_format == compression_zstd)
+                    ZSTD_freeDStream(m_zstd);
+            #endif
+            }
+
+            // Starts decoding the format; for zip, in is advanced past the local file header
+            const char *start(compression format, const unsigned char *&in, std::size_t &in_size)
+            {
+                (void)in;                       // Used by zip only
+                (void)in_size;
+                m_format = format;
+                switch (format)
+                {
+                    case compression_none:
+                        return 0;
+                #if defined(BOOST_PROPERTY_TREE_ASN1_USE_ZLIB)
+                    case compression_zip:
+                    {
+                        // Only the first entry is read, from its local file header
+                        if (in_size < 30)
+                            return "truncated zip header";
+                        unsigned method = in[8] | (in[9] << 8);
+                        std::size_t skip = 30 + (in[26] | (in[27] << 8)) + (in[28] | (in[29] << 8));
+                        if (method != 8)
+                            return "unsupported zip method";
+                        if (in_size < skip)
+                            return "truncated zip header";
+                        in += skip;
+                        in_size -= skip;
+                    }
+                    // fall through
+                    case compression_gzip:
+                    case compression_zlib:
+                    {
+                        std::memset(&m_zlib, 0, sizeof(m_zlib));
+                        int window = format == compression_zip ? -MAX_WBITS : MAX_WBITS + 32;
+                        if (inflateInit2(&m_zlib, window) != Z_OK)
+                            return "inflateInit2 failed";
+                        m_started = true;
+                        return 0;
+                    }
+                #endif
+                #if defined(BOOST_PROPERTY_TREE_ASN1_USE_LZMA)
+                    case compression_xz:
+                    {
+                        if (lzma_stream_decoder(&m_lzma, UINT64_MAX, LZMA_CONCATENATED) != LZMA_OK)
+                            return "lzma_stream_decoder failed";
+                        m_started = true;
+                        return 0;
+                    }
+                #endif
+                #if defined(BOOST_PROPERTY_TREE_ASN1_USE_ZSTD)
+                    case compression_zstd:
+                    {
+                        m_zstd = ZSTD_createDStream();
+                        if (!m_zstd || ZSTD_isError(ZSTD_initDStream(m_zstd)))
+                            return "ZSTD_initDStream failed";
+                        m_started = true;
+                        return 0;
+                    }
+                #endif
+                    default:
+                        return "compression format not enabled";
+                }
+            }
+
+            const char *decode(const unsigned char *&in, std::size_t &in_size,
+                               unsigned char *&out, std::size_t &out_size, bool &end)
+            {
+                end = false;
+                switch (m_format)
+                {
+                    case compression_none:
+                    {
+                        std::size_t n = std::min(in_size, out_size);
+                        std::memcpy(out, in, n);
+                        in += n;
+                        in_size -= n;
+                        out += n;
+                        out_size -= n;
+                        return 0;
+                    }
+                #if defined(BOOST_PROPERTY_TREE_ASN1_USE_ZLIB)
+                    case compression_gzip:
+                    case compression_zlib:
+                    case compression_zip:
+                    {
+                        m_zlib.next_in = const_cast<Bytef *>(in);
+                        m_zlib.avail_in = static_cast<uInt>(in_size);
+                        m_zlib.next_out = out;
+                        m_zlib.avail_out = static_cast<uInt>(out_size);
+                        int status = inflate(&m_zlib, Z_NO_FLUSH);
+                        in = m_zlib.next_in;
+                        in_size = m_zlib.avail_in;
+                        out = m_zlib.next_out;
+                        out_size = m_zlib.avail_out;
+                        if (status == Z_STREAM_END)
+                        {
+                            // Concatenated gzip members continue the stream
+                            if (m_format == compression_gzip && in_size >= 2 && in[0] == 0x1F && in[1] == 0x8B)
+                                return inflateReset(&m_zlib) == Z_OK ? 0 : "inflateReset failed";
+                            end = true;
+                            return 0;
+                        }
+                        if (status != Z_OK && status != Z_BUF_ERROR)
+                            return "inflate failed: corrupt data";
+                        return 0;
+                    }
+                #endif
+                #if defined(BOOST_PROPERTY_TREE_ASN1_USE_LZMA)
+                    case compression_xz:
+                    {
+                        m_lzma.next_in = in;
+                        m_lzma.avail_in = in_size;
+                        m_lzma.next_out = out;
+                        m_lzma.avail_out = out_size;
+                        lzma_ret status = lzma_code(&m_lzma, in_size ? LZMA_RUN : LZMA_FINISH);
+                        in = m_lzma.next_in;
+                        in_size = m_lzma.avail_in;
+                        out = m_lzma.next_out;
+                        out_size = m_lzma.avail_out;
+                        if (status == LZMA_STREAM_END)
+                            end = true;
+                        else if (status != LZMA_OK && status != LZMA_BUF_ERROR)
+                            return "lzma_code failed";
+                        return 0;
+                    }
+                #endif
+                #if defined(BOOST_PROPERTY_TREE_ASN1_USE_ZSTD)
+                    case compression_zstd:
+                    {
+                        ZSTD_inBuffer input = {in, in_size, 0};
+                        ZSTD_outBuffer output = {out, out_size, 0};
+                        std::size_t status = ZSTD_decompressStream(m_zstd, &output, &input);
+                        in += input.pos;
+                        in_size -= input.pos;
+                        out += output.pos;
+                        out_size -= output.pos;
+                        if (ZSTD_isError(status))
+                            return ZSTD_getErrorName(status);
+                        if (status == 0 && !in_size)
+                            end = true;
+                        return 0;
+                    }
+                #endif
+                    default:
+                        return "compression format not enabled";
+                }
+            }
+
+        private:
+            compression m_format;
+            bool m_started;
+        #if defined(BOOST_PROPERTY_TREE_ASN1_USE_ZLIB)
+            z_stream m_zlib;
+        #endif
+        #if defined(BOOST_PROPERTY_TREE_ASN1_USE_LZMA)
+            lzma_stream m_lzma;
+        #endif
+        #if defined(BOOST_PROPERTY_TREE_ASN1_USE_ZSTD)
+            ZSTD_DStream *m_zstd;
+        #endif
+        };
+    }
+    //! \endcond
+
+    //! Decompresses a file on a separate thread into a buffer the parser can read while it fills.
+    //! The buffer is sized once from the header of the first BER node, so data() never moves;
+    //! a declared length the file cannot hold, or above BOOST_PROPERTY_TREE_ASN1_MAX_PRESIZE,
+    //! is not trusted and the data is handed over when finished, as for an indefinite length.
+    //! bytes past that node are kept apart and available through tail() once finished.
+    //! When the first node has an indefinite length, data becomes available only when finished.
+    class decompressing_source
+    {
+    public:
+
+        //! Opens filename and starts decompressing it; throws asn1_parser_error if it cannot be opened.
+        explicit decompressing_source(const std::string &filename)
+            : m_stream(filename.c_str(), std::ios::in | std::ios::binary)
+            , m_file_size(0)
+            , m_format(compression_none)
+            , m_sized(false)
+            , m_available(0)
+            , m_finished(false)
+            , m_stop(false)
+            , m_error(0)
+        {
+            if (!m_stream)
+                BOOST_PROPERTY_TREE_THROW(asn1_parser_error(
+                    "cannot open file", filename, 0));
+            m_stream.seekg(0, std::ios::end);
+            m_file_size = static_cast<boost::uint64_t>(m_stream.tellg());
+            m_stream.seekg(0, std::ios::beg);
+            m_thread = boost::thread(&decompressing_source::run, this);
+        }
+
+        //! Stops decompression and waits for the thread
+        ~decompressing_source()
+        {
+            {
+                boost::lock_guard<boost::mutex> lock(m_mutex);
+                m_stop = true;
+            }
+            m_thread.join();
+        }
+
+        //! Blocks until size bytes of data() are available, or decompression has finished.
+        //! \return Number of bytes available, which is less than size only at the end.
+        std::size_t wait(std::size_t size)
+        {
+            boost::unique_lock<boost::mutex> lock(m_mutex);
+            while (m_available < size && !m_finished)
+                m_ready.wait(lock);
+            return m_available;
+        }
+
+        //! Blocks until the size of data() is known: the size of the first BER node,
+        //! or of the whole data if that node has an indefinite length.
+        std::size_t size()
+        {
+            boost::unique_lock<boost::mutex> lock(m_mutex);
+            while (!m_sized && !m_finished)
+                m_ready.wait(lock);
+            return m_data.size();
+        }
+
+        //! Decompressed data; valid once size() has returned
+        const unsigned char *data() const
+        {
+            return m_data.empty() ? 0 : &m_data[0];
+        }
+
+        //! Decompressed bytes following the first BER node; complete once finished
+        const std::vector<unsigned char> &tail()
+        {
+            wait(static_cast<std::size_t>(-1));
+            return m_tail;
+        }
+
+        //! Format of the file, known once some data is available
+        compression format() const
+        {
+            return m_format;
+        }
+
+        //! Error met while reading or decompressing, or 0; complete once finished
+        const char *error()
+        {
+            wait(static_cast<std::size_t>(-1));
+            return m_error;
+        }
+
+    private:
+
+        void run()
+        {
+            const char *error = 0;
+            try
+            {
+                error = decompress();
+            }
+            catch (std::bad_alloc &)
+            {
+                error = "out of memory";
+            }
+            boost::lock_guard<boost::mutex> lock(m_mutex);
+            if (!m_sized)
+                m_available = m_data.size();   // Indefinite length: everything at once
+            m_error = error;
+            m_finished = true;
+            m_ready.notify_all();
+        }
+
+        // Publishes the bytes decoded so far; returns false when the source is being destroyed
+        bool publish(std::size_t available)
+        {
+            boost::lock_guard<boost::mutex> lock(m_mutex);
+            if (m_sized && available != m_available)
+            {
+                m_available = available;
+                m_ready.notify_all();
+            }
+            return !m_stop;
+        }
+
+        const char *decompress()
+        {
+            std::vector<unsigned char> chunk(BOOST_PROPERTY_TREE_ASN1_READ_CHUNK_SIZE);
+            std::vector<unsigned char> head;    // First decoded bytes, until the size is known
+            internal::decoder decoder;
+            std::size_t size = 0;               // Decoded bytes stored in m_data
+            bool started = false;
+            bool end = false;
+
+            while (!end)
+            {
+                m_stream.read(reinterpret_cast<char *>(&chunk[0]), chunk.size());
+                std::size_t in_size = static_cast<std::size_t>(m_stream.gcount());
+                // At the end of the file xz is called without input, to finish its concatenated streams
+                bool finishing = !in_size;
+                if (finishing && (!started || m_format != compression_xz))
+                    break;
+                const unsigned char *in = &chunk[0];
+                if (!started)
+                {
+                    m_format = internal::detect_compression(in, in_size);
+                    if (const char *error = decoder.start(m_format, in, in_size))
+                        return error;
+                    started = true;
+                }
+                while ((in_size || finishing) && !end)
+                {
+                    // Destination: the sized buffer, the tail past it, or the head until sized
+                    std::vector<unsigned char> &target = m_sized ? (size < m_data.size() ? m_data : m_tail) : head;
+                    std::size_t used = &target == &m_data ? size : target.size();
+                    if (&target != &m_data && target.size() == target.capacity())
+                        target.reserve(std::max<std::size_t>(2 * target.size(), 64 * 1024));
+                    if (&target != &m_data)
+                        target.resize(target.capacity());
+                    unsigned char *out = &target[used];
+                    std::size_t out_size = target.size() - used;
+                    if (const char *error = decoder.decode(in, in_size, out, out_size, end))
+                        return error;
+                    std::size_t produced = (target.size() - used) - out_size;
+                    if (&target == &m_data)
+                        size += produced;
+                    else
+                        target.resize(used + produced);
+
+                    if (!m_sized)
+                        size_buffer(head, size);
+                    if (m_sized && !publish(size))
+                        return 0;
+                    if ((m_format == compression_none || finishing) && !produced)
+                        break;
+                }
+                if (finishing)
+                    break;
+            }
+            if (!m_sized)
+            {
+                // Too short or indefinite length: hand everything over at the end
+                boost::lock_guard<boost::mutex> lock(m_mutex);
+                m_data.swap(head);
+                size = m_data.size();
+            }
+            else
+                publish(size);
+            // A compressed stream must reach its end, whether or not the buffer was sized
+            if (m_format != compression_none && (!end || size < m_data.size()))
+                return "truncated compressed data";
+            return m_stream.bad() ? "read error" : 0;
+        }
+
+        // Sizes m_data from the header of the first node once enough bytes are decoded
+        void size_buffer(std::vector<unsigned char> &head, std::size_t &size)
+        {
+            using namespace detail::rapidasn1;
+            if (head.empty())
+                return;
+            std::size_t tag = 0, len = 0;
+            int is_varlen = 0;
+            parse_code code = error_none;
+            std::size_t tag_size = detail::rapidasn1::internal::decode_tag<parse_default>(&head[0], head.size(), tag);
+            std::size_t len_size = tag_size ? detail::rapidasn1::internal::decode_len<parse_default>(&head[0] + tag_size, head.size() - tag_size, len, is_varlen, code) : 0;
+            // Malformed or indefinite: the parser gets the whole data at the end
+            if (!len_size || is_varlen)
+                return;
+            std::size_t total = tag_size + len_size + len;
+            if (total > presize_limit())
+                return;
+            boost::lock_guard<boost::mutex> lock(m_mutex);
+            m_data.resize(total);
+            size = std::min(total, head.size());
+            std::memcpy(&m_data[0], &head[0], size);
+            m_tail.assign(head.begin() + size, head.end());
+            head.clear();
+            m_sized = true;
+            m_ready.notify_all();
+        }
+
+        // Largest declared size trusted for sizing m_data: deflate expands at most 1032 times
+        boost::uint64_t presize_limit() const
+        {
+            boost::uint64_t limit = BOOST_PROPERTY_TREE_ASN1_MAX_PRESIZE;
+            if (m_format == compression_none)
+                return std::min(limit, m_file_size);
+            if (m_format == compression_gzip || m_format == compression_zlib || m_format == compression_zip)
+                return std::min(limit, m_file_size * 1032);
+            return limit;
+        }
+
+        std::ifstream m_stream;
+        boost::uint64_t m_file_size;
+        compression m_format;
+        std::vector<unsigned char> m_data;
+        std::vector<unsigned char> m_tail;
+        bool m_sized;                       // m_data has its final size
+        std::size_t m_available;            // Bytes of m_data published to the parser
+        bool m_finished;
+        bool m_stop;
+        const char *m_error;
+        boost::mutex m_mutex;
+        boost::condition_variable m_ready;
+        boost::thread m_thread;
+    };
+
+    //! \cond internal
+    namespace internal
+    {
+        // Parses the nodes in [pos, end) of source under parent, waiting for the data as it is decompressed.
+        // Groups larger than what is available are opened and their children parsed one by one, down to levels deep.
+        template<class Byte, class Source>
+        bool parse_streaming(detail::rapidasn1::asn1_tree<Byte> &tree,
+                             detail::rapidasn1::asn1_node<Byte> *parent,
+                             Source &source, const Byte *text,
+                             std::size_t pos, std::size_t end, int levels,
+                             detail::rapidasn1::parse_result &result)
+        {
+            using namespace detail::rapidasn1;
+            while (pos < end)
+            {
+                std::size_t limit = std::min(source.wait(std::min(pos + 10, end)), end);
+                std::size_t tag = 0, len = 0;
+                int is_varlen = 0;
+                parse_code code = error_none;
+                std::size_t tag_size = detail::rapidasn1::internal::decode_tag<parse_default>(text + pos, limit - pos, tag);
+                std::size_t len_size = tag_size ? detail::rapidasn1::internal::decode_len<parse_default>(text + pos + tag_size, limit - pos - tag_size, len, is_varlen, code) : 0;
+                std::size_t header = tag_size + len_size;
+
+                asn1_node<Byte> *node = tree.allocate_node(node_nongroup);
+                parent->append_node(node);
+                if (len_size && (text[pos] & 0x20) && !is_varlen && levels > 0 &&
+                    len <= end - pos - header && source.wait(pos + header + len) < pos + header + len)
+                {
+                    // Not decoded yet: open the group and stream its children
+                    node->node_class(static_cast<class_type>((text[pos] & 0xC0) >> 6));
+                    node->type(node_group);
+                    node->tag(tag);
+                    node->value(text + pos + header, len);
+                    if (!parse_streaming(tree, node, source, text, pos + header, pos + header + len, levels - 1, result))
+                        return false;
+                    pos += header + len;
+                    continue;
+                }
+
+                // Whole node at once; malformed headers are reported by the parser
+                std::size_t node_end = len_size && !is_varlen && len <= end - pos - header ? pos + header + len : end;
+                node_end = std::min(source.wait(node_end), node_end);
+                std::size_t node_size = tree.template parse_node<parse_default>(text + pos, node_end - pos, node, result);
+                if (!node_size)
+                {
+                    result.where += pos;
+                    return false;
+                }
+                pos += node_size;
+            }
+            return true;
+        }
+
+        // Source of data already in memory
+        struct memory_source
+        {
+            std::size_t size;
+            std::size_t wait(std::size_t)
+            {
+                return size;
+            }
+        };
+    }
+    //! \endcond
+
+    //! Parses a file as it is being decompressed, into tree.
+    //! Call events are parsed while later ones are still being decompressed.
+    //! \param source Source of the file; it must outlive tree.
+    //! \param result Receives the parse or decompression error.
+    //! \return true on success.
+    template<class Byte>
+    bool parse_streaming(detail::rapidasn1::asn1_tree<Byte> &tree, decompressing_source &source,
+                         detail::rapidasn1::parse_result &result)
+    {
+        tree.remove_all_nodes();
+        result.code = detail::rapidasn1::error_none;
+        std::size_t size = source.size();
+        bool ok = internal::parse_streaming(tree, &tree, source, reinterpret_cast<const Byte *>(source.data()),
+                                            0, size, 2, result);
+        const std::vector<unsigned char> &tail = source.tail();
+        if (ok && !tail.empty())
+        {
+            internal::memory_source rest = {tail.size()};
+            ok = internal::parse_streaming(tree, &tree, rest, reinterpret_cast<const Byte *>(&tail[0]),
+                                           0, tail.size(), 0, result);
+            if (!ok)
+                result.where += size;
+        }
+        if (const char *error = source.error())
+        {
+            // A decompression error explains a parse error at the end of the data
+            result.code = detail::rapidasn1::error_unexpected_end;
+            result.what = error;
+            result.where = source.wait(static_cast<std::size_t>(-1));
+            return false;
+        }
+        return ok;
+    }
+
+    //! Reads a compressed or uncompressed file into pt, parsing while it is decompressed.
+    template<class Ptree>
+    void read_asn1_compressed_internal(const std::string &filename, Ptree &pt)
+    {
+        typedef unsigned char Byte;
+        decompressing_source source(filename);
+        detail::rapidasn1::asn1_tree<Byte> tree;
+        detail::rapidasn1::parse_result result;
+        if (!parse_streaming(tree, source, result))
+            BOOST_PROPERTY_TREE_THROW(asn1_parser_error(result.what, filename, 0, result.where));
+        read_asn1_node(&tree, pt);
+    }
+
+} } }
+
+#endif
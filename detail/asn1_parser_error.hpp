@@ -11,20 +11,50 @@
 #define BOOST_PROPERTY_TREE_DETAIL_ASN1_PARSER_ERROR_HPP_INCLUDED
 
 #include <boost/property_tree/detail/file_parser_error.hpp>
+#include <boost/cstdint.hpp>
+#include <cstdio>
 #include <string>
 
 namespace boost { namespace property_tree { namespace asn1_parser
 {
-    //! ASN1 parser error
+    //! ASN1 parser error.
+    //! BER data has no lines: line() is always 0 and offset() gives the position in the file instead,
+    //! as a 64-bit byte offset so that batches above 4 GB are reported exactly.
     class asn1_parser_error: public file_parser_error
     {
     public:
+        //! Offset of errors that are not about a position of the data, such as a file that cannot be opened
+        static boost::uint64_t no_offset()
+        {
+            return ~static_cast<boost::uint64_t>(0);
+        }
+
         asn1_parser_error(const std::string &message, 
                           const std::string &filename, 
-                          unsigned long line): 
-            file_parser_error(message, filename, line)
+                          unsigned long line,
+                          boost::uint64_t offset = no_offset()): 
+            file_parser_error(format_message(message, offset), filename, line),
+            m_offset(offset)
         { 
         }
+
+        //! Byte offset of the error in the file or buffer, or no_offset()
+        boost::uint64_t offset() const
+        {
+            return m_offset;
+        }
+
+    private:
+        static std::string format_message(const std::string &message, boost::uint64_t offset)
+        {
+            if (offset == no_offset())
+                return message;
+            char text[40];
+            std::sprintf(text, " at offset %llu", static_cast<unsigned long long>(offset));
+            return message + text;
+        }
+
+        boost::uint64_t m_offset;
     };
     
 } } }
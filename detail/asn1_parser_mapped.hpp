@@ -0,0 +1,133 @@
+// ----------------------------------------------------------------------------
+// Copyright (C) 2015-2016 zunceng@gmail.com
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+// For more information, see www.boost.org
+// ----------------------------------------------------------------------------
+#ifndef BOOST_PROPERTY_TREE_DETAIL_ASN1_PARSER_MAPPED_HPP_INCLUDED
+#define BOOST_PROPERTY_TREE_DETAIL_ASN1_PARSER_MAPPED_HPP_INCLUDED
+
+//! \file asn1_parser_mapped.hpp Memory mapping of files larger than the address space can hold,
+//! one window at a time. Positions in the file are boost::uint64_t throughout;
+//! std::size_t is only used for sizes within a window.
+
+#include "asn1_parser_error.hpp"
+#include <boost/cstdint.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <fstream>
+#include <string>
+
+#ifndef BOOST_PROPERTY_TREE_ASN1_MAP_WINDOW_SIZE
+    // Largest part of a file mapped at once by mapped_file, plus one page.
+    // Define BOOST_PROPERTY_TREE_ASN1_MAP_WINDOW_SIZE before including asn1_parser.hpp if you want to override the default value.
+    #define BOOST_PROPERTY_TREE_ASN1_MAP_WINDOW_SIZE (static_cast<std::size_t>(sizeof(void *) < 8 ? 64 : 1024) * 1024 * 1024)
+#endif
+
+namespace boost { namespace property_tree { namespace asn1_parser
+{
+    //! Read-only mapping of a file through a window that moves on demand.
+    //! Files no larger than the window are mapped once; larger ones, such as consolidated
+    //! batches above 4 GB on a 32-bit target, are remapped as map() asks for other parts.
+    class mapped_file
+    {
+    public:
+
+        //! Opens filename; throws asn1_parser_error if it cannot be opened.
+        //! \param window_size Largest size map() accepts, rounded up to a multiple of the page size.
+        explicit mapped_file(const std::string &filename,
+                             std::size_t window_size = BOOST_PROPERTY_TREE_ASN1_MAP_WINDOW_SIZE)
+            : m_filename(filename)
+            , m_begin(0)
+        {
+            std::size_t page_size = boost::interprocess::mapped_region::get_page_size();
+            m_window_size = (window_size + page_size - 1) / page_size * page_size;
+            std::ifstream stream(filename.c_str(), std::ios::in | std::ios::binary);
+            if (stream)
+                stream.seekg(0, std::ios::end);
+            std::streamoff size = stream ? static_cast<std::streamoff>(stream.tellg()) : -1;
+            if (size < 0)
+                BOOST_PROPERTY_TREE_THROW(asn1_parser_error("cannot open file", filename, 0));
+            m_size = static_cast<boost::uint64_t>(size);
+            if (!m_size)
+                return;
+            try
+            {
+                boost::interprocess::file_mapping mapping(filename.c_str(), boost::interprocess::read_only);
+                m_file.swap(mapping);
+            }
+            catch (boost::interprocess::interprocess_exception &)
+            {
+                BOOST_PROPERTY_TREE_THROW(asn1_parser_error("cannot open file", filename, 0));
+            }
+        }
+
+        const std::string &filename() const
+        {
+            return m_filename;
+        }
+
+        //! Size of the file
+        boost::uint64_t size() const
+        {
+            return m_size;
+        }
+
+        //! Largest size map() accepts
+        std::size_t window_size() const
+        {
+            return m_window_size;
+        }
+
+        //! Maps size bytes of the file from offset, moving the window if they are not in it.
+        //! The pointer is valid until the next call to map().
+        //! Throws asn1_parser_error if the bytes are past the end of the file or size exceeds window_size().
+        const unsigned char *map(boost::uint64_t offset, std::size_t size)
+        {
+            if (offset > m_size || size > m_size - offset)
+                BOOST_PROPERTY_TREE_THROW(asn1_parser_error("unexpect end: mapped_file::map()", m_filename, 0, offset));
+            if (size > m_window_size)
+                BOOST_PROPERTY_TREE_THROW(asn1_parser_error("larger than the mapping window: mapped_file::map()",
+                                                            m_filename, 0, offset));
+            if (!size)
+                return 0;
+            if (offset < m_begin || offset + size > m_begin + m_region.get_size())
+            {
+                // Windows start on a page; one more page keeps size bytes inside whatever the offset
+                std::size_t page_size = boost::interprocess::mapped_region::get_page_size();
+                boost::uint64_t begin = offset / page_size * page_size;
+                boost::uint64_t length = m_size - begin;
+                if (length > m_window_size + page_size)
+                    length = m_window_size + page_size;
+                try
+                {
+                    boost::interprocess::mapped_region region(m_file, boost::interprocess::read_only,
+                                                              static_cast<boost::interprocess::offset_t>(begin),
+                                                              static_cast<std::size_t>(length));
+                    m_region.swap(region);
+                }
+                catch (boost::interprocess::interprocess_exception &)
+                {
+                    BOOST_PROPERTY_TREE_THROW(asn1_parser_error("cannot map file", m_filename, 0, offset));
+                }
+                m_begin = begin;
+            }
+            return static_cast<const unsigned char *>(m_region.get_address()) + static_cast<std::size_t>(offset - m_begin);
+        }
+
+    private:
+
+        std::string m_filename;
+        boost::interprocess::file_mapping m_file;
+        boost::interprocess::mapped_region m_region;
+        boost::uint64_t m_size;
+        boost::uint64_t m_begin;            // Offset of the window in the file
+        std::size_t m_window_size;
+    };
+
+} } }
+
+#endif
@@ -20,12 +20,33 @@
 #include <vector>
 #include <algorithm>
 #include <boost/lexical_cast.hpp>
+#include <boost/utility/string_ref.hpp>
 #include "asn1_parser_error.hpp"
 #include "rapidasn1.hpp"
 
 
 namespace boost { namespace property_tree { namespace asn1_parser
 {
+    //! Writes tag in decimal to key, which must hold 20 characters.
+    //! \return Number of characters written.
+    inline std::size_t tag_key(std::size_t tag, char *key)
+    {
+        char digits[20];
+        std::size_t n = 0;
+        do
+        {
+            digits[n++] = static_cast<char>('0' + tag % 10);
+            tag /= 10;
+        } while (tag);
+        for (std::size_t i = 0; i < n; ++i)
+            key[i] = digits[n - 1 - i];
+        return n;
+    }
+
+    //! Copies the nodes under node into pt, keyed by their tags in decimal.
+    //! Keys stay strings even in an asn1_view_ptree: ptree paths need a string key, and a tag
+    //! has no text in the buffer to view. Tag numbers fit the small-string buffer of common
+    //! standard libraries, so making a key allocates nothing.
     template<class Ptree, class Byte>
     void read_asn1_node(detail::rapidasn1::asn1_node<Byte> *node,
                        Ptree &pt)
@@ -39,15 +60,16 @@ namespace boost { namespace property_tree { namespace asn1_parser
         {
             case node_nongroup:
             {
-                pt.data() = typename Ptree::key_type((const char*)node->value(), node->value_size());
+                pt.data() = typename Ptree::data_type((const char*)node->value(), node->value_size());
             }break;
             case node_group:
             {
                 // Copy children
                 for (asn1_node<Byte> *child = node->first_node(); child; child = child->next_sibling())
                 {
+                    char key[20];
                     Ptree &pt_node = pt.push_back(
-                        std::make_pair(boost::lexical_cast<std::string>(child->tag()),Ptree()))->second;
+                        std::make_pair(typename Ptree::key_type(key, tag_key(child->tag(), key)), Ptree()))->second;
                     read_asn1_node(child, pt_node);
                 }
             }break;
@@ -57,6 +79,52 @@ namespace boost { namespace property_tree { namespace asn1_parser
         }
     }
     
+    //! Parses size bytes at data into pt.
+    //! If the data type of Ptree is a non-owning view (see asn1_view_ptree),
+    //! the values of pt point into data, which must then outlive pt.
+    //! Throws asn1_parser_error, with filename and the offset of the error, if the data is malformed.
+    template<class Ptree, class Byte>
+    void read_asn1_internal(const Byte *data, std::size_t size,
+                            Ptree &pt,
+                            const std::string &filename)
+    {
+        boost::property_tree::detail::rapidasn1::asn1_tree<Byte> tree;
+        detail::rapidasn1::parse_result result;
+        if (!tree.template parse<detail::rapidasn1::parse_default>(data, size, result))
+            BOOST_PROPERTY_TREE_THROW(asn1_parser_error(result.what, filename, 0, result.where));
+        
+        // tree.print<1>();
+        read_asn1_node(&tree, pt);
+    }
+
+    //! Parses size bytes at data into pt without using exceptions for malformed data.
+    //! \return true on success; otherwise pt is left untouched and result holds the error.
+    template<class Ptree, class Byte>
+    bool read_asn1_internal(const Byte *data, std::size_t size,
+                            Ptree &pt,
+                            detail::rapidasn1::parse_result &result)
+    {
+        boost::property_tree::detail::rapidasn1::asn1_tree<Byte> tree;
+        if (!tree.template parse<detail::rapidasn1::parse_default>(data, size, result))
+            return false;
+        read_asn1_node(&tree, pt);
+        return true;
+    }
+
+    //! Parses size bytes at data into pt, skipping broken groups (see asn1_tree::parse_recover()).
+    //! \return true if all the data was consumed.
+    template<class Ptree, class Byte>
+    bool read_asn1_internal(const Byte *data, std::size_t size,
+                            Ptree &pt,
+                            const std::string &filename,
+                            std::vector<detail::rapidasn1::parse_failure> &failures)
+    {
+        boost::property_tree::detail::rapidasn1::asn1_tree<Byte> tree;
+        bool complete = tree.template parse_recover<detail::rapidasn1::parse_default>(data, size, failures);
+        read_asn1_node(&tree, pt);
+        return complete;
+    }
+
     template<class Ptree>
     void read_asn1_internal(std::basic_istream<typename Ptree::key_type::value_type> &stream,
                             Ptree &pt,
@@ -71,62 +139,113 @@ namespace boost { namespace property_tree { namespace asn1_parser
         if (!stream.good())
             BOOST_PROPERTY_TREE_THROW(asn1_parser_error("read error", filename, 0));
 
-        boost::property_tree::detail::rapidasn1::asn1_tree<Byte> tree;
-        tree.parse<1>((const Byte*)(&*v.begin()), v.size());
-        
-        // tree.print<1>();
-        read_asn1_node(&tree, pt);
+        read_asn1_internal((const Byte*)(&*v.begin()), v.size(), pt, filename);
+    }
+
+    template<class Ptree>
+    bool read_asn1_internal(std::basic_istream<typename Ptree::key_type::value_type> &stream,
+                            Ptree &pt,
+                            const std::string &filename,
+                            std::vector<detail::rapidasn1::parse_failure> &failures)
+    {
+        typedef typename Ptree::key_type::value_type Ch;
+        typedef unsigned char Byte;
+
+        // Load data into vector
+        std::vector<Ch> v(std::istreambuf_iterator<Ch>(stream.rdbuf()),
+                          std::istreambuf_iterator<Ch>());
+        if (!stream.good())
+            BOOST_PROPERTY_TREE_THROW(asn1_parser_error("read error", filename, 0));
+
+        return read_asn1_internal((const Byte*)(&*v.begin()), v.size(), pt, filename, failures);
     }
     
-    template<int Flags>
-    long long binary2Int(const std::string& data)
+    //! Property tree whose values are non-owning views into the parsed buffer.
+    //! Fill it with read_asn1(data, size, pt); the buffer must outlive the tree.
+    typedef basic_ptree<std::string, boost::string_ref> asn1_view_ptree;
+
+    //! Decodes a two's complement integer of 1 to 8 octets; throws asn1_parser_error for other sizes,
+    //! or returns 0 for them if Flags has parse_non_validating.
+    template<int Flags, class Byte>
+    long long binary2Int(const Byte *data, std::size_t size)
     {
-        if (data.length() <= 8&& data.length()>0)
+        if (size - 1 < 8)
         {
             unsigned long long ret = 0;
             
-            int negative = (*data.begin()) & 0x80;
-            for(std::string::const_iterator it=data.begin(); it!=data.end(); it++)
+            int negative = data[0] & 0x80;
+            for(std::size_t i = 0; i < size; i++)
             {
                 ret <<= 8;
-                ret |= reinterpret_cast<const unsigned char&>(*it);
+                ret |= static_cast<unsigned char>(data[i]);
             }
             if (negative)
             {
-                for(int i = data.length(); i<8; i++)
+                for(std::size_t i = size; i<8; i++)
                 {
                     ret |= (0xFFULL) << (i*8);
                 }
             }
-            return reinterpret_cast<long long&>(ret);
+            return static_cast<long long>(ret);
         }
-        BOOST_PROPERTY_TREE_THROW(asn1_parser_error("parse int error", "", 0));
+        if (!(Flags & detail::rapidasn1::parse_non_validating))
+            BOOST_PROPERTY_TREE_THROW(asn1_parser_error("parse int error", "", 0));
         return 0;
     }
 
+    template<int Flags>
+    long long binary2Int(const std::string& data)
+    {
+        return binary2Int<Flags>(data.data(), data.size());
+    }
+
+    //! Returns a view of the octets; nothing is copied.
+    template<int Flags, class Byte>
+    boost::string_ref binary2OCTString(const Byte *data, std::size_t size)
+    {
+        return boost::string_ref(reinterpret_cast<const char *>(data), size);
+    }
+
     template<int Flags>
     std::string binary2OCTString(const std::string& data)
     {
         return data;
     }
-    template<int Flags>
-    std::string binary2BCDString(const std::string& data)
+
+    //! Writes the digits of a BCD string to out, which must hold 2*size characters.
+    //! \return Number of digits written.
+    template<int Flags, class Byte>
+    std::size_t binary2BCDString(const Byte *data, std::size_t size, char *out)
     {
-        std::string ret;
-        for(std::string::const_iterator it=data.begin(); it!=data.end(); it++)
+        std::size_t n = 0;
+        for(std::size_t i = 0; i < size; i++)
         {
-            char high = ((*it)&0xF0)>>4;
-            char low = (*it)&0x0F;
+            char high = (data[i]&0xF0)>>4;
+            char low = data[i]&0x0F;
             
             if (high == 0x0F)
                 break;
-            ret.append(1, high+'0');
+            out[n++] = high+'0';
             if (low == 0x0F)
                 break;
-            ret.append(1, low+'0');
+            out[n++] = low+'0';
         }
+        return n;
+    }
+
+    template<int Flags, class Byte>
+    std::string binary2BCDString(const Byte *data, std::size_t size)
+    {
+        std::string ret(2*size, '\0');
+        ret.resize(size ? binary2BCDString<Flags>(data, size, &ret[0]) : 0);
         return ret;
     }
+
+    template<int Flags>
+    std::string binary2BCDString(const std::string& data)
+    {
+        return binary2BCDString<Flags>(data.data(), data.size());
+    }
     
 } } }
 
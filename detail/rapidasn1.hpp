@@ -15,10 +15,37 @@
 #include <boost/assert.hpp>
 #include <cstdlib>      // For std::size_t
 #include <new>          // For placement new
+#include <vector>       // For parse_recover() failure list
+
+#if defined(__linux__)
+#include <sys/mman.h>       // For memory mapped pool blocks
+#include <sys/syscall.h>    // For mbind
+#include <unistd.h>
+#endif
 
 ///////////////////////////////////////////////////////////////////////////
 // BOOST_PROPERTY_TREE_RAPIDASN1_PARSE_ERROR
     
+#if defined(BOOST_PROPERTY_TREE_RAPIDASN1_NO_EXCEPTIONS)
+
+#define BOOST_PROPERTY_TREE_RAPIDASN1_PARSE_ERROR(what, where) { parse_error_handler(what, where); BOOST_ASSERT(0); }
+
+namespace boost { namespace property_tree { namespace detail {namespace rapidasn1
+{
+    //! When exceptions are disabled by defining BOOST_PROPERTY_TREE_RAPIDASN1_NO_EXCEPTIONS,
+    //! this function is called by the throwing parse functions to notify user about the error.
+    //! It must be defined by the user.
+    //! <br><br>
+    //! This function cannot return. If it does, the results are undefined.
+    //! <br><br>
+    //! The parse() overload taking a parse_result never calls this function.
+    //! \param what Human readable description of the error.
+    //! \param where Position within the parsed data where the error was detected.
+    void parse_error_handler(const char *what, std::size_t where);
+}}}}
+
+#else
+    
 #include <exception>    // For std::exception
 
 #define BOOST_PROPERTY_TREE_RAPIDASN1_PARSE_ERROR(what, where) throw parse_error(what, where)
@@ -32,7 +59,7 @@ namespace boost { namespace property_tree { namespace detail {namespace rapidasn
     //! Use where() function to get a pointer to position within source text where error was detected.
     //! <br><br>
     //! If throwing exceptions by the parser is undesirable, 
-    //! it can be disabled by defining RAPIDASN1_NO_EXCEPTIONS macro before rapidasn1.hpp is included.
+    //! it can be disabled by defining BOOST_PROPERTY_TREE_RAPIDASN1_NO_EXCEPTIONS macro before rapidasn1.hpp is included.
     //! This will cause the parser to call rapidasn1::parse_error_handler() function instead of throwing an exception.
     //! This function must be defined by the user.
     //! <br><br>
@@ -63,7 +90,7 @@ namespace boost { namespace property_tree { namespace detail {namespace rapidasn
         }
 
         //! Gets position of data where error happened.
-        //! \return Pointer to location within the parsed string where error occured.
+        //! \return Offset of the error from the start of the parsed data.
         size_t where() const throw()
         {
             return m_where;
@@ -77,6 +104,104 @@ namespace boost { namespace property_tree { namespace detail {namespace rapidasn
     };
 }}}}
 
+#endif
+
+namespace boost { namespace property_tree { namespace detail {namespace rapidasn1
+{
+    //! Error codes reported through parse_result.
+    enum parse_code
+    {
+        error_none = 0,             //!< No error.
+        error_unexpected_end,       //!< Data ends inside a tag, length or value.
+        error_bad_length,           //!< Length field is not supported.
+        error_overrun,              //!< Length runs past the enclosing group or the data.
+        error_missing_end,          //!< Indefinite-length group without end-of-contents marker.
+        error_varlen_primitive,     //!< Indefinite length on a primitive node.
+        error_too_deep,             //!< Nesting deeper than the validator supports.
+        error_bad_tag,              //!< Multi-octet tag while parsing with parse_single_byte_tags.
+    };
+
+    //! Outcome of a parse, returned by the exception-free parse functions.
+    //! what and where are only meaningful when code is not error_none.
+    struct parse_result
+    {
+        parse_code code;            //!< Error code, error_none on success
+        const char *what;           //!< Human readable description of the error
+        std::size_t where;          //!< Position within the parsed data where the error was detected
+
+        //! \return true if the parse succeeded.
+        bool ok() const
+        {
+            return code == error_none;
+        }
+    };
+
+    //! Record of a node skipped by asn1_tree::parse_recover().
+    struct parse_failure
+    {
+        const char *what;           //!< Description of the error that caused the skip
+        std::size_t where;          //!< Position of the error within the parsed data
+        std::size_t offset;         //!< Position of the skipped node within the parsed data
+        std::size_t size;           //!< Bytes skipped, header included; 0 if parsing had to stop here
+        std::size_t tag;            //!< Tag of the skipped node, or 0 if parsing had to stop here
+        parse_code code;            //!< Error code of the error that caused the skip
+    };
+
+    ///////////////////////////////////////////////////////////////////////
+    // Parsing flags
+
+    //! Parse flag instructing the parser to reject indefinite-length encodings.
+    //! A length octet of 0x80 is reported as error_bad_length, and end-of-contents markers are never looked for.
+    //! Can be combined with other flags by use of | operator.
+    //! <br><br>
+    //! See asn1_tree::parse() function.
+    const int parse_definite_only = 0x2;
+
+    //! Parse flag instructing the parser to skip bounds checks.
+    //! Lengths are trusted to fit in their group and in the data, and headers to end before the data.
+    //! Use it only on data that has already been checked, for example with validate();
+    //! on malformed data the behaviour is undefined.
+    //! binary2Int() no longer checks the size of its input either.
+    //! Can be combined with other flags by use of | operator.
+    //! <br><br>
+    //! See asn1_tree::parse() function.
+    const int parse_non_validating = 0x4;
+
+    //! Parse flag instructing the parser to not set value pointers of group nodes.
+    //! value() of a group is then empty; value_size() still gives the length of its content.
+    //! Can be combined with other flags by use of | operator.
+    //! <br><br>
+    //! See asn1_tree::parse() function.
+    const int parse_no_group_values = 0x8;
+
+    //! Parse flag instructing the parser to decode single-octet identifiers only, with tag numbers up to 30.
+    //! Other identifiers are reported as error_bad_tag, or misread with parse_non_validating.
+    //! Can be combined with other flags by use of | operator.
+    //! <br><br>
+    //! See asn1_tree::parse() function.
+    const int parse_single_byte_tags = 0x10;
+
+    //! Parse flag instructing the parser to build group nodes only.
+    //! Primitive nodes are skipped by their length without allocating a node,
+    //! and walk() does not call the value() function of its handler.
+    //! Can be combined with other flags by use of | operator.
+    //! <br><br>
+    //! See asn1_tree::parse() function.
+    const int parse_structure_only = 0x20;
+
+    //! Parse flags which represent default behaviour of the parser.
+    //! This is always equal to 0, so that all other flags can be simply ored together.
+    //! <br><br>
+    //! See asn1_tree::parse() function.
+    const int parse_default = 0;
+
+    //! A combination of parse flags resulting in fastest possible parsing of trusted data,
+    //! keeping every node but not the value pointers of groups.
+    //! <br><br>
+    //! See asn1_tree::parse() function.
+    const int parse_fastest = parse_non_validating | parse_no_group_values;
+}}}}
+
 ///////////////////////////////////////////////////////////////////////////
 // Pool sizes
 
@@ -94,6 +219,18 @@ namespace boost { namespace property_tree { namespace detail {namespace rapidasn
     #define BOOST_PROPERTY_TREE_RAPIDASN1_DYNAMIC_POOL_SIZE (64 * 1024)
 #endif
 
+#ifndef BOOST_PROPERTY_TREE_RAPIDASN1_MAX_POOL_SIZE
+    // Largest dynamic memory block of memory_pool when blocks grow geometrically.
+    // Define BOOST_PROPERTY_TREE_RAPIDASN1_MAX_POOL_SIZE before including rapidasn1.hpp if you want to override the default value.
+    #define BOOST_PROPERTY_TREE_RAPIDASN1_MAX_POOL_SIZE (64 * 1024 * 1024)
+#endif
+
+#ifndef BOOST_PROPERTY_TREE_RAPIDASN1_HUGE_PAGE_SIZE
+    // Size of the huge pages backing memory_pool blocks with pool_huge_pages.
+    // Define BOOST_PROPERTY_TREE_RAPIDASN1_HUGE_PAGE_SIZE before including rapidasn1.hpp if you want to override the default value.
+    #define BOOST_PROPERTY_TREE_RAPIDASN1_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+#endif
+
 #ifndef BOOST_PROPERTY_TREE_RAPIDASN1_ALIGNMENT
     // Memory allocation alignment.
     // Define BOOST_PROPERTY_TREE_RAPIDASN1_ALIGNMENT before including rapidxml.hpp if you want to override the default value, which is the size of pointer.
@@ -148,13 +285,92 @@ namespace boost { namespace property_tree { namespace detail {namespace rapidasn
             // static const unsigned char lookup_upcase[256];                  // To uppercase conversion table for ASCII characters
         // };        
 
-        
+        // Decodes the tag number of the identifier octets at text.
+        // Class and constructed bit are in text[0].
+        // Returns the size of the identifier, or 0 if the data ends first.
+        template<int Flags, class Byte>
+        inline std::size_t decode_tag(const Byte *text, std::size_t size, std::size_t &tag)
+        {
+            if (!(Flags & parse_non_validating) && !size)
+                return 0;
+            tag = (*text) & 0x1F;
+            if (Flags & parse_single_byte_tags)
+                return (Flags & parse_non_validating) || tag <= 30 ? 1 : 0;
+            if (tag <= 30)
+                return 1;
+            tag = 0;
+            for (std::size_t pos = 1; (Flags & parse_non_validating) || pos < size; ++pos)
+            {
+                Byte cur = *(text+pos);
+                tag <<= 7;
+                tag += cur & 0x7F;
+                if (!(cur&0x80))
+                    return pos+1;
+            }
+            return 0;
+        }
+
+        // Decodes the length octets at text into len, which may be std::size_t or boost::uint64_t.
+        // Lengths of up to sizeof(Length) octets are accepted, so 8 octets on 64-bit targets;
+        // a longer length field cannot be stored and is malformed.
+        // Returns the size of the length field, or 0 with code set if it is malformed.
+        template<int Flags, class Byte, class Length>
+        inline std::size_t decode_len(const Byte *text, std::size_t size, Length &len, int &is_varlen, parse_code &code)
+        {
+            if (!(Flags & parse_non_validating) && !size)
+            {
+                code = error_unexpected_end;
+                return 0;
+            }
+            if (!((*text) & 0x80))
+            {
+                len = *text;
+                is_varlen = 0;
+                return 1;
+            }
+            std::size_t n = (*text) & 0x7F;
+            if (n == 0)
+            {
+                if (Flags & parse_definite_only)
+                {
+                    code = error_bad_length;
+                    return 0;
+                }
+                is_varlen = 1;
+                return 1;
+            }
+            is_varlen = 0;
+            if (n > sizeof(Length))
+            {
+                code = error_bad_length;
+                return 0;
+            }
+            if (!(Flags & parse_non_validating) && n+1 > size)
+            {
+                code = error_unexpected_end;
+                return 0;
+            }
+            len = 0;
+            for (std::size_t i = 1; i <= n; ++i)
+            {
+                len <<= 8;
+                len |= static_cast<unsigned char>(*(text+i));
+            }
+            return n+1;
+        }
     }
     //! \endcond
 
     ///////////////////////////////////////////////////////////////////////
     // Memory pool
     
+    //! Options of memory_pool blocks, see memory_pool::set_options().
+    enum pool_options
+    {
+        pool_huge_pages = 0x1,      //!< Back blocks with huge pages (MAP_HUGETLB, else transparent huge pages through madvise)
+        pool_numa_local = 0x2,      //!< Bind blocks to the NUMA node of the allocating thread
+    };
+
     //! This class is used by the parser to create new nodes and attributes, without overheads of dynamic memory allocation.
     //! In most cases, you will not need to use this class directly. 
     //! However, if you need to create nodes manually or modify names/values of nodes, 
@@ -178,6 +394,8 @@ namespace boost { namespace property_tree { namespace detail {namespace rapidasn
     //! by using global <code>new[]</code> and <code>delete[]</code> operators. 
     //! This behaviour can be changed by setting custom allocation routines. 
     //! Use set_allocator() function to set them.
+    //! The block size can also be chosen at run time, with geometric growth, using set_block_size(),
+    //! and blocks can be mapped on huge pages local to the NUMA node of the parsing thread using set_options().
     //! <br><br>
     //! Allocations for nodes, attributes and strings are aligned at <code>BOOST_PROPERTY_TREE_RAPIDASN1_ALIGNMENT</code> bytes.
     //! This value defaults to the size of pointer on target architecture.
@@ -205,6 +423,10 @@ namespace boost { namespace property_tree { namespace detail {namespace rapidasn
         memory_pool()
             : m_alloc_func(0)
             , m_free_func(0)
+            , m_first_block_size(BOOST_PROPERTY_TREE_RAPIDASN1_DYNAMIC_POOL_SIZE)
+            , m_max_block_size(BOOST_PROPERTY_TREE_RAPIDASN1_DYNAMIC_POOL_SIZE)
+            , m_growth(1)
+            , m_options(0)
         {
             init();
         }
@@ -247,6 +469,27 @@ namespace boost { namespace property_tree { namespace detail {namespace rapidasn
             return node;
         }
         
+        //! Allocates a string from the pool, copying size characters of source if it is not 0.
+        //! \param source String to copy, or 0 to leave the allocated string uninitialized.
+        //! \param size Number of characters to allocate.
+        //! \return Pointer to allocated string. This pointer will never be NULL.
+        Byte *allocate_string(const Byte *source, std::size_t size)
+        {
+            Byte *result = static_cast<Byte *>(allocate_aligned(size * sizeof(Byte)));
+            if (source)
+                for (std::size_t i = 0; i < size; ++i)
+                    result[i] = source[i];
+            return result;
+        }
+
+        //! Allocates raw memory from the pool for objects other than nodes, such as the nodes of a translated tree.
+        //! The memory is aligned at <code>BOOST_PROPERTY_TREE_RAPIDASN1_ALIGNMENT</code> bytes and released with the pool.
+        //! \return Pointer to allocated memory. This pointer will never be NULL.
+        void *allocate_memory(std::size_t size)
+        {
+            return allocate_aligned(size);
+        }
+
         //! Clones an asn1_node and its hierarchy of child nodes and attributes.
         //! Nodes and attributes are allocated from this memory pool.
         //! Names and values are not cloned, they are shared between the clone and the source.
@@ -286,11 +529,9 @@ namespace boost { namespace property_tree { namespace detail {namespace rapidasn
         {
             while (m_begin != m_static_memory)
             {
-                char *previous_begin = reinterpret_cast<header *>(align(m_begin))->previous_begin;
-                if (m_free_func)
-                    m_free_func(m_begin);
-                else
-                    delete[] m_begin;
+                header *block = reinterpret_cast<header *>(align(m_begin));
+                char *previous_begin = block->previous_begin;
+                free_raw(m_begin, block->size, block->mapped);
                 m_begin = previous_begin;
             }
             init();
@@ -316,11 +557,44 @@ namespace boost { namespace property_tree { namespace detail {namespace rapidasn
             m_free_func = ff;
         }
 
+        //! Sets the size of the dynamic blocks allocated once static memory is exhausted.
+        //! Each new block is growth times bigger than the previous one, up to max_size;
+        //! clear() starts over from size.
+        //! This can only be called when no memory is allocated from the pool yet, otherwise results are undefined.
+        //! \param size Size of the first dynamic block
+        //! \param growth Growth factor of the block size, 1 for fixed size blocks
+        //! \param max_size Largest block size, or 0 for <code>BOOST_PROPERTY_TREE_RAPIDASN1_MAX_POOL_SIZE</code>
+        void set_block_size(std::size_t size, std::size_t growth = 1, std::size_t max_size = 0)
+        {
+            BOOST_ASSERT(m_begin == m_static_memory && m_ptr == align(m_begin));    // Verify that no memory is allocated yet
+            BOOST_ASSERT(size > 0 && growth > 0);
+            m_first_block_size = size;
+            m_growth = growth;
+            m_max_block_size = growth == 1 ? size : (max_size ? max_size : BOOST_PROPERTY_TREE_RAPIDASN1_MAX_POOL_SIZE);
+            if (m_max_block_size < size)
+                m_max_block_size = size;
+            m_block_size = size;
+        }
+
+        //! Sets how dynamic blocks are obtained, as a combination of pool_options.
+        //! Blocks are then memory mapped, rounded up to whole huge pages with pool_huge_pages;
+        //! when huge pages or NUMA binding are not available, plain pages are used.
+        //! Options are ignored when user-defined allocation functions are set, and on systems without mmap.
+        //! This can only be called when no memory is allocated from the pool yet, otherwise results are undefined.
+        //! \param options Combination of pool_options, or 0 for the default allocation
+        void set_options(int options)
+        {
+            BOOST_ASSERT(m_begin == m_static_memory && m_ptr == align(m_begin));    // Verify that no memory is allocated yet
+            m_options = options;
+        }
+
     private:
 
         struct header
         {
             char *previous_begin;
+            std::size_t size;           // Size of the raw block
+            bool mapped;                // Block was obtained with mmap
         };
 
         void init()
@@ -328,6 +602,7 @@ namespace boost { namespace property_tree { namespace detail {namespace rapidasn
             m_begin = m_static_memory;
             m_ptr = align(m_begin);
             m_end = m_static_memory + sizeof(m_static_memory);
+            m_block_size = m_first_block_size;
         }
         
         char *align(char *ptr)
@@ -336,11 +611,16 @@ namespace boost { namespace property_tree { namespace detail {namespace rapidasn
             return ptr + alignment;
         }
         
-        char *allocate_raw(std::size_t size)
+        char *allocate_raw(std::size_t &size, bool &mapped)
         {
             // Allocate
             void *memory;   
-            if (m_alloc_func)   // Allocate memory using either user-specified allocation function or global operator new[]
+            mapped = false;
+            if (!m_alloc_func && m_options && (memory = map_raw(size)) != 0)
+            {
+                mapped = true;
+            }
+            else if (m_alloc_func)   // Allocate memory using either user-specified allocation function or global operator new[]
             {
                 memory = m_alloc_func(size);
                 BOOST_ASSERT(memory); // Allocator is not allowed to return 0, on failure it must either throw, stop the program or use longjmp
@@ -351,6 +631,73 @@ namespace boost { namespace property_tree { namespace detail {namespace rapidasn
             }
             return static_cast<char *>(memory);
         }
+
+        void free_raw(char *memory, std::size_t size, bool mapped)
+        {
+        #if defined(__linux__)
+            if (mapped)
+            {
+                munmap(memory, size);
+                return;
+            }
+        #endif
+            (void)size;
+            (void)mapped;
+            if (m_free_func)
+                m_free_func(memory);
+            else
+                delete[] memory;
+        }
+
+        // Maps a block according to m_options, rounding size up; returns 0 to fall back to the default allocation
+        void *map_raw(std::size_t &size)
+        {
+        #if defined(__linux__)
+            const std::size_t huge = BOOST_PROPERTY_TREE_RAPIDASN1_HUGE_PAGE_SIZE;
+            void *memory = MAP_FAILED;
+            if (m_options & pool_huge_pages)
+            {
+                size = (size + huge - 1) & ~(huge - 1);
+            #if defined(MAP_HUGETLB)
+                memory = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            #endif
+                if (memory == MAP_FAILED)
+                {
+                    // No reserved huge pages: map a huge page aligned range and ask for transparent huge pages
+                    char *raw = static_cast<char *>(mmap(0, size + huge, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+                    if (raw == MAP_FAILED)
+                        return 0;
+                    char *aligned = reinterpret_cast<char *>((reinterpret_cast<std::size_t>(raw) + huge - 1) & ~(huge - 1));
+                    if (aligned != raw)
+                        munmap(raw, aligned - raw);
+                    if (aligned + size != raw + size + huge)
+                        munmap(aligned + size, raw + size + huge - (aligned + size));
+                    memory = aligned;
+                #if defined(MADV_HUGEPAGE)
+                    madvise(memory, size, MADV_HUGEPAGE);
+                #endif
+                }
+            }
+            else
+            {
+                memory = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                if (memory == MAP_FAILED)
+                    return 0;
+            }
+        #if defined(SYS_mbind)
+            if (m_options & pool_numa_local)
+            {
+                // MPOL_LOCAL: allocate on the node of the thread touching the pages; ignored on kernels without NUMA
+                const int mpol_local = 4;
+                syscall(SYS_mbind, memory, size, mpol_local, 0, 0, 0);
+            }
+        #endif
+            return memory;
+        #else
+            (void)size;
+            return 0;
+        #endif
+        }
         
         void *allocate_aligned(std::size_t size)
         {
@@ -360,19 +707,24 @@ namespace boost { namespace property_tree { namespace detail {namespace rapidasn
             // If not enough memory left in current pool, allocate a new pool
             if (result + size > m_end)
             {
-                // Calculate required pool size (may be bigger than BOOST_PROPERTY_TREE_RAPIDASN1_DYNAMIC_POOL_SIZE)
-                std::size_t pool_size = BOOST_PROPERTY_TREE_RAPIDASN1_DYNAMIC_POOL_SIZE;
+                // Calculate required pool size (may be bigger than the block size)
+                std::size_t pool_size = m_block_size;
                 if (pool_size < size)
                     pool_size = size;
+                if (m_block_size < m_max_block_size)
+                    m_block_size = m_block_size * m_growth < m_max_block_size ? m_block_size * m_growth : m_max_block_size;
                 
                 // Allocate
                 std::size_t alloc_size = sizeof(header) + (2 * BOOST_PROPERTY_TREE_RAPIDASN1_ALIGNMENT - 2) + pool_size;     // 2 alignments required in worst case: one for header, one for actual allocation
-                char *raw_memory = allocate_raw(alloc_size);
+                bool mapped;
+                char *raw_memory = allocate_raw(alloc_size, mapped);
                     
                 // Setup new pool in allocated memory
                 char *pool = align(raw_memory);
                 header *new_header = reinterpret_cast<header *>(pool);
                 new_header->previous_begin = m_begin;
+                new_header->size = alloc_size;
+                new_header->mapped = mapped;
                 m_begin = raw_memory;
                 m_ptr = pool + sizeof(header);
                 m_end = raw_memory + alloc_size;
@@ -392,6 +744,11 @@ namespace boost { namespace property_tree { namespace detail {namespace rapidasn
         char m_static_memory[BOOST_PROPERTY_TREE_RAPIDASN1_STATIC_POOL_SIZE];    // Static raw memory
         boost_ptree_raw_alloc_func *m_alloc_func;           // Allocator function, or 0 if default is to be used
         boost_ptree_raw_free_func *m_free_func;             // Free function, or 0 if default is to be used
+        std::size_t m_block_size;                           // Size of the next dynamic block
+        std::size_t m_first_block_size;                     // Size of the first dynamic block
+        std::size_t m_max_block_size;                       // Largest dynamic block
+        std::size_t m_growth;                               // Growth factor of the block size
+        int m_options;                                      // pool_options of dynamic blocks
     };
     
     
@@ -778,18 +1135,18 @@ namespace boost { namespace property_tree { namespace detail {namespace rapidasn
             char tmp[1024];
             if (this->type() == node_group)
             {
-                snprintf(tmp, sizeof(tmp), "%stag:[%lu] len:[%lu] group:", std::string(blank, ' ').c_str(), this->tag(), this->value_size());
+                snprintf(tmp, sizeof(tmp), "%stag:[%lu] len:[%llu] group:", std::string(blank, ' ').c_str(), static_cast<unsigned long>(this->tag()), static_cast<unsigned long long>(this->value_size()));
                 std::cout << tmp;
             }
             else
             {
                 if (this->value_size() > 256)
                 {
-                    snprintf(tmp, sizeof(tmp), "%stag:[%lu] len:[%lu] value:", std::string(blank, ' ').c_str(), this->tag(), this->value_size());
+                    snprintf(tmp, sizeof(tmp), "%stag:[%lu] len:[%llu] value:", std::string(blank, ' ').c_str(), static_cast<unsigned long>(this->tag()), static_cast<unsigned long long>(this->value_size()));
                 }
                 else
                 {
-                    snprintf(tmp, sizeof(tmp), "%stag:[%lu] len:[%lu] value:", std::string(blank, ' ').c_str(), this->tag(), this->value_size());
+                    snprintf(tmp, sizeof(tmp), "%stag:[%lu] len:[%llu] value:", std::string(blank, ' ').c_str(), static_cast<unsigned long>(this->tag()), static_cast<unsigned long long>(this->value_size()));
                 }
                 std::cout << tmp;
                 for (size_t i=0; i<(this->value_size()>16?16:this->value_size()); i++)
@@ -856,37 +1213,66 @@ namespace boost { namespace property_tree { namespace detail {namespace rapidasn
         //! Constructs empty asn1 tree
         asn1_tree()
             : asn1_node<Byte>(node_group)
+            , m_failures(0)
+            , m_base(0)
         {
+            m_error.code = error_none;
+            m_error.what = 0;
+            m_error.where = 0;
         }
 
+        //! Parses size bytes of BER data into the tree.
+        //! Nodes keep pointers into text, which must persist for the lifetime of the tree.
+        //! Throws parse_error if the data is malformed.
+        //! \param Flags Flags used to adjust the parser, combined with | operator (parse_default, parse_non_validating...).
+        //! Each combination is a separate instantiation in which the unused checks are compiled out.
         template<int Flags>
         void parse(const Byte *text, size_t size)
+        {
+            parse_result result;
+            if (!parse<Flags>(text, size, result))
+                BOOST_PROPERTY_TREE_RAPIDASN1_PARSE_ERROR(result.what, result.where);
+        }
+
+        //! Parses size bytes of BER data into the tree without using exceptions.
+        //! Nodes keep pointers into text, which must persist for the lifetime of the tree.
+        //! \param result Receives the error code, description and position if the data is malformed.
+        //! \return true on success.
+        template<int Flags>
+        bool parse(const Byte *text, size_t size, parse_result &result)
         {
             BOOST_ASSERT(text);
-            // Remove current contents
-            this->remove_all_nodes();
-            this->value(text, size);
-            
-            // Parse children
-            while (1)
+            m_failures = 0;
+            if (parse_children<Flags>(text, size))
             {
-                if (size==0)
-                    break;
-                    
-                std::size_t child_size = 0;
-                asn1_node<Byte> *child_node = this->allocate_node(node_nongroup);
-                if ( (child_size = this->parse_node<Flags>(text, size, child_node)) )
-                {
-                    this->append_node(child_node);
-                }
-                else
-                {
-                    BOOST_PROPERTY_TREE_RAPIDASN1_PARSE_ERROR("prase error: parse()", text-this->value());
-                }
-                text += child_size;
-                size -= child_size;
+                result.code = error_none;
+                return true;
             }
+            result = m_error;
+            return false;
+        }
 
+        //! Parses size bytes of BER data, skipping broken parts instead of failing.
+        //! A definite-length group whose content cannot be parsed is dropped from the tree
+        //! by its own length, recorded in failures, and parsing continues with its next sibling.
+        //! No exceptions are used; a node that cannot be skipped ends the parse,
+        //! and the tree holds everything parsed up to that point.
+        //! A group cut short by the end of the data is parsed as far as the data goes.
+        //! \param failures Receives one record per skipped node, plus a final record with size 0 if parsing stopped early.
+        //! \return true if all the data was consumed.
+        template<int Flags>
+        bool parse_recover(const Byte *text, size_t size, std::vector<parse_failure> &failures)
+        {
+            BOOST_ASSERT(text);
+            m_failures = &failures;
+            bool complete = parse_children<Flags>(text, size);
+            m_failures = 0;
+            if (!complete)
+            {
+                parse_failure failure = {m_error.what, m_error.where, m_error.where, 0, 0, m_error.code};
+                failures.push_back(failure);
+            }
+            return complete;
         }
 
         //! Clears the document by deleting all nodes and clearing the memory pool.
@@ -902,16 +1288,104 @@ namespace boost { namespace property_tree { namespace detail {namespace rapidasn
         ///////////////////////////////////////////////////////////////////////
         // Internal parsing functions
         
+        //! Parses one node at text; throws parse_error if it is malformed,
+        //! with the position of the error relative to text.
+        //! \return Size of the node, header included.
         template<int Flags>
         size_t parse_node(const Byte* text, size_t size, asn1_node<Byte> *node)
+        {
+            m_base = text;
+            size_t node_size = parse_node_nothrow<Flags>(text, size, node);
+            if (!node_size)
+                BOOST_PROPERTY_TREE_RAPIDASN1_PARSE_ERROR(m_error.what, m_error.where);
+            return node_size;
+        }
+
+        //! Parses one node at text without using exceptions.
+        //! \param result Receives the error if the node is malformed, positioned relative to text.
+        //! \return Size of the node, header included, or 0 on error.
+        template<int Flags>
+        size_t parse_node(const Byte* text, size_t size, asn1_node<Byte> *node, parse_result &result)
+        {
+            m_base = text;
+            size_t node_size = parse_node_nothrow<Flags>(text, size, node);
+            if (!node_size)
+                result = m_error;
+            else
+                result.code = error_none;
+            return node_size;
+        }
+        
+        // Parses the top level nodes; returns false and sets the error on failure
+        template<int Flags>
+        bool parse_children(const Byte *text, size_t size)
+        {
+            // Remove current contents
+            this->remove_all_nodes();
+            this->value(text, size);
+            m_base = text;
+            
+            // Parse children
+            while (size)
+            {
+                std::size_t child_size = parse_child<Flags>(this, text, size);
+                if (!child_size)
+                    return false;
+                text += child_size;
+                size -= child_size;
+            }
+            return true;
+        }
+
+        // Parses the node at text as the last child of parent; returns 0 and sets the error on failure.
+        // The partial node is kept if parsing stops here, and dropped if it can be skipped.
+        // With parse_structure_only a primitive node is parsed into a temporary and not kept.
+        template<int Flags>
+        size_t parse_child(asn1_node<Byte> *parent, const Byte *text, size_t size)
+        {
+            if ((Flags & parse_structure_only) && !((*text) & 0x20))
+            {
+                asn1_node<Byte> value_node(node_nongroup);
+                std::size_t value_size = parse_node_nothrow<Flags>(text, size, &value_node);
+                return value_size ? value_size : recover_node<Flags>(text, size);
+            }
+            asn1_node<Byte> *child_node = this->allocate_node(node_nongroup);
+            parent->append_node(child_node);
+            std::size_t child_size = parse_node_nothrow<Flags>(text, size, child_node);
+            if (!child_size)
+            {
+                if (!(child_size = recover_node<Flags>(text, size)))
+                    return 0;
+                parent->remove_last_node();
+            }
+            return child_size;
+        }
+
+        // Parses one node; returns 0 and sets the error on failure.
+        // On failure the node keeps what could be parsed of it.
+        template<int Flags>
+        size_t parse_node_nothrow(const Byte* text, size_t size, asn1_node<Byte> *node)
         {
             std::size_t pos = 0;
             // parse tag
             pos += parse_tag<Flags>(text+pos, size-pos, node);
+            if (!pos)
+            {
+                if ((Flags & parse_single_byte_tags) && size)
+                    return parse_failed(error_bad_tag, "unsupported tag: parse_tag()", text);
+                return parse_failed(error_unexpected_end, "unexpect end: parse_tag()", text);
+            }
             
             // parse len
             int is_varlen = 0;
-            pos += parse_len<Flags>(text+pos, size-pos, node, is_varlen);
+            std::size_t len_size = parse_len<Flags>(text+pos, size-pos, node, is_varlen);
+            if (!len_size)
+            {
+                node->value(0, 0);
+                return 0;
+            }
+            pos += len_size;
+            const bool varlen = !(Flags & parse_definite_only) && is_varlen;
             
             // parse value
             if (node->type() == node_group)
@@ -919,40 +1393,54 @@ namespace boost { namespace property_tree { namespace detail {namespace rapidasn
                 // parse group
                 const Byte* group_value = text + pos;
                 size_t group_size = 0;
+                size_t limit = size - pos;     // Bytes available to the children
+                if (Flags & parse_non_validating)
+                {
+                    if (!varlen)
+                        limit = node->value_size();
+                }
+                else if (!varlen)
+                {
+                    // When recovering, a truncated group is parsed as far as the data goes
+                    if (node->value_size() > limit && !m_failures)
+                        return parse_failed(error_overrun, "prase error: parse_node()", text + pos);
+                    if (node->value_size() < limit)
+                        limit = node->value_size();
+                }
                 while(1)
                 {
                     // quit condition
-                    if (is_varlen)
+                    if (varlen)
                     {
-                        if (detect_end<Flags>(text + pos, size))
+                        if (!(Flags & parse_non_validating) && limit - group_size < 2)
+                        {
+                            group_value_of<Flags>(node, group_value, group_size);
+                            return parse_failed(error_missing_end, "expected end: detect_end()", text + pos);
+                        }
+                        if (detect_end<Flags>(text + pos, limit - group_size))
                         {
-                            node->value(group_value, group_size);
+                            group_value_of<Flags>(node, group_value, group_size);
                             return pos+2;
                         }
                     }
-                    else
+                    else if (group_size == limit)
                     {
-                        if (group_size == node->value_size())
+                        if (!(Flags & parse_non_validating) && limit < node->value_size())
                         {
-                            node->value(group_value);
-                            return pos;
-                        }
-                        else if (group_size > node->value_size())
-                        {
-                            BOOST_PROPERTY_TREE_RAPIDASN1_PARSE_ERROR("prase error: parse_node()", text-this->value() + pos);
+                            group_value_of<Flags>(node, group_value, group_size);
+                            return parse_failed(error_unexpected_end, "unexpect end: parse_node()", text + pos);
                         }
+                        if (!(Flags & parse_no_group_values))
+                            node->value(group_value);
+                        return pos;
                     }
                 
                     // parse child node
-                    std::size_t child_size = 0;
-                    asn1_node<Byte> *child_node = this->allocate_node(node_nongroup);
-                    if ( (child_size = parse_node<Flags>(text+pos, is_varlen?size:node->value_size(), child_node)) )
-                    {
-                        node->append_node(child_node);
-                    }
-                    else
+                    std::size_t child_size = parse_child<Flags>(node, text+pos, limit-group_size);
+                    if (!child_size)
                     {
-                        BOOST_PROPERTY_TREE_RAPIDASN1_PARSE_ERROR("prase error: parse_node()", text-this->value() + pos);
+                        group_value_of<Flags>(node, group_value, group_size);
+                        return 0;
                     }
                     pos += child_size;
                     group_size += child_size;
@@ -961,109 +1449,524 @@ namespace boost { namespace property_tree { namespace detail {namespace rapidasn
             else
             {
                 // parse data
-                if (is_varlen)
-                    BOOST_PROPERTY_TREE_RAPIDASN1_PARSE_ERROR("prase error: parse_node()", text-this->value() + pos);
+                if (!(Flags & parse_non_validating) && (varlen || node->value_size() > size - pos))
+                {
+                    node->value(0, 0);
+                    return parse_failed(is_varlen ? error_varlen_primitive : error_overrun,
+                                        "prase error: parse_node()", text + pos);
+                }
                 
                 node->value(text + pos);
                 return pos + node->value_size();
             }
+        }
+        
+        // In recovery mode, skips the node at text after it failed to parse.
+        // Only a node with a definite length that fits in size can be skipped.
+        // Returns the bytes skipped, or 0 to let the failure propagate to the parent.
+        template<int Flags>
+        size_t recover_node(const Byte *text, size_t size)
+        {
+            if (!m_failures)
+                return 0;
+            
+            parse_result error = m_error;
+            parse_failure failure = {error.what, error.where, static_cast<std::size_t>(text - m_base), 0, 0, error.code};
+            asn1_node<Byte> header(node_nongroup);
+            int is_varlen = 0;
+            std::size_t pos = parse_tag<Flags>(text, size, &header);
+            std::size_t len_size = pos ? parse_len<Flags>(text + pos, size - pos, &header, is_varlen) : 0;
+            
+            // Keep the original error for the caller
+            m_error = error;
             
+            if (!len_size || is_varlen || header.value_size() > size - pos - len_size)
+                return 0;
+            failure.size = pos + len_size + header.value_size();
+            failure.tag = header.tag();
+            m_failures->push_back(failure);
+            return failure.size;
+        }
+        
+        // Sets the content of a group, unless parse_no_group_values leaves its value pointer unset
+        template<int Flags>
+        void group_value_of(asn1_node<Byte> *node, const Byte *value, size_t size)
+        {
+            if (Flags & parse_no_group_values)
+                node->value_size(size);
+            else
+                node->value(value, size);
+        }
+        
+        // Records an error; always returns 0
+        size_t parse_failed(parse_code code, const char *what, const Byte *where)
+        {
+            m_error.code = code;
+            m_error.what = what;
+            m_error.where = where - m_base;
+            return 0;
         }
         
         template<int Flags>
         size_t parse_tag(const Byte* text, size_t size, asn1_node<Byte> *node)
         {
-            if (size)
+            std::size_t tag = 0;
+            std::size_t tag_size = internal::decode_tag<Flags>(text, size, tag);
+            if (tag_size)
             {
                 node->node_class(static_cast<class_type>(((*text) & 0xC0) >> 6));
                 node->type(static_cast<node_type>(((*text) & 0x20) >> 5));
-                size_t tmp = (*text) & 0x1F;
-                if (tmp > 30)
+                node->tag(tag);
+            }
+            return tag_size;
+        }
+        
+        //! Parses a length field.
+        //! \return Size of the length field, or 0 if it is malformed.
+        template<int Flags>
+        size_t parse_len(const Byte* text, size_t size, asn1_node<Byte> *node, int& is_varlen)
+        {
+            std::size_t len = 0;
+            parse_code code = error_none;
+            std::size_t len_size = internal::decode_len<Flags>(text, size, len, is_varlen, code);
+            if (!len_size)
+                return parse_failed(code, code == error_bad_length ? "prase error: parse_len()" : "unexpect end: parse_len()", text);
+            if (!is_varlen)
+                node->value_size(len);
+            return len_size;
+        }
+        
+        //! Checks for an end-of-contents marker; size must be at least 2.
+        template<int Flags>
+        bool detect_end(const Byte *text, size_t size)
+        {
+            BOOST_ASSERT(size >= 2);
+            return (*text == 0) && (*(text+1) == 0);
+        }
+        
+    private:
+        
+        parse_result m_error;                           // Last error
+        std::vector<parse_failure> *m_failures;         // Failure list while recovering, or 0
+        const Byte *m_base;                             // Start of the data being parsed, origin of error positions
+        
+    };
+
+    #ifndef BOOST_PROPERTY_TREE_RAPIDASN1_VALIDATE_DEPTH
+        // Maximum nesting depth accepted by walk() and validate().
+        // Define BOOST_PROPERTY_TREE_RAPIDASN1_VALIDATE_DEPTH before including rapidasn1.hpp if you want to override the default value.
+        // The walker keeps one small stack frame per level on the machine stack.
+        #define BOOST_PROPERTY_TREE_RAPIDASN1_VALIDATE_DEPTH 64
+    #endif
+
+    //! \cond internal
+    namespace internal
+    {
+        // Handler for walk() that ignores every node
+        struct null_handler
+        {
+            bool begin_group(std::size_t, std::size_t, std::size_t)
+            {
+                return true;
+            }
+            void end_group(std::size_t, std::size_t, std::size_t)
+            {
+            }
+            template<class Byte>
+            void value(std::size_t, const Byte *, std::size_t, std::size_t)
+            {
+            }
+        };
+    }
+    //! \endcond
+
+    //! Walks size bytes of BER at text depth-first without building a tree,
+    //! checking the structure like validate() and reporting every node to handler:
+    //! <br><code>
+    //! <br>bool begin_group(std::size_t tag, std::size_t offset, std::size_t depth);
+    //! <br>void end_group(std::size_t tag, std::size_t end, std::size_t depth);
+    //! <br>void value(std::size_t tag, const Byte *value, std::size_t size, std::size_t depth);
+    //! </code><br>
+    //! offset is the position of the group header and end the position just past the group,
+    //! end-of-contents marker included. If begin_group() returns false the content of the group
+    //! is skipped without callbacks (by its length when it has one) and only end_group() follows.
+    //! No memory is allocated; nesting is tracked on a fixed stack of
+    //! <code>BOOST_PROPERTY_TREE_RAPIDASN1_VALIDATE_DEPTH</code> levels, and a node at that depth,
+    //! group or value, fails with error_too_deep: handlers get depths below the limit and can keep
+    //! their own per-level state in arrays of <code>BOOST_PROPERTY_TREE_RAPIDASN1_VALIDATE_DEPTH</code> entries.
+    //! \param Flags Parse flags; parse_no_group_values has no effect here.
+    //! \param result Receives the error code, description and position if the data is malformed.
+    //! \return true if the data is well-formed.
+    template<int Flags, class Byte, class Handler>
+    bool walk(const Byte *text, std::size_t size, Handler &handler, parse_result &result)
+    {
+        struct frame
+        {
+            std::size_t end;        // End of a definite group, or of the enclosing data for an indefinite one
+            std::size_t tag;
+            int is_varlen;
+        };
+        frame stack[BOOST_PROPERTY_TREE_RAPIDASN1_VALIDATE_DEPTH];
+        std::size_t depth = 0;
+        std::size_t skip_depth = 0;     // Depth of the group being skipped, or 0
+        std::size_t end = size;
+        std::size_t pos = 0;
+        const char *what = 0;
+        parse_code code = error_none;
+
+        while (1)
+        {
+            if (!(Flags & parse_definite_only) && depth && stack[depth-1].is_varlen)
+            {
+                if (end - pos < 2)
+                {
+                    code = error_missing_end;
+                    what = "expected end: walk()";
+                    break;
+                }
+                if (text[pos] == 0 && text[pos+1] == 0)
                 {
-                    tmp = 0;
-                    size_t pos = 1;
-                    while(pos<size)
+                    pos += 2;
+                    --depth;
+                    if (!skip_depth || skip_depth > depth)
                     {
-                        Byte cur = *(text+pos);
-                        Byte cur_val = cur & 0x7F;
-                        tmp <<= 7;
-                        tmp += cur_val;
-                        if (!(cur&0x80))
-                        {
-                            node->tag(tmp);
-                            return pos+1;
-                        }
-                        pos++;
+                        skip_depth = 0;
+                        handler.end_group(stack[depth].tag, pos, depth);
                     }
+                    end = depth ? stack[depth-1].end : size;
+                    continue;
                 }
-                else
+            }
+            else if (pos == end)
+            {
+                if (!depth)
+                {
+                    result.code = error_none;
+                    return true;
+                }
+                --depth;
+                if (!skip_depth || skip_depth > depth)
                 {
-                    node->tag(tmp);
-                    return 1;
+                    skip_depth = 0;
+                    handler.end_group(stack[depth].tag, pos, depth);
                 }
+                end = depth ? stack[depth-1].end : size;
+                continue;
             }
-            return 0;
-        }
-        
-        template<int Flags>
-        size_t parse_len(const Byte* text, size_t size, asn1_node<Byte> *node, int& is_varlen)
-        {
-            if (!size)
-                BOOST_PROPERTY_TREE_RAPIDASN1_PARSE_ERROR("unexpect end: parse_len()", text-this->value());
-            
-            if ((*text) & 0x80)
+
+            // Single byte tags and short lengths are decoded inline
+            std::size_t header = 0;
+            std::size_t tag = 0;
+            std::size_t len = 0;
+            int is_varlen = 0;
+            if ((((Flags & parse_single_byte_tags) && (Flags & parse_non_validating)) || (text[pos] & 0x1F) != 0x1F)
+                && ((Flags & parse_non_validating) || end - pos >= 2) && !(text[pos+1] & 0x80))
+            {
+                header = 2;
+                tag = text[pos] & 0x1F;
+                len = text[pos+1];
+            }
+            else
             {
-                std::size_t n = (*text) & 0x7F;
-                if (n==0)
+                std::size_t tag_size = internal::decode_tag<Flags>(text + pos, end - pos, tag);
+                if (!tag_size)
                 {
-                    is_varlen=1;
-                    return 1;
+                    bool bad_tag = (Flags & parse_single_byte_tags) && end > pos;
+                    code = bad_tag ? error_bad_tag : error_unexpected_end;
+                    what = bad_tag ? "unsupported tag: walk()" : "unexpect end: walk()";
+                    break;
                 }
-                else
+                std::size_t len_size = internal::decode_len<Flags>(text + pos + tag_size, end - pos - tag_size, len, is_varlen, code);
+                if (!len_size)
                 {
-                    is_varlen = 0;
+                    what = "prase error: walk()";
+                    pos += tag_size;
+                    break;
                 }
-                    
-                if (n > 4)
-                    BOOST_PROPERTY_TREE_RAPIDASN1_PARSE_ERROR("prase error: parse_len()", text-this->value());
-                if (n+1 > size)
-                    BOOST_PROPERTY_TREE_RAPIDASN1_PARSE_ERROR("prase error: parse_len()", text-this->value());
-                std::size_t len = 0;
-                for(size_t i=1; i<=n; i++)
+                header = tag_size + len_size;
+            }
+
+            // Groups and values alike, so that handlers only see depths below the limit
+            if (depth == BOOST_PROPERTY_TREE_RAPIDASN1_VALIDATE_DEPTH)
+            {
+                code = error_too_deep;
+                what = "too deep: walk()";
+                break;
+            }
+            if (text[pos] & 0x20)
+            {
+                if (!(Flags & parse_non_validating) && !is_varlen && len > end - pos - header)
                 {
-                    len <<= 8;
-                    len |= (*(text+i));
+                    code = error_overrun;
+                    what = "prase error: walk()";
+                    pos += header;
+                    break;
                 }
-                node->value_size(len);
-                return n+1;
+                if (!skip_depth && !handler.begin_group(tag, pos, depth))
+                {
+                    if (!is_varlen)
+                    {
+                        // Skipped by its length
+                        pos += header + len;
+                        handler.end_group(tag, pos, depth);
+                        continue;
+                    }
+                    skip_depth = depth + 1;
+                }
+                if (!is_varlen)
+                    end = pos + header + len;
+                stack[depth].end = end;
+                stack[depth].tag = tag;
+                stack[depth].is_varlen = is_varlen;
+                ++depth;
+                pos += header;
             }
             else
             {
-                std::size_t len = (*text) & 0x7F;
+                if (!(Flags & parse_non_validating) && (is_varlen || len > end - pos - header))
+                {
+                    code = is_varlen ? error_varlen_primitive : error_overrun;
+                    what = "prase error: walk()";
+                    pos += header;
+                    break;
+                }
+                if (!(Flags & parse_structure_only) && !skip_depth)
+                    handler.value(tag, text + pos + header, len, depth);
+                pos += header + len;
+            }
+        }
+
+        result.code = code;
+        result.what = what;
+        result.where = pos;
+        return false;
+    }
+
+    //! \cond internal
+    namespace internal
+    {
+        // Decodes the tag and length at text, with inline paths for single-octet tags and lengths below 64K.
+        // Length is std::size_t, or boost::uint64_t for positions in files that may exceed the address space.
+        // Returns the size of the header, or 0 with code set if it is malformed.
+        template<int Flags, class Byte, class Length>
+        inline std::size_t decode_header(const Byte *text, std::size_t size, std::size_t &tag,
+                                         Length &len, int &is_varlen, parse_code &code)
+        {
+            if ((((Flags & parse_single_byte_tags) && (Flags & parse_non_validating)) || (text[0] & 0x1F) != 0x1F) &&
+                ((Flags & parse_non_validating) || size >= 4))
+            {
+                tag = text[0] & 0x1F;
                 is_varlen = 0;
-                node->value_size(len);
-                return 1;
+                unsigned char first = static_cast<unsigned char>(text[1]);
+                if (first < 0x80)
+                {
+                    len = first;
+                    return 2;
+                }
+                if (first == 0x81)
+                {
+                    len = static_cast<unsigned char>(text[2]);
+                    return 3;
+                }
+                if (first == 0x82)
+                {
+                    len = (static_cast<Length>(static_cast<unsigned char>(text[2])) << 8) | static_cast<unsigned char>(text[3]);
+                    return 4;
+                }
             }
+            std::size_t tag_size = decode_tag<Flags>(text, size, tag);
+            if (!tag_size)
+            {
+                code = (Flags & parse_single_byte_tags) && size ? error_bad_tag : error_unexpected_end;
+                return 0;
+            }
+            std::size_t len_size = decode_len<Flags>(text + tag_size, size - tag_size, len, is_varlen, code);
+            return len_size ? tag_size + len_size : 0;
         }
-        
-        template<int Flags>
-        bool detect_end(const Byte *text, size_t size)
+
+        // Skips the content of an indefinite-length group starting at pos, nested groups included.
+        // Definite-length nodes are jumped over by their length; end-of-contents markers are only
+        // recognised where a header is expected, never inside values.
+        // Returns the position past the closing end-of-contents marker, or 0 with code and pos set on error.
+        template<int Flags, class Byte>
+        std::size_t skip_varlen(const Byte *text, std::size_t &pos, std::size_t size, parse_code &code)
         {
-            if (size < 2)
+            std::size_t depth = 1;
+            while (depth)
             {
-                BOOST_PROPERTY_TREE_RAPIDASN1_PARSE_ERROR("expected end: detect_end()", text-this->value());
+                if (size - pos < 2)
+                {
+                    code = error_missing_end;
+                    return 0;
+                }
+                if (!text[pos] && !text[pos + 1])
+                {
+                    pos += 2;
+                    --depth;
+                    continue;
+                }
+                std::size_t tag, len;
+                int is_varlen = 0;
+                std::size_t header = decode_header<Flags>(text + pos, size - pos, tag, len, is_varlen, code);
+                if (!header)
+                    return 0;
+                if (is_varlen)
+                {
+                    if (!(text[pos] & 0x20))
+                    {
+                        code = error_varlen_primitive;
+                        return 0;
+                    }
+                    ++depth;
+                    pos += header;
+                }
+                else
+                {
+                    if (!(Flags & parse_non_validating) && len > size - pos - header)
+                    {
+                        code = error_overrun;
+                        return 0;
+                    }
+                    pos += header + len;
+                }
             }
-            else
+            return pos;
+        }
+
+        // Walks the sibling nodes in size bytes at text, calling sink(offset, tag, size) for each.
+        // Stops at the end of the data, at an end-of-contents marker in place of a sibling,
+        // or when sink returns false; end then receives the position past the marker, or of the sibling.
+        template<int Flags, class Byte, class Sink>
+        bool scan_siblings(const Byte *text, std::size_t size, Sink &sink, std::size_t &end, parse_result &result)
+        {
+            std::size_t pos = 0;
+            parse_code code = error_none;
+            while (pos < size)
             {
-                if ((*text == 0) && (*(text+1) == 0))
-                    return true;
+                if (!(Flags & parse_definite_only) && !text[pos] && size - pos >= 2 && !text[pos + 1])
+                {
+                    pos += 2;
+                    break;
+                }
+                std::size_t tag, len;
+                int is_varlen = 0;
+                std::size_t header = decode_header<Flags>(text + pos, size - pos, tag, len, is_varlen, code);
+                if (!header)
+                    break;
+                std::size_t offset = pos;
+                if (is_varlen)
+                {
+                    if (!(text[pos] & 0x20))
+                    {
+                        code = error_varlen_primitive;
+                        break;
+                    }
+                    pos += header;
+                    if (!skip_varlen<Flags>(text, pos, size, code))
+                        break;
+                }
                 else
-                    return false;
+                {
+                    if (!(Flags & parse_non_validating) && len > size - pos - header)
+                    {
+                        code = error_overrun;
+                        pos += header;
+                        break;
+                    }
+                    pos += header + len;
+                }
+                if (!sink(offset, tag, pos - offset))
+                {
+                    pos = offset;
+                    break;
+                }
             }
+            end = pos;
+            result.code = code;
+            if (code == error_none)
+                return true;
+            result.what = "prase error: scan_siblings()";
+            result.where = pos;
+            return false;
         }
-        
-    };
 
+        // Sinks of scan_siblings()
+        struct offset_sink
+        {
+            std::vector<std::size_t> *offsets;
+            std::size_t base;
+
+            bool operator()(std::size_t offset, std::size_t, std::size_t)
+            {
+                offsets->push_back(base + offset);
+                return true;
+            }
+        };
+
+        struct count_sink
+        {
+            std::size_t count;
+
+            bool operator()(std::size_t, std::size_t, std::size_t)
+            {
+                ++count;
+                return true;
+            }
+        };
+    }
+    //! \endcond
+
+    //! Finds the sibling nodes in size bytes at text, jumping from header to header
+    //! without looking into definite-length nodes; the content of a group can be scanned
+    //! for its children this way. Headers with single-octet tags and short lengths are decoded inline.
+    //! Scanning stops at the end of the data or at an end-of-contents marker in place of a sibling,
+    //! which closes the content of an indefinite-length group.
+    //! An indefinite-length sibling is skipped by walking its nested headers to its marker;
+    //! markers are never searched for as bytes, since values may contain them.
+    //! \param offsets Receives the position of each sibling; existing elements are kept.
+    //! \param end Receives the position past the siblings, end-of-contents marker included.
+    //! \param result Receives the error code, description and position if a header is malformed.
+    //! \return true on success.
+    template<int Flags, class Byte>
+    bool scan_siblings(const Byte *text, std::size_t size, std::vector<std::size_t> &offsets,
+                       std::size_t &end, parse_result &result)
+    {
+        internal::offset_sink sink = {&offsets, 0};
+        return internal::scan_siblings<Flags>(text, size, sink, end, result);
+    }
+
+    //! Counts the sibling nodes in size bytes at text; see scan_siblings().
+    template<int Flags, class Byte>
+    bool count_siblings(const Byte *text, std::size_t size, std::size_t &count,
+                        std::size_t &end, parse_result &result)
+    {
+        internal::count_sink sink = {0};
+        bool ok = internal::scan_siblings<Flags>(text, size, sink, end, result);
+        count = sink.count;
+        return ok;
+    }
+
+    //! Checks that size bytes at text are well-formed BER without building a tree:
+    //! lengths nest correctly, indefinite-length groups are closed by end-of-contents markers
+    //! and nothing is truncated. Values are not interpreted.
+    //! No memory is allocated; nesting is tracked on a fixed stack of
+    //! <code>BOOST_PROPERTY_TREE_RAPIDASN1_VALIDATE_DEPTH</code> levels.
+    //! \param result Receives the error code, description and position if the data is malformed.
+    //! \return true if the data is well-formed.
+    template<int Flags, class Byte>
+    bool validate(const Byte *text, std::size_t size, parse_result &result)
+    {
+        internal::null_handler handler;
+        return walk<Flags>(text, size, handler, result);
+    }
+
+    //! Checks that size bytes at text are well-formed BER; see validate(text, size, result).
+    template<int Flags, class Byte>
+    bool validate(const Byte *text, std::size_t size)
+    {
+        parse_result result;
+        return validate<Flags>(text, size, result);
+    }
 
 }}}}
 
@@ -0,0 +1,443 @@
+// ----------------------------------------------------------------------------
+// Copyright (C) 2015-2016 zunceng@gmail.com
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+// For more information, see www.boost.org
+// ----------------------------------------------------------------------------
+#ifndef BOOST_PROPERTY_TREE_TAP3_AGGREGATE_HPP_INCLUDED
+#define BOOST_PROPERTY_TREE_TAP3_AGGREGATE_HPP_INCLUDED
+
+#include "asn1_parser_error.hpp"
+#include "rapidasn1.hpp"
+#include "tap3_parser_read.hpp"
+#include <boost/cstdint.hpp>
+#include <boost/lexical_cast.hpp>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace boost { namespace property_tree { namespace detail {namespace tap_parser{
+
+    //! Aggregate functions
+    enum tap_aggregate_op
+    {
+        aggregate_count,    //!< Number of call events holding the field
+        aggregate_sum,      //!< Sum of every occurrence of the field
+        aggregate_min,      //!< Lowest occurrence of the field
+        aggregate_max,      //!< Highest occurrence of the field
+    };
+
+    //! Groups of call events with their aggregated values, kept in an open-addressing hash table.
+    //! Tables filled by different threads from the same tap_aggregation can be merged.
+    class tap_aggregate_table
+    {
+    public:
+
+        tap_aggregate_table()
+            : m_width(0)
+            , m_used(0)
+        {
+        }
+
+        //! Number of groups
+        std::size_t size() const
+        {
+            return m_used;
+        }
+
+        //! Number of call events in group
+        long long count(std::size_t group) const
+        {
+            return m_values[group * (m_width + 1)];
+        }
+
+        //! Value of aggregate n of group
+        long long value(std::size_t group, std::size_t n) const
+        {
+            BOOST_ASSERT(n < m_width);
+            return m_values[group * (m_width + 1) + 1 + n];
+        }
+
+        //! Raw key of group: the BER octets of each group-by field, each preceded by its size
+        std::string raw_key(std::size_t group) const
+        {
+            return m_keys.substr(m_groups[group].key_offset, m_groups[group].key_size);
+        }
+
+        //! Adds the groups of other, which must come from the same tap_aggregation.
+        //! An empty other, even one never filled, leaves the table unchanged.
+        void merge(const tap_aggregate_table &other)
+        {
+            if (!other.m_used)
+                return;
+            if (!m_used)
+                init(other.m_ops);
+            BOOST_ASSERT(m_ops == other.m_ops);
+            for (std::size_t i = 0; i < other.m_used; ++i)
+            {
+                const group &g = other.m_groups[i];
+                add(other.m_keys.data() + g.key_offset, g.key_size, g.hash, &other.m_values[i * (m_width + 1)]);
+            }
+        }
+
+        //! Removes all groups
+        void clear()
+        {
+            m_slots.clear();
+            m_groups.clear();
+            m_values.clear();
+            m_keys.clear();
+            m_used = 0;
+        }
+
+    //! \cond internal
+        void init(const std::vector<tap_aggregate_op> &ops)
+        {
+            clear();
+            m_ops = ops;
+            m_width = ops.size();
+        }
+
+        static boost::uint64_t hash(const char *key, std::size_t size)
+        {
+            // FNV-1a
+            boost::uint64_t h = 14695981039346656037ULL;
+            for (std::size_t i = 0; i < size; ++i)
+                h = (h ^ static_cast<unsigned char>(key[i])) * 1099511628211ULL;
+            return h;
+        }
+
+        // Merges one record or partial group; values holds the count then one value per aggregate
+        void add(const char *key, std::size_t key_size, boost::uint64_t h, const long long *values)
+        {
+            if ((m_used + 1) * 4 > m_slots.size() * 3)
+                grow();
+            std::size_t mask = m_slots.size() - 1;
+            std::size_t slot = static_cast<std::size_t>(h) & mask;
+            while (m_slots[slot])
+            {
+                const group &g = m_groups[m_slots[slot] - 1];
+                if (g.hash == h && g.key_size == key_size && std::memcmp(m_keys.data() + g.key_offset, key, key_size) == 0)
+                {
+                    combine(&m_values[(m_slots[slot] - 1) * (m_width + 1)], values);
+                    return;
+                }
+                slot = (slot + 1) & mask;
+            }
+            group g = {h, m_keys.size(), key_size};
+            m_keys.append(key, key_size);
+            m_groups.push_back(g);
+            m_values.insert(m_values.end(), values, values + m_width + 1);
+            m_slots[slot] = ++m_used;
+        }
+    //! \endcond
+
+    private:
+
+        struct group
+        {
+            boost::uint64_t hash;
+            std::size_t key_offset;
+            std::size_t key_size;
+        };
+
+        void combine(long long *into, const long long *values) const
+        {
+            into[0] += values[0];
+            for (std::size_t n = 0; n < m_width; ++n)
+            {
+                long long &a = into[n + 1];
+                long long b = values[n + 1];
+                switch (m_ops[n])
+                {
+                    case aggregate_count:
+                    case aggregate_sum:
+                        a += b;
+                        break;
+                    case aggregate_min:
+                        if (b < a)
+                            a = b;
+                        break;
+                    case aggregate_max:
+                        if (b > a)
+                            a = b;
+                        break;
+                }
+            }
+        }
+
+        void grow()
+        {
+            std::vector<std::size_t> slots(m_slots.empty() ? 64 : m_slots.size() * 2, 0);
+            std::size_t mask = slots.size() - 1;
+            for (std::size_t i = 0; i < m_used; ++i)
+            {
+                std::size_t slot = static_cast<std::size_t>(m_groups[i].hash) & mask;
+                while (slots[slot])
+                    slot = (slot + 1) & mask;
+                slots[slot] = i + 1;
+            }
+            m_slots.swap(slots);
+        }
+
+        std::vector<tap_aggregate_op> m_ops;
+        std::size_t m_width;                // Number of aggregates
+        std::size_t m_used;                 // Number of groups
+        std::vector<std::size_t> m_slots;   // 1-based group index, 0 for a free slot
+        std::vector<group> m_groups;
+        std::vector<long long> m_values;    // Count and aggregates, m_width + 1 per group
+        std::string m_keys;                 // Keys of all groups
+    };
+
+    //! Streaming aggregation of call events.
+    //! Group-by keys and aggregated fields are given as TAP paths, matched against the end of
+    //! the element path inside each call event: "Imsi" matches any Imsi, "ChargeDetail.Charge"
+    //! only a Charge directly in a ChargeDetail. A key takes the first occurrence of its field in
+    //! the call event; call events lacking a key field are grouped under an empty value.
+    //! Only the named fields are decoded; no tree is built.
+    template<int Version, int Release>
+    class tap_aggregation
+    {
+    public:
+
+        tap_aggregation()
+            : m_list_tag(find_tap_tag<Version, Release>("CallEventDetailList"))
+        {
+        }
+
+        //! Adds a group-by key; throws asn1_parser_error if the path names an unknown element.
+        tap_aggregation &group_by(const std::string &path)
+        {
+            m_keys.push_back(compile(path));
+            return *this;
+        }
+
+        //! Adds an aggregated field; throws asn1_parser_error if the path names an unknown element.
+        tap_aggregation &aggregate(const std::string &path, tap_aggregate_op op)
+        {
+            m_fields.push_back(compile(path));
+            m_ops.push_back(op);
+            return *this;
+        }
+
+        //! Number of group-by keys
+        std::size_t keys() const
+        {
+            return m_keys.size();
+        }
+
+        //! Aggregates the call events of a whole batch into table.
+        //! \return false if the batch is malformed; result then holds the error.
+        template<class Byte>
+        bool run(const Byte *data, std::size_t size, tap_aggregate_table &table, rapidasn1::parse_result &result) const
+        {
+            prepare(table);
+            runner<Byte> handler(*this, table, false);
+            return rapidasn1::walk<rapidasn1::parse_default>(data, size, handler, result);
+        }
+
+        //! Aggregates a single call event, as located by a tap_index_entry, into table.
+        //! Lets threads work on separate ranges of call events and merge their tables.
+        template<class Byte>
+        bool accumulate(const Byte *record, std::size_t size, tap_aggregate_table &table, rapidasn1::parse_result &result) const
+        {
+            prepare(table);
+            runner<Byte> handler(*this, table, true);
+            return rapidasn1::walk<rapidasn1::parse_default>(record, size, handler, result);
+        }
+
+        //! Decodes key n of a group of table according to the type of its element.
+        std::string key(const tap_aggregate_table &table, std::size_t group, std::size_t n) const
+        {
+            BOOST_ASSERT(n < m_keys.size());
+            std::string raw = table.raw_key(group);
+            std::size_t pos = 0;
+            for (std::size_t i = 0; ; ++i)
+            {
+                boost::uint32_t size;
+                std::memcpy(&size, raw.data() + pos, sizeof(size));
+                pos += sizeof(size);
+                if (i == n)
+                {
+                    const char *value = raw.data() + pos;
+                    const tap_element *element = find_tap_element<Version, Release>(m_keys[n].tags.back());
+                    switch (element->type)
+                    {
+                        case Integer:
+                        case Integer64:
+                            return size ? boost::lexical_cast<std::string>(asn1_parser::binary2Int<0>(value, size)) : std::string();
+                        case BcdString:
+                            return asn1_parser::binary2BCDString<0>(value, size);
+                        default:
+                            return std::string(value, size);
+                    }
+                }
+                pos += size;
+            }
+        }
+
+    private:
+
+        struct field
+        {
+            std::vector<std::size_t> tags;  // Element path, outermost first
+        };
+
+        field compile(const std::string &path) const
+        {
+            field f;
+            if (!find_tap_path<Version, Release>(path, f.tags))
+                BOOST_PROPERTY_TREE_THROW(asn1_parser::asn1_parser_error(
+                    "unknown TAP element", path, 0));
+            return f;
+        }
+
+        void prepare(tap_aggregate_table &table) const
+        {
+            if (!table.size())
+                table.init(m_ops);
+        }
+
+        // Walk handler collecting the fields of each call event
+        template<class Byte>
+        class runner
+        {
+        public:
+
+            runner(const tap_aggregation &spec, tap_aggregate_table &table, bool single)
+                : m_spec(spec)
+                , m_table(table)
+                , m_record_depth(single ? 0 : 1)
+                , m_in_list(single)
+                , m_key_values(spec.m_keys.size())
+                , m_key_seen(spec.m_keys.size())
+                , m_values(spec.m_fields.size() + 1)
+                , m_value_seen(spec.m_fields.size())
+            {
+            }
+
+            bool begin_group(std::size_t tag, std::size_t, std::size_t depth)
+            {
+                m_tags[depth] = tag;
+                if (!m_in_list)
+                {
+                    // Only CallEventDetailList is entered below the top level
+                    if (depth == 1 && tag == m_spec.m_list_tag)
+                    {
+                        m_in_list = true;
+                        m_record_depth = 2;
+                        return true;
+                    }
+                    return depth == 0;
+                }
+                if (depth == m_record_depth)
+                    begin_record();
+                return true;
+            }
+
+            void end_group(std::size_t, std::size_t, std::size_t depth)
+            {
+                if (m_in_list && depth == m_record_depth)
+                    end_record();
+                else if (m_in_list && depth + 1 == m_record_depth)
+                    m_in_list = false;
+            }
+
+            void value(std::size_t tag, const Byte *value, std::size_t size, std::size_t depth)
+            {
+                if (!m_in_list || depth <= m_record_depth)
+                    return;
+                m_tags[depth] = tag;
+                for (std::size_t k = 0; k < m_spec.m_keys.size(); ++k)
+                    if (!m_key_seen[k] && matches(m_spec.m_keys[k], depth))
+                    {
+                        m_key_values[k].assign(reinterpret_cast<const char *>(value), size);
+                        m_key_seen[k] = true;
+                    }
+                for (std::size_t n = 0; n < m_spec.m_fields.size(); ++n)
+                    if (matches(m_spec.m_fields[n], depth))
+                    {
+                        long long v = size && size <= 8 ? asn1_parser::binary2Int<rapidasn1::parse_non_validating>(value, size) : 0;
+                        long long &a = m_values[n + 1];
+                        switch (m_spec.m_ops[n])
+                        {
+                            case aggregate_count:
+                                a = 1;
+                                break;
+                            case aggregate_sum:
+                                a += v;
+                                break;
+                            case aggregate_min:
+                                if (!m_value_seen[n] || v < a)
+                                    a = v;
+                                break;
+                            case aggregate_max:
+                                if (!m_value_seen[n] || v > a)
+                                    a = v;
+                                break;
+                        }
+                        m_value_seen[n] = true;
+                    }
+            }
+
+        private:
+
+            bool matches(const field &f, std::size_t depth) const
+            {
+                return match_tap_path(f.tags, m_tags, m_record_depth, depth);
+            }
+
+            void begin_record()
+            {
+                for (std::size_t k = 0; k < m_key_seen.size(); ++k)
+                {
+                    m_key_values[k].clear();
+                    m_key_seen[k] = false;
+                }
+                std::fill(m_values.begin(), m_values.end(), 0);
+                std::fill(m_value_seen.begin(), m_value_seen.end(), false);
+            }
+
+            void end_record()
+            {
+                m_key.clear();
+                for (std::size_t k = 0; k < m_key_values.size(); ++k)
+                {
+                    boost::uint32_t size = static_cast<boost::uint32_t>(m_key_values[k].size());
+                    m_key.append(reinterpret_cast<const char *>(&size), sizeof(size));
+                    m_key.append(m_key_values[k]);
+                }
+                // Min and max of a call event without the field stay neutral
+                for (std::size_t n = 0; n < m_value_seen.size(); ++n)
+                    if (!m_value_seen[n] && m_spec.m_ops[n] == aggregate_min)
+                        m_values[n + 1] = 0x7FFFFFFFFFFFFFFFLL;
+                    else if (!m_value_seen[n] && m_spec.m_ops[n] == aggregate_max)
+                        m_values[n + 1] = -0x7FFFFFFFFFFFFFFFLL - 1;
+                m_values[0] = 1;
+                m_table.add(m_key.data(), m_key.size(), tap_aggregate_table::hash(m_key.data(), m_key.size()), &m_values[0]);
+            }
+
+            const tap_aggregation &m_spec;
+            tap_aggregate_table &m_table;
+            std::size_t m_record_depth;
+            bool m_in_list;
+            std::vector<std::string> m_key_values;
+            std::vector<bool> m_key_seen;
+            std::vector<long long> m_values;
+            std::vector<bool> m_value_seen;
+            std::string m_key;
+            std::size_t m_tags[BOOST_PROPERTY_TREE_RAPIDASN1_VALIDATE_DEPTH];
+        };
+
+        std::vector<field> m_keys;
+        std::vector<field> m_fields;
+        std::vector<tap_aggregate_op> m_ops;
+        std::size_t m_list_tag;             // CallEventDetailList, whose children are aggregated
+    };
+
+}}}}
+
+#endif
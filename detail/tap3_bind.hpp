@@ -0,0 +1,479 @@
+// ----------------------------------------------------------------------------
+// Copyright (C) 2015-2016 zunceng@gmail.com
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+// For more information, see www.boost.org
+// ----------------------------------------------------------------------------
+#ifndef BOOST_PROPERTY_TREE_TAP3_BIND_HPP_INCLUDED
+#define BOOST_PROPERTY_TREE_TAP3_BIND_HPP_INCLUDED
+
+#include "asn1_parser_error.hpp"
+#include "rapidasn1.hpp"
+#include "tap3_parser_read.hpp"
+#include "tap3_references.hpp"
+#include "tap3_time.hpp"
+#include <boost/static_assert.hpp>
+#include <boost/type_traits/is_integral.hpp>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace boost { namespace property_tree { namespace detail {namespace tap_parser{
+
+    //! Binding of a record struct to TAP elements; specialize it for each struct:
+    //! <br><code>
+    //! <br>struct Moc { long long charge; char imsi[16]; };
+    //! <br>template<> struct tap_record_traits<Moc>
+    //! <br>{
+    //! <br>    template<class Binder> static void bind(Binder &b)
+    //! <br>    {
+    //! <br>        b.record("MobileOriginatedCall");
+    //! <br>        b("Imsi", &Moc::imsi);
+    //! <br>        b("ChargeDetail.Charge", &Moc::charge);
+    //! <br>    }
+    //! <br>};
+    //! </code><br>
+    //! Fields are integral types, filled from Integer elements, or char arrays, filled with the
+    //! decoded text of the element (BCD digits, octets) truncated and terminated by a null character.
+    //! utc_time() binds a boost::int64_t to a timestamp group, such as CallEventStartTimeStamp,
+    //! filled with UTC seconds since 1970-01-01; see tap3_time.hpp.
+    //! resolve() binds a reference code to the value it stands for; see tap3_references.hpp.
+    //! Paths are matched against the end of the element path inside a call event and
+    //! a field takes the first occurrence of its element. record() restricts the binding
+    //! to one kind of call event; without it every call event gives a record.
+    template<class Record>
+    struct tap_record_traits;
+
+    namespace internal
+    {
+        template<class T>
+        void set_integer(void *field, const unsigned char *value, std::size_t size, std::size_t)
+        {
+            *static_cast<T *>(field) = size && size <= 8
+                ? static_cast<T>(asn1_parser::binary2Int<rapidasn1::parse_non_validating>(value, size)) : T();
+        }
+
+        template<int Version, int Release>
+        void set_chars(void *field, const unsigned char *value, std::size_t size, std::size_t capacity, std::size_t tag)
+        {
+            char *out = static_cast<char *>(field);
+            std::size_t n = 0;
+            if (find_tap_element<Version, Release>(tag)->type == BcdString)
+            {
+                for (std::size_t i = 0; i < size && n + 1 < capacity; ++i)
+                {
+                    unsigned char high = value[i] >> 4;
+                    unsigned char low = value[i] & 0x0F;
+                    if (high == 0x0F)
+                        break;
+                    out[n++] = static_cast<char>('0' + high);
+                    if (low == 0x0F || n + 1 == capacity)
+                        break;
+                    out[n++] = static_cast<char>('0' + low);
+                }
+            }
+            else
+            {
+                n = size < capacity ? size : capacity - 1;
+                std::memcpy(out, value, n);
+            }
+            out[n] = 0;
+        }
+
+        // Resolvers of reference codes, by type of the bound member
+
+        inline void resolve_value(const tap_references &references, boost::int64_t code, tap_exchange_rate *field, std::size_t)
+        {
+            if (const tap_exchange_rate *rate = references.exchange_rates.find(code))
+                *field = *rate;
+        }
+
+        inline void resolve_value(const tap_references &references, boost::int64_t code, tap_taxation *field, std::size_t)
+        {
+            if (const tap_taxation *taxation = references.taxations.find(code))
+                *field = *taxation;
+        }
+
+        inline void resolve_value(const tap_references &references, boost::int64_t code, tap_rec_entity *field, std::size_t)
+        {
+            if (const tap_rec_entity *entity = references.rec_entities.find(code))
+                *field = *entity;
+        }
+
+        inline void resolve_value(const tap_references &references, boost::int64_t code, boost::int32_t *field, std::size_t)
+        {
+            if (const boost::int32_t *offset = references.utc_offsets.find(code))
+                *field = *offset;
+        }
+
+        inline void resolve_value(const tap_references &references, boost::int64_t code, char *field, std::size_t capacity)
+        {
+            if (const std::string *description = references.message_descriptions.find(code))
+                copy_text(field, capacity, reinterpret_cast<const unsigned char *>(description->data()), description->size());
+        }
+
+        template<class T>
+        void resolve_field(const tap_references &references, boost::int64_t code, void *field, std::size_t capacity)
+        {
+            resolve_value(references, code, static_cast<T *>(field), capacity);
+        }
+    }
+
+    //! Fills structs straight from BER, as bound by tap_record_traits<Record>.
+    //! The binding is resolved once, on construction: element names become tags and each
+    //! decoded value is dispatched by its tag to the few fields bound to it. Reading then walks
+    //! the BER without building a tree and without any allocation per field.
+    //! Paths are names, which C++03 cannot take as template arguments, hence the binding
+    //! is resolved at run time rather than compiled into a switch.
+    template<int Version, int Release, class Record>
+    class tap_binding
+    {
+    public:
+
+        //! Resolves the binding of Record; throws asn1_parser_error if it names an unknown element.
+        tap_binding()
+            : m_record_tag(0)
+            , m_has_references(false)
+            , m_list_tag(tag("CallEventDetailList"))
+            , m_local_time_tag(tag("LocalTimeStamp"))
+            , m_offset_tag(tag("UtcTimeOffset"))
+            , m_offset_code_tag(tag("UtcTimeOffsetCode"))
+        {
+            tap_record_traits<Record>::bind(*this);
+            index_fields();
+        }
+
+        //! Reads every bound call event of a batch, appending one Record to records for each.
+        //! \return false if the batch is malformed; result then holds the error.
+        template<class Byte>
+        bool read(const Byte *data, std::size_t size, std::vector<Record> &records,
+                  rapidasn1::parse_result &result) const
+        {
+            tap_references references;
+            return read(data, size, records, references, result);
+        }
+
+        //! Reads every bound call event of a batch, also giving the reference tables of the batch.
+        //! The tables are filled in the same pass, before the call events, if the binding
+        //! has resolve() or utc_time() fields.
+        template<class Byte>
+        bool read(const Byte *data, std::size_t size, std::vector<Record> &records,
+                  tap_references &references, rapidasn1::parse_result &result) const
+        {
+            references.clear();
+            runner<Byte> handler(*this, records, references);
+            return rapidasn1::walk<rapidasn1::parse_default>(data, size, handler, result);
+        }
+
+        //! Restricts the binding to the call events named name
+        void record(const char *name)
+        {
+            m_record_tag = tag(name);
+            if (!m_record_tag)
+                BOOST_PROPERTY_TREE_THROW(asn1_parser::asn1_parser_error(
+                    "unknown TAP element", name, 0));
+        }
+
+        //! Binds an integral member
+        template<class T>
+        void operator()(const char *path, T Record::*member)
+        {
+            BOOST_STATIC_ASSERT(boost::is_integral<T>::value);
+            add(path, offset(member), sizeof(T), &internal::set_integer<T>, 0);
+        }
+
+        //! Binds a char array member
+        template<std::size_t N>
+        void operator()(const char *path, char (Record::*member)[N])
+        {
+            BOOST_STATIC_ASSERT(N > 0);
+            add(path, offset(member), N, 0, &internal::set_chars<Version, Release>);
+        }
+
+        //! Binds a member to the timestamp group at path, converted to UTC seconds since 1970-01-01.
+        //! A UtcTimeOffsetCode is resolved through the UtcTimeOffsetInfoList of NetworkInfo, which
+        //! is read in the same pass since it precedes the call events; a timestamp whose offset
+        //! is unknown keeps its local time.
+        void utc_time(const char *path, boost::int64_t Record::*member)
+        {
+            add(path, offset(member), sizeof(boost::int64_t), 0, 0);
+            m_fields.back().utc_time = true;
+            m_has_references = true;
+        }
+
+        //! Binds the CurrencyConversion of the ExchangeRateCode at path
+        void resolve(const char *path, tap_exchange_rate Record::*member)
+        {
+            add_reference<tap_exchange_rate>(path, tag("ExchangeRateCode"), offset(member), sizeof(tap_exchange_rate));
+        }
+
+        //! Binds the Taxation of the TaxCode at path
+        void resolve(const char *path, tap_taxation Record::*member)
+        {
+            add_reference<tap_taxation>(path, tag("TaxCode"), offset(member), sizeof(tap_taxation));
+        }
+
+        //! Binds the RecEntityInformation of the RecEntityCode at path
+        void resolve(const char *path, tap_rec_entity Record::*member)
+        {
+            add_reference<tap_rec_entity>(path, tag("RecEntityCode"), offset(member), sizeof(tap_rec_entity));
+        }
+
+        //! Binds the UTC offset, in seconds east of UTC, of the UtcTimeOffsetCode at path
+        void resolve(const char *path, boost::int32_t Record::*member)
+        {
+            add_reference<boost::int32_t>(path, m_offset_code_tag, offset(member), sizeof(boost::int32_t));
+        }
+
+        //! Binds the MessageDescription of the MessageDescriptionCode at path, truncated to N - 1 characters
+        template<std::size_t N>
+        void resolve(const char *path, char (Record::*member)[N])
+        {
+            BOOST_STATIC_ASSERT(N > 0);
+            add_reference<char>(path, tag("MessageDescriptionCode"), offset(member), N);
+        }
+
+    private:
+
+        typedef void (*integer_setter)(void *, const unsigned char *, std::size_t, std::size_t);
+        typedef void (*chars_setter)(void *, const unsigned char *, std::size_t, std::size_t, std::size_t);
+        typedef void (*code_resolver)(const tap_references &, boost::int64_t, void *, std::size_t);
+
+        struct field
+        {
+            std::vector<std::size_t> path;
+            std::size_t offset;
+            std::size_t size;
+            integer_setter set_integer;
+            chars_setter set_chars;
+            code_resolver resolve;      // Reference code, see resolve()
+            bool utc_time;              // Timestamp group, see utc_time()
+        };
+
+        // Parts of a timestamp group seen so far in a record
+        struct timestamp_state
+        {
+            boost::int64_t local;
+            boost::int32_t offset;
+            bool has_local;
+            bool has_offset;
+        };
+
+        static std::size_t tag(const char *name)
+        {
+            return find_tap_tag<Version, Release>(name);
+        }
+
+        template<class T>
+        static std::size_t offset(T Record::*member)
+        {
+            const Record probe = Record();
+            return reinterpret_cast<const char *>(&(probe.*member)) - reinterpret_cast<const char *>(&probe);
+        }
+
+        void add(const char *path, std::size_t offset, std::size_t size, integer_setter integer, chars_setter chars)
+        {
+            field f;
+            if (!find_tap_path<Version, Release>(path, f.path))
+                BOOST_PROPERTY_TREE_THROW(asn1_parser::asn1_parser_error(
+                    "unknown TAP element", path, 0));
+            f.offset = offset;
+            f.size = size;
+            f.set_integer = integer;
+            f.set_chars = chars;
+            f.resolve = 0;
+            f.utc_time = false;
+            m_fields.push_back(f);
+        }
+
+        template<class T>
+        void add_reference(const char *path, std::size_t code_tag, std::size_t offset, std::size_t size)
+        {
+            add(path, offset, size, 0, 0);
+            if (m_fields.back().path.back() != code_tag)
+                BOOST_PROPERTY_TREE_THROW(asn1_parser::asn1_parser_error(
+                    "not a reference code of this type", path, 0));
+            m_fields.back().resolve = &internal::resolve_field<T>;
+            m_has_references = true;
+        }
+
+        // Lists the fields by the tag of the values they take, so that a value visits only
+        // its own fields: m_by_tag[m_first[tag]] to m_by_tag[m_first[tag + 1]] for tags below 1024.
+        // A timestamp group takes the values of its LocalTimeStamp, UtcTimeOffset and UtcTimeOffsetCode.
+        void index_fields()
+        {
+            std::vector<std::size_t> counts(1025, 0);
+            for (int pass = 0; pass < 2; ++pass)
+            {
+                for (std::size_t i = 0; i < m_fields.size(); ++i)
+                {
+                    std::size_t tags[3] = {m_fields[i].path.back(), 0, 0};
+                    if (m_fields[i].utc_time)
+                    {
+                        tags[0] = m_local_time_tag;
+                        tags[1] = m_offset_tag;
+                        tags[2] = m_offset_code_tag;
+                    }
+                    for (std::size_t t = 0; t < 3 && tags[t]; ++t)
+                    {
+                        if (pass)
+                            m_by_tag[counts[tags[t]]++] = i;
+                        else
+                            ++counts[tags[t] + 1];
+                    }
+                }
+                if (!pass)
+                {
+                    for (std::size_t t = 1; t < counts.size(); ++t)
+                        counts[t] += counts[t - 1];
+                    m_first = counts;
+                    m_by_tag.resize(counts.back());
+                }
+            }
+        }
+
+        // Walk handler filling one record per call event
+        template<class Byte>
+        class runner
+        {
+        public:
+
+            runner(const tap_binding &binding, std::vector<Record> &records, tap_references &references)
+                : m_binding(binding)
+                , m_records(records)
+                , m_references(references)
+                , m_builder(references)
+                , m_in_list(false)
+                , m_seen(binding.m_fields.size())
+                , m_times(binding.m_fields.size())
+            {
+            }
+
+            bool begin_group(std::size_t tag, std::size_t offset, std::size_t depth)
+            {
+                m_tags[depth] = tag;
+                if (!m_in_list)
+                {
+                    // Only CallEventDetailList is entered below the top level,
+                    // and the reference lists when codes are resolved
+                    if (depth == 1 && tag == m_binding.m_list_tag)
+                        m_in_list = true;
+                    else if (depth && m_binding.m_has_references)
+                        return m_builder.begin_group(tag, offset, depth);
+                    return depth == 0 || m_in_list;
+                }
+                if (depth == 2)
+                {
+                    // Call events of other kinds are skipped by their length
+                    if (m_binding.m_record_tag && tag != m_binding.m_record_tag)
+                        return false;
+                    m_records.push_back(Record());
+                    std::fill(m_seen.begin(), m_seen.end(), false);
+                    timestamp_state none = {0, 0, false, false};
+                    std::fill(m_times.begin(), m_times.end(), none);
+                }
+                return true;
+            }
+
+            void end_group(std::size_t tag, std::size_t offset, std::size_t depth)
+            {
+                if (!m_in_list)
+                    m_builder.end_group(tag, offset, depth);
+                else if (depth == 1)
+                    m_in_list = false;
+            }
+
+            void value(std::size_t tag, const Byte *value, std::size_t size, std::size_t depth)
+            {
+                const unsigned char *octets = reinterpret_cast<const unsigned char *>(value);
+                if (!m_in_list)
+                {
+                    m_builder.value(tag, value, size, depth);
+                    return;
+                }
+                if (depth <= 2 || tag >= 1024)
+                    return;
+                m_tags[depth] = tag;
+                char *record = reinterpret_cast<char *>(&m_records.back());
+                for (std::size_t k = m_binding.m_first[tag]; k < m_binding.m_first[tag + 1]; ++k)
+                {
+                    const std::size_t i = m_binding.m_by_tag[k];
+                    const field &f = m_binding.m_fields[i];
+                    if (f.utc_time)
+                    {
+                        if (!m_seen[i] && depth > 3 && match_tap_path(f.path, m_tags, 2, depth - 1))
+                            m_seen[i] = set_time(m_times[i], record + f.offset, tag, octets, size);
+                        continue;
+                    }
+                    if (m_seen[i] || !match_tap_path(f.path, m_tags, 2, depth))
+                        continue;
+                    if (f.resolve)
+                    {
+                        if (size && size <= 8)
+                            f.resolve(m_references, asn1_parser::binary2Int<rapidasn1::parse_non_validating>(octets, size),
+                                      record + f.offset, f.size);
+                    }
+                    else if (f.set_integer)
+                        f.set_integer(record + f.offset, octets, size, f.size);
+                    else
+                        f.set_chars(record + f.offset, octets, size, f.size, tag);
+                    m_seen[i] = true;
+                }
+            }
+
+        private:
+
+            // Adds a child of a timestamp group to its field; returns true once the UTC time is known
+            bool set_time(timestamp_state &state, char *field, std::size_t tag, const unsigned char *value, std::size_t size)
+            {
+                if (tag == m_binding.m_local_time_tag)
+                    state.has_local = local_time_seconds(value, size, state.local);
+                else if (tag == m_binding.m_offset_tag)
+                    state.has_offset = utc_offset_seconds(value, size, state.offset);
+                else if (tag == m_binding.m_offset_code_tag && size && size <= 8)
+                {
+                    const boost::int32_t *offset = m_references.utc_offsets.find(
+                        asn1_parser::binary2Int<rapidasn1::parse_non_validating>(value, size));
+                    state.has_offset = offset != 0;
+                    state.offset = offset ? *offset : 0;
+                }
+                if (!state.has_local)
+                    return false;
+                boost::int64_t seconds = state.local - (state.has_offset ? state.offset : 0);
+                std::memcpy(field, &seconds, sizeof(seconds));
+                return state.has_offset;
+            }
+
+            const tap_binding &m_binding;
+            std::vector<Record> &m_records;
+            tap_references &m_references;
+            internal::reference_builder<Version, Release> m_builder;      // Fills m_references before the call events
+            bool m_in_list;
+            std::vector<bool> m_seen;
+            std::vector<timestamp_state> m_times;
+            std::size_t m_tags[BOOST_PROPERTY_TREE_RAPIDASN1_VALIDATE_DEPTH];
+        };
+
+        std::size_t m_record_tag;       // Tag of the bound call events, or 0 for all
+        std::vector<field> m_fields;
+        bool m_has_references;          // Some field is bound by utc_time() or resolve()
+        std::size_t m_list_tag, m_local_time_tag, m_offset_tag, m_offset_code_tag;
+        std::vector<std::size_t> m_first;   // Start of the fields of each tag in m_by_tag, see index_fields()
+        std::vector<std::size_t> m_by_tag;
+    };
+
+    //! Reads the call events of a batch into a vector of structs bound by tap_record_traits<Record>.
+    template<int Version, int Release, class Record, class Byte>
+    bool read_tap_records(const Byte *data, std::size_t size, std::vector<Record> &records,
+                          rapidasn1::parse_result &result)
+    {
+        static const tap_binding<Version, Release, Record> binding;
+        return binding.read(data, size, records, result);
+    }
+
+}}}}
+
+#endif
@@ -0,0 +1,268 @@
+// ----------------------------------------------------------------------------
+// Copyright (C) 2015-2016 zunceng@gmail.com
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+// For more information, see www.boost.org
+// ----------------------------------------------------------------------------
+#ifndef BOOST_PROPERTY_TREE_TAP3_DECODER_HPP_INCLUDED
+#define BOOST_PROPERTY_TREE_TAP3_DECODER_HPP_INCLUDED
+
+//! \file tap3_decoder.hpp One-pass decoding of TAP batches from BER into a tap_tree.
+//! The decoder looks every tag up in the table. tools/tap3_codegen can generate a specialisation
+//! of tap_decoder<Version, Release> with one function per group and a switch over its child tags,
+//! but none is shipped: on the sample batches it was no faster than the table.
+
+#include "rapidasn1.hpp"
+#include "tap3_parser_read.hpp"
+#include "tap3_tree.hpp"
+
+namespace boost { namespace property_tree { namespace detail {namespace tap_parser{
+
+    namespace internal
+    {
+        // Header of a BER node read by the decoders
+        struct ber_header
+        {
+            std::size_t tag;
+            std::size_t len;            // Content length, unless varlen
+            bool constructed;
+            bool varlen;
+        };
+
+        // Input and error of a decode, shared by the functions of a decoder
+        struct decode_state
+        {
+            const unsigned char *data;
+            std::size_t depth;
+            rapidasn1::parse_result *result;
+
+            // Records an error; always returns false
+            bool fail(rapidasn1::parse_code code, const char *what, std::size_t where)
+            {
+                result->code = code;
+                result->what = what;
+                result->where = where;
+                return false;
+            }
+        };
+
+        typedef bool (*group_decoder)(tap_tree &, tap_node &, decode_state &, std::size_t &, std::size_t, bool);
+
+        // Reads the header of the next child of a group whose content ends at end,
+        // or at an end-of-contents marker if varlen; pos is left at the content of the child.
+        // Returns 1 for a child, 0 past the end of the group and -1 on error.
+        inline int next_child(decode_state &state, std::size_t &pos, std::size_t end, bool varlen, ber_header &child)
+        {
+            const unsigned char *data = state.data;
+            if (varlen)
+            {
+                if (end - pos < 2)
+                    return state.fail(rapidasn1::error_missing_end, "expected end: decode_tap()", pos) - 1;
+                if (!data[pos] && !data[pos + 1])
+                {
+                    pos += 2;
+                    return 0;
+                }
+            }
+            else if (pos == end)
+                return 0;
+
+            std::size_t tag_size = rapidasn1::internal::decode_tag<rapidasn1::parse_default>(data + pos, end - pos, child.tag);
+            if (!tag_size)
+                return state.fail(rapidasn1::error_unexpected_end, "unexpect end: decode_tap()", pos) - 1;
+            int is_varlen = 0;
+            rapidasn1::parse_code code = rapidasn1::error_none;
+            std::size_t len_size = rapidasn1::internal::decode_len<rapidasn1::parse_default>(
+                data + pos + tag_size, end - pos - tag_size, child.len, is_varlen, code);
+            if (!len_size)
+                return state.fail(code, "prase error: decode_tap()", pos + tag_size) - 1;
+            child.constructed = (data[pos] & 0x20) != 0;
+            child.varlen = is_varlen != 0;
+            pos += tag_size + len_size;
+            if (child.varlen ? !child.constructed : child.len > end - pos)
+                return state.fail(child.varlen ? rapidasn1::error_varlen_primitive : rapidasn1::error_overrun,
+                                  "prase error: decode_tap()", pos) - 1;
+            return 1;
+        }
+
+        // Enters a group; fails beyond BOOST_PROPERTY_TREE_RAPIDASN1_VALIDATE_DEPTH levels
+        inline bool enter_group(decode_state &state, std::size_t pos)
+        {
+            if (++state.depth > BOOST_PROPERTY_TREE_RAPIDASN1_VALIDATE_DEPTH)
+                return state.fail(rapidasn1::error_too_deep, "too deep: decode_tap()", pos);
+            return true;
+        }
+
+        // Skips the content of a child that is not decoded
+        inline bool skip_content(decode_state &state, std::size_t &pos, std::size_t end, const ber_header &child)
+        {
+            if (!child.varlen)
+            {
+                pos += child.len;
+                return true;
+            }
+            if (!enter_group(state, pos))
+                return false;
+            ber_header grandchild;
+            int next;
+            while ((next = next_child(state, pos, end, true, grandchild)) > 0)
+                if (!skip_content(state, pos, end, grandchild))
+                    return false;
+            --state.depth;
+            return next == 0;
+        }
+
+        // Value conversions, as done by trans_asn1_tree(); Integers are stored as numbers and as text
+
+        inline void append_integer(tap_tree &tree, tap_node &parent, const tap_element *element,
+                                   const unsigned char *value, std::size_t size)
+        {
+            unsigned long long number = 0;
+            if (size && size <= 8)
+            {
+                number = (value[0] & 0x80) ? ~0ULL : 0;
+                for (std::size_t i = 0; i < size; ++i)
+                    number = (number << 8) | value[i];
+            }
+            bool negative = static_cast<long long>(number) < 0;
+            unsigned long long magnitude = negative ? 0 - number : number;
+            char text[24];
+            char *end = text + sizeof(text);
+            char *begin = end;
+            do
+            {
+                *--begin = static_cast<char>('0' + magnitude % 10);
+                magnitude /= 10;
+            } while (magnitude);
+            if (negative)
+                *--begin = '-';
+            tap_node *node = tree.allocate_node(element, begin, end - begin);
+            node->integer(static_cast<boost::int64_t>(number));
+            parent.append_node(node);
+        }
+
+        inline void append_octets(tap_tree &tree, tap_node &parent, const tap_element *element,
+                                  const unsigned char *value, std::size_t size)
+        {
+            parent.append_node(tree.allocate_node(element, reinterpret_cast<const char *>(value), size));
+        }
+
+        inline void append_bcd(tap_tree &tree, tap_node &parent, const tap_element *element,
+                               const unsigned char *value, std::size_t size)
+        {
+            tap_node *node = tree.allocate_node(element);
+            parent.append_node(node);
+            if (!size)
+                return;
+            char *text = tree.allocate_string(0, 2 * size);
+            std::size_t n = 0;
+            for (std::size_t i = 0; i < size; ++i)
+            {
+                unsigned char high = value[i] >> 4;
+                unsigned char low = value[i] & 0x0F;
+                if (high == 0x0F)
+                    break;
+                text[n++] = static_cast<char>('0' + high);
+                if (low == 0x0F)
+                    break;
+                text[n++] = static_cast<char>('0' + low);
+            }
+            node->value(text, n);
+        }
+
+        inline void append_value(tap_tree &tree, tap_node &parent, const tap_element *element,
+                                 const unsigned char *value, std::size_t size)
+        {
+            switch (element->type)
+            {
+                case Integer:
+                case Integer64:
+                    append_integer(tree, parent, element, value, size);
+                    break;
+                case BcdString:
+                    append_bcd(tree, parent, element, value, size);
+                    break;
+                default:
+                    append_octets(tree, parent, element, value, size);
+                    break;
+            }
+        }
+
+        // Decodes a child whose header has been read: groups with decoder, values by the type of element.
+        // Children missing from the lookup table are skipped.
+        inline bool decode_child(tap_tree &tree, tap_node &parent, decode_state &state, std::size_t &pos, std::size_t end,
+                                 const ber_header &child, const tap_element *element, group_decoder decoder)
+        {
+            if (!element)
+                return skip_content(state, pos, end, child);
+            if (element->type == Group)
+            {
+                tap_node *node = tree.allocate_node(element);
+                parent.append_node(node);
+                if (!child.constructed)
+                {
+                    pos += child.len;
+                    return true;
+                }
+                return decoder(tree, *node, state, pos, child.varlen ? end : pos + child.len, child.varlen);
+            }
+            if (child.varlen)
+                return skip_content(state, pos, end, child);
+            append_value(tree, parent, element, state.data + pos, child.len);
+            pos += child.len;
+            return true;
+        }
+
+        // Decodes the children of a group by looking their tags up in the table
+        template<int Version, int Release>
+        bool decode_generic(tap_tree &tree, tap_node &node, decode_state &state, std::size_t &pos, std::size_t end, bool varlen)
+        {
+            if (!enter_group(state, pos))
+                return false;
+            ber_header child;
+            int next;
+            while ((next = next_child(state, pos, end, varlen, child)) > 0)
+                if (!decode_child(tree, node, state, pos, end, child, find_tap_element<Version, Release>(child.tag),
+                                  &decode_generic<Version, Release>))
+                    return false;
+            --state.depth;
+            return next == 0;
+        }
+    }
+
+    //! Decoder of the batches of a TAP Version/Release.
+    //! Specialisations generated by tools/tap3_codegen provide the same decode() function
+    //! with the tags of each group resolved at compile time.
+    template<int Version, int Release>
+    struct tap_decoder
+    {
+        //! Decodes the size bytes of state.data as children of tree
+        static bool decode(tap_tree &tree, internal::decode_state &state, std::size_t size)
+        {
+            std::size_t pos = 0;
+            return internal::decode_generic<Version, Release>(tree, tree, state, pos, size, false);
+        }
+    };
+
+    //! Decodes a batch straight from BER into tree, with the same result as parsing it
+    //! into an asn1_tree and calling trans_asn1_tree(), but in one pass and without the BER tree.
+    //! Values are copied; the tree does not refer to data.
+    //! \param result Receives the error code, description and position if the data is malformed.
+    //! \return true on success; otherwise tree holds what was decoded before the error.
+    template<int Version, int Release, class Byte>
+    bool decode_tap(const Byte *data, std::size_t size, tap_tree &tree, rapidasn1::parse_result &result)
+    {
+        tree.clear();
+        internal::decode_state state = {reinterpret_cast<const unsigned char *>(data), 0, &result};
+        if (!tap_decoder<Version, Release>::decode(tree, state, size))
+            return false;
+        result.code = rapidasn1::error_none;
+        return true;
+    }
+
+}}}}
+
+#endif
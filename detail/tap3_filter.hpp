@@ -0,0 +1,359 @@
+// ----------------------------------------------------------------------------
+// Copyright (C) 2015-2016 zunceng@gmail.com
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+// For more information, see www.boost.org
+// ----------------------------------------------------------------------------
+#ifndef BOOST_PROPERTY_TREE_TAP3_FILTER_HPP_INCLUDED
+#define BOOST_PROPERTY_TREE_TAP3_FILTER_HPP_INCLUDED
+
+#include "asn1_parser_error.hpp"
+#include "rapidasn1.hpp"
+#include "tap3_index.hpp"
+#include "tap3_parser_read.hpp"
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace boost { namespace property_tree { namespace detail {namespace tap_parser{
+
+    //! Selection of call events by predicates evaluated on the raw BER values.
+    //! Predicates name TAP paths, matched against the end of the element path inside each
+    //! call event as by tap_aggregation; a predicate holds if any occurrence of its element
+    //! satisfies it, and a call event is selected if every predicate holds.
+    //! A predicate followed by once() is decided by the first occurrence of its element instead,
+    //! which lets a call event failing it be rejected at that point.
+    //! Values are compared as they are encoded: BCD digits as packed nibbles, OctStrings
+    //! byte by byte and Integers in two's complement, so nothing is converted to text.
+    //! <br><code>
+    //! <br>tap_filter<3, 11> filter;
+    //! <br>filter.bcd_prefix("Imsi", "23802").once().octet_range("CallEventStartTimeStamp.LocalTimeStamp", "20140612000000", "20140612235959");
+    //! <br>filter.select(data, size, offsets, result);
+    //! </code><br>
+    template<int Version, int Release>
+    class tap_filter
+    {
+    public:
+
+        tap_filter()
+            : m_record_tag(0)
+        {
+        }
+
+        //! Restricts the selection to the call events named name, such as GprsCall
+        tap_filter &record(const char *name)
+        {
+            m_record_tag = find_tap_tag<Version, Release>(name, std::strlen(name));
+            if (!m_record_tag)
+                BOOST_PROPERTY_TREE_THROW(asn1_parser::asn1_parser_error(
+                    "unknown TAP element", name, 0));
+            return *this;
+        }
+
+        //! BCD digits, such as an Imsi, starting with digits
+        tap_filter &bcd_prefix(const std::string &path, const std::string &digits)
+        {
+            return bcd_range(path, digits, digits);
+        }
+
+        //! BCD digits whose leading digits lie between low and high, each compared on its own length;
+        //! bcd_range("Imsi", "238020", "238029") selects Imsi from 238020... to 238029...
+        tap_filter &bcd_range(const std::string &path, const std::string &low, const std::string &high)
+        {
+            predicate p = compile(path, predicate_bcd);
+            p.low = pack_bcd(low);
+            p.high = pack_bcd(high);
+            p.low_digits = low.size();
+            p.high_digits = high.size();
+            m_predicates.push_back(p);
+            return *this;
+        }
+
+        //! OctString equal to value
+        tap_filter &equals(const std::string &path, const std::string &value)
+        {
+            return one_of(path, std::vector<std::string>(1, value));
+        }
+
+        //! OctString equal to one of values, such as a set of ServingNetwork
+        tap_filter &one_of(const std::string &path, const std::vector<std::string> &values)
+        {
+            predicate p = compile(path, predicate_set);
+            p.values = values;
+            std::sort(p.values.begin(), p.values.end());
+            m_predicates.push_back(p);
+            return *this;
+        }
+
+        //! OctString between low and high inclusive, byte by byte;
+        //! with fixed-width digits, as LocalTimeStamp, this is a time window.
+        tap_filter &octet_range(const std::string &path, const std::string &low, const std::string &high)
+        {
+            predicate p = compile(path, predicate_octets);
+            p.low = low;
+            p.high = high;
+            m_predicates.push_back(p);
+            return *this;
+        }
+
+        //! Integer between min and max inclusive
+        tap_filter &integer_range(const std::string &path, long long min, long long max)
+        {
+            predicate p = compile(path, predicate_integer);
+            p.min = min;
+            p.max = max;
+            m_predicates.push_back(p);
+            return *this;
+        }
+
+        //! Marks the last predicate as decided by the first occurrence of its element, for elements
+        //! that occur at most once in a call event, such as Imsi or TotalCallEventDuration.
+        //! A call event failing it is rejected without looking further into it; without once(),
+        //! a later occurrence could still satisfy the predicate, so the rest of the call event is read.
+        tap_filter &once()
+        {
+            BOOST_ASSERT(!m_predicates.empty());
+            m_predicates.back().once = true;
+            return *this;
+        }
+
+        //! Checks one call event, header included.
+        //! \return false if it is not selected or is malformed; result tells which.
+        template<class Byte>
+        bool match(const Byte *record, std::size_t size, rapidasn1::parse_result &result) const
+        {
+            result.code = rapidasn1::error_none;
+            matcher<Byte> handler(*this);
+            return rapidasn1::walk<rapidasn1::parse_default>(record, size, handler, result) && handler.selected();
+        }
+
+        //! Finds the call events of a batch that are selected. Call events are located by their
+        //! headers as by scan_call_events(), and a call event of another kind than record() is
+        //! skipped by its length. The others are read until every predicate holds, or until one
+        //! marked once() fails; the rest of the call event is then skipped group by group.
+        //! \param offsets Receives the position of each selected call event in data.
+        //! \return true on success; false with result set if the batch is malformed.
+        template<class Byte>
+        bool select(const Byte *data, std::size_t size, std::vector<std::size_t> &offsets,
+                    rapidasn1::parse_result &result) const
+        {
+            offsets.clear();
+            std::size_t begin, end;
+            if (!internal::find_call_event_list<Version, Release>(data, begin, size, result))
+                return false;
+            selector<Byte> sink = {this, data, begin, &offsets, false, rapidasn1::parse_result()};
+            if (rapidasn1::internal::scan_siblings<rapidasn1::parse_default>(data + begin, size, sink, end, result) && !sink.failed)
+                return true;
+            if (sink.failed)
+                result = sink.failure;
+            result.where += begin;
+            return false;
+        }
+
+    private:
+
+        enum predicate_kind
+        {
+            predicate_bcd,
+            predicate_set,
+            predicate_octets,
+            predicate_integer
+        };
+
+        struct predicate
+        {
+            std::vector<std::size_t> path;
+            predicate_kind kind;
+            bool once;                          // Decided by the first occurrence
+            std::string low, high;              // Packed BCD or octets
+            std::size_t low_digits, high_digits;
+            std::vector<std::string> values;    // Sorted
+            long long min, max;
+        };
+
+        predicate compile(const std::string &path, predicate_kind kind) const
+        {
+            predicate p;
+            if (!find_tap_path<Version, Release>(path, p.path))
+                BOOST_PROPERTY_TREE_THROW(asn1_parser::asn1_parser_error(
+                    "unknown TAP element", path, 0));
+            p.kind = kind;
+            p.once = false;
+            p.low_digits = p.high_digits = 0;
+            p.min = p.max = 0;
+            return p;
+        }
+
+        // Packs digits into BCD octets, high nibble first, as stored in the BER value
+        static std::string pack_bcd(const std::string &digits)
+        {
+            std::string packed((digits.size() + 1) / 2, '\xFF');
+            for (std::size_t i = 0; i < digits.size(); ++i)
+            {
+                unsigned char digit = static_cast<unsigned char>(digits[i] - '0') & 0x0F;
+                unsigned char &octet = reinterpret_cast<unsigned char &>(packed[i / 2]);
+                octet = (i & 1) ? ((octet & 0xF0) | digit) : ((digit << 4) | 0x0F);
+            }
+            return packed;
+        }
+
+        // Compares the first digits of a BCD value with packed digits; a value
+        // shorter than digits compares greater, as its filler nibbles would.
+        static int compare_bcd(const unsigned char *value, std::size_t size, const std::string &packed, std::size_t digits)
+        {
+            std::size_t octets = digits / 2;
+            std::size_t n = size < octets ? size : octets;
+            int c = std::memcmp(value, packed.data(), n);
+            if (c || size < octets)
+                return c ? c : 1;
+            if (!(digits & 1))
+                return 0;
+            int high = size > octets ? value[octets] >> 4 : 0x0F;
+            return high - (static_cast<unsigned char>(packed[octets]) >> 4);
+        }
+
+        static int compare_octets(const unsigned char *value, std::size_t size, const std::string &octets)
+        {
+            std::size_t n = size < octets.size() ? size : octets.size();
+            int c = std::memcmp(value, octets.data(), n);
+            return c ? c : (size < octets.size() ? -1 : size > octets.size());
+        }
+
+        static bool test(const predicate &p, const unsigned char *value, std::size_t size)
+        {
+            switch (p.kind)
+            {
+                case predicate_bcd:
+                    return compare_bcd(value, size, p.low, p.low_digits) >= 0 &&
+                           compare_bcd(value, size, p.high, p.high_digits) <= 0;
+                case predicate_set:
+                {
+                    // Binary search of the sorted values
+                    std::size_t first = 0, count = p.values.size();
+                    while (count)
+                    {
+                        std::size_t half = count / 2;
+                        if (compare_octets(value, size, p.values[first + half]) > 0)
+                        {
+                            first += half + 1;
+                            count -= half + 1;
+                        }
+                        else
+                            count = half;
+                    }
+                    return first < p.values.size() && !compare_octets(value, size, p.values[first]);
+                }
+                case predicate_octets:
+                    return compare_octets(value, size, p.low) >= 0 && compare_octets(value, size, p.high) <= 0;
+                case predicate_integer:
+                {
+                    if (!size || size > 8)
+                        return false;
+                    long long number = asn1_parser::binary2Int<rapidasn1::parse_non_validating>(value, size);
+                    return number >= p.min && number <= p.max;
+                }
+            }
+            return false;
+        }
+
+        // Walk handler deciding the predicates of one call event; once every predicate holds,
+        // or one fails for good, the rest of the call event is skipped group by group.
+        template<class Byte>
+        class matcher
+        {
+        public:
+
+            explicit matcher(const tap_filter &filter)
+                : m_filter(filter)
+                , m_held(filter.m_predicates.size())
+                , m_pending(filter.m_predicates.size())
+                , m_rejected(false)
+            {
+            }
+
+            bool selected() const
+            {
+                return !m_rejected && !m_pending;
+            }
+
+            bool begin_group(std::size_t tag, std::size_t, std::size_t depth)
+            {
+                m_tags[depth] = tag;
+                if (!depth && m_filter.m_record_tag && tag != m_filter.m_record_tag)
+                    m_rejected = true;
+                return m_pending && !m_rejected;
+            }
+
+            void end_group(std::size_t, std::size_t, std::size_t)
+            {
+            }
+
+            void value(std::size_t tag, const Byte *value, std::size_t size, std::size_t depth)
+            {
+                if (!m_pending || m_rejected)
+                    return;
+                m_tags[depth] = tag;
+                const unsigned char *octets = reinterpret_cast<const unsigned char *>(value);
+                for (std::size_t i = 0; i < m_held.size(); ++i)
+                {
+                    const predicate &p = m_filter.m_predicates[i];
+                    if (m_held[i] || !match_tap_path(p.path, m_tags, 0, depth))
+                        continue;
+                    if (test(p, octets, size))
+                    {
+                        m_held[i] = true;
+                        --m_pending;
+                    }
+                    else if (p.once)
+                    {
+                        m_rejected = true;
+                        return;
+                    }
+                }
+            }
+
+        private:
+
+            const tap_filter &m_filter;
+            std::vector<bool> m_held;
+            std::size_t m_pending;          // Predicates not yet satisfied
+            bool m_rejected;                // Call event of another kind, or failing a once() predicate
+            std::size_t m_tags[BOOST_PROPERTY_TREE_RAPIDASN1_VALIDATE_DEPTH];
+        };
+
+        // Sink of rapidasn1::internal::scan_siblings() matching each call event
+        template<class Byte>
+        struct selector
+        {
+            const tap_filter *filter;
+            const Byte *data;
+            std::size_t base;
+            std::vector<std::size_t> *offsets;
+            bool failed;
+            rapidasn1::parse_result failure;    // Error within a call event, relative to the list
+
+            bool operator()(std::size_t offset, std::size_t, std::size_t size)
+            {
+                if (filter->match(data + base + offset, size, failure))
+                    offsets->push_back(base + offset);
+                else if (!failure.ok())
+                {
+                    failed = true;
+                    failure.where += offset;
+                    return false;
+                }
+                return true;
+            }
+        };
+
+        std::size_t m_record_tag;       // Tag of the selected call events, or 0 for all
+        std::vector<predicate> m_predicates;
+    };
+
+}}}}
+
+#endif
@@ -0,0 +1,481 @@
+// ----------------------------------------------------------------------------
+// Copyright (C) 2015-2016 zunceng@gmail.com
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+// For more information, see www.boost.org
+// ----------------------------------------------------------------------------
+#ifndef BOOST_PROPERTY_TREE_TAP3_FINGERPRINT_HPP_INCLUDED
+#define BOOST_PROPERTY_TREE_TAP3_FINGERPRINT_HPP_INCLUDED
+
+//! \file tap3_fingerprint.hpp Fingerprints of call events, to find duplicates across batches.
+//! A fingerprint is 128 bits made of two XXH64 hashes with different seeds, taken either over
+//! the BER octets of a call event or over a chosen set of its fields.
+
+#include "asn1_parser_error.hpp"
+#include "rapidasn1.hpp"
+#include "tap3_index.hpp"
+#include "tap3_parser_read.hpp"
+#include <boost/cstdint.hpp>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace boost { namespace property_tree { namespace detail {namespace tap_parser{
+
+    //! 128-bit fingerprint of a call event
+    struct tap_fingerprint
+    {
+        boost::uint64_t low;
+        boost::uint64_t high;
+
+        bool operator==(const tap_fingerprint &other) const
+        {
+            return low == other.low && high == other.high;
+        }
+
+        bool operator!=(const tap_fingerprint &other) const
+        {
+            return !(*this == other);
+        }
+
+        bool operator<(const tap_fingerprint &other) const
+        {
+            return high < other.high || (high == other.high && low < other.low);
+        }
+    };
+
+    namespace internal
+    {
+        const boost::uint64_t xxh_prime1 = 0x9E3779B185EBCA87ULL;
+        const boost::uint64_t xxh_prime2 = 0xC2B2AE3D27D4EB4FULL;
+        const boost::uint64_t xxh_prime3 = 0x165667B19E3779F9ULL;
+        const boost::uint64_t xxh_prime4 = 0x85EBCA77C2B2AE63ULL;
+        const boost::uint64_t xxh_prime5 = 0x27D4EB2F165667C5ULL;
+
+        // Seed of the high half of a fingerprint
+        const boost::uint64_t fingerprint_seed = 0x5441503346505231ULL;
+
+        inline boost::uint64_t rotate_left(boost::uint64_t value, int bits)
+        {
+            return (value << bits) | (value >> (64 - bits));
+        }
+
+        // Little-endian loads, whatever the alignment and byte order of the host
+        inline boost::uint64_t read_le64(const unsigned char *p)
+        {
+            boost::uint64_t value = 0;
+            for (int i = 7; i >= 0; --i)
+                value = (value << 8) | p[i];
+            return value;
+        }
+
+        inline boost::uint32_t read_le32(const unsigned char *p)
+        {
+            return static_cast<boost::uint32_t>(p[0]) | (static_cast<boost::uint32_t>(p[1]) << 8) |
+                   (static_cast<boost::uint32_t>(p[2]) << 16) | (static_cast<boost::uint32_t>(p[3]) << 24);
+        }
+
+        inline boost::uint64_t xxh64_round(boost::uint64_t accumulator, boost::uint64_t input)
+        {
+            accumulator += input * xxh_prime2;
+            return rotate_left(accumulator, 31) * xxh_prime1;
+        }
+
+        inline boost::uint64_t xxh64_merge(boost::uint64_t accumulator, boost::uint64_t value)
+        {
+            accumulator ^= xxh64_round(0, value);
+            return accumulator * xxh_prime1 + xxh_prime4;
+        }
+
+        // XXH64 of size octets at data
+        inline boost::uint64_t xxh64(const unsigned char *data, std::size_t size, boost::uint64_t seed)
+        {
+            const unsigned char *p = data;
+            const unsigned char *end = data + size;
+            boost::uint64_t hash;
+            if (size >= 32)
+            {
+                boost::uint64_t v1 = seed + xxh_prime1 + xxh_prime2;
+                boost::uint64_t v2 = seed + xxh_prime2;
+                boost::uint64_t v3 = seed;
+                boost::uint64_t v4 = seed - xxh_prime1;
+                for (; end - p >= 32; p += 32)
+                {
+                    v1 = xxh64_round(v1, read_le64(p));
+                    v2 = xxh64_round(v2, read_le64(p + 8));
+                    v3 = xxh64_round(v3, read_le64(p + 16));
+                    v4 = xxh64_round(v4, read_le64(p + 24));
+                }
+                hash = rotate_left(v1, 1) + rotate_left(v2, 7) + rotate_left(v3, 12) + rotate_left(v4, 18);
+                hash = xxh64_merge(hash, v1);
+                hash = xxh64_merge(hash, v2);
+                hash = xxh64_merge(hash, v3);
+                hash = xxh64_merge(hash, v4);
+            }
+            else
+                hash = seed + xxh_prime5;
+
+            hash += size;
+            for (; end - p >= 8; p += 8)
+                hash = rotate_left(hash ^ xxh64_round(0, read_le64(p)), 27) * xxh_prime1 + xxh_prime4;
+            if (end - p >= 4)
+            {
+                hash = rotate_left(hash ^ (read_le32(p) * xxh_prime1), 23) * xxh_prime2 + xxh_prime3;
+                p += 4;
+            }
+            for (; p < end; ++p)
+                hash = rotate_left(hash ^ (*p * xxh_prime5), 11) * xxh_prime1;
+
+            hash ^= hash >> 33;
+            hash *= xxh_prime2;
+            hash ^= hash >> 29;
+            hash *= xxh_prime3;
+            hash ^= hash >> 32;
+            return hash;
+        }
+
+        inline tap_fingerprint fingerprint_octets(const unsigned char *data, std::size_t size)
+        {
+            tap_fingerprint fingerprint;
+            fingerprint.low = xxh64(data, size, 0);
+            fingerprint.high = xxh64(data, size, fingerprint_seed);
+            return fingerprint;
+        }
+
+        inline void append_le64(std::vector<unsigned char> &out, boost::uint64_t value)
+        {
+            for (int i = 0; i < 8; ++i, value >>= 8)
+                out.push_back(static_cast<unsigned char>(value));
+        }
+    }
+
+    //! Computes the fingerprints of call events.
+    //! Without keys, a fingerprint covers all the BER octets of a call event, header included.
+    //! With keys, it covers the call event tag and the first value of each key, in the order
+    //! the keys were given; it then ignores the other fields and how the call event is encoded.
+    //! <br><code>
+    //! <br>tap_fingerprinter<3, 11> fingerprinter;
+    //! <br>fingerprinter.key("Imsi").key("CallEventStartTimeStamp.LocalTimeStamp").key("TotalCallEventDuration");
+    //! <br>fingerprinter.fingerprint_call_events(data, size, fingerprints, result);
+    //! </code><br>
+    template<int Version, int Release>
+    class tap_fingerprinter
+    {
+    public:
+
+        //! Adds a key field, as a TAP path matched against the end of the element path
+        tap_fingerprinter &key(const std::string &path)
+        {
+            std::vector<std::size_t> tags;
+            if (!find_tap_path<Version, Release>(path, tags))
+                BOOST_PROPERTY_TREE_THROW(asn1_parser::asn1_parser_error(
+                    "unknown TAP element", path, 0));
+            m_keys.push_back(tags);
+            return *this;
+        }
+
+        //! Computes the fingerprint of one call event, header included.
+        //! \return true on success; false with result set if the call event is malformed.
+        template<class Byte>
+        bool fingerprint(const Byte *record, std::size_t size, tap_fingerprint &fingerprint,
+                         rapidasn1::parse_result &result) const
+        {
+            result.code = rapidasn1::error_none;
+            const unsigned char *octets = reinterpret_cast<const unsigned char *>(record);
+            if (m_keys.empty())
+            {
+                fingerprint = internal::fingerprint_octets(octets, size);
+                return true;
+            }
+            key_reader<Byte> reader(*this);
+            if (!rapidasn1::walk<rapidasn1::parse_default>(record, size, reader, result))
+                return false;
+            fingerprint = internal::fingerprint_octets(&reader.canonical[0], reader.canonical.size());
+            return true;
+        }
+
+        //! Computes the fingerprints of the call events of a batch, in the same pass
+        //! that locates them as scan_call_events() does.
+        //! \param offsets Receives the position of each call event in data, if not null.
+        //! \return true on success; false with result set if the batch is malformed.
+        template<class Byte>
+        bool fingerprint_call_events(const Byte *data, std::size_t size, std::vector<tap_fingerprint> &fingerprints,
+                                     rapidasn1::parse_result &result, std::vector<std::size_t> *offsets = 0) const
+        {
+            fingerprints.clear();
+            if (offsets)
+                offsets->clear();
+            std::size_t begin, end;
+            if (!internal::find_call_event_list<Version, Release>(data, begin, size, result))
+                return false;
+            fingerprint_sink<Byte> sink = {this, data, begin, &fingerprints, offsets, false, rapidasn1::parse_result()};
+            if (rapidasn1::internal::scan_siblings<rapidasn1::parse_default>(data + begin, size, sink, end, result) && !sink.failed)
+                return true;
+            if (sink.failed)
+                result = sink.failure;
+            result.where += begin;
+            return false;
+        }
+
+    private:
+
+        // Walk handler collecting the canonical form of the keys of a call event:
+        // its tag, then the XXH64 of the first value of each key, or 0 if the key is absent.
+        template<class Byte>
+        class key_reader
+        {
+        public:
+
+            explicit key_reader(const tap_fingerprinter &fingerprinter)
+                : m_fingerprinter(fingerprinter)
+                , m_seen(fingerprinter.m_keys.size())
+                , m_pending(fingerprinter.m_keys.size())
+                , m_hashes(fingerprinter.m_keys.size())
+            {
+            }
+
+            bool begin_group(std::size_t tag, std::size_t, std::size_t depth)
+            {
+                m_tags[depth] = tag;
+                if (!depth)
+                    internal::append_le64(canonical, tag);
+                return m_pending != 0;
+            }
+
+            void end_group(std::size_t, std::size_t, std::size_t depth)
+            {
+                if (depth)
+                    return;
+                for (std::size_t i = 0; i < m_hashes.size(); ++i)
+                    internal::append_le64(canonical, m_hashes[i]);
+            }
+
+            void value(std::size_t tag, const Byte *value, std::size_t size, std::size_t depth)
+            {
+                m_tags[depth] = tag;
+                if (!depth)
+                {
+                    // Primitive call event
+                    internal::append_le64(canonical, tag);
+                    end_group(tag, 0, depth);
+                    return;
+                }
+                for (std::size_t i = 0; i < m_seen.size(); ++i)
+                    if (!m_seen[i] && match_tap_path(m_fingerprinter.m_keys[i], m_tags, 0, depth))
+                    {
+                        m_seen[i] = true;
+                        --m_pending;
+                        m_hashes[i] = internal::xxh64(reinterpret_cast<const unsigned char *>(value), size, i + 1);
+                    }
+            }
+
+            std::vector<unsigned char> canonical;
+
+        private:
+
+            const tap_fingerprinter &m_fingerprinter;
+            std::vector<bool> m_seen;
+            std::size_t m_pending;          // Keys not met yet
+            std::vector<boost::uint64_t> m_hashes;
+            std::size_t m_tags[BOOST_PROPERTY_TREE_RAPIDASN1_VALIDATE_DEPTH];
+        };
+
+        // Sink of rapidasn1::internal::scan_siblings() fingerprinting each call event
+        template<class Byte>
+        struct fingerprint_sink
+        {
+            const tap_fingerprinter *fingerprinter;
+            const Byte *data;
+            std::size_t base;
+            std::vector<tap_fingerprint> *fingerprints;
+            std::vector<std::size_t> *offsets;
+            bool failed;
+            rapidasn1::parse_result failure;    // Error within a call event, relative to the list
+
+            bool operator()(std::size_t offset, std::size_t, std::size_t size)
+            {
+                tap_fingerprint fingerprint;
+                if (!fingerprinter->fingerprint(data + base + offset, size, fingerprint, failure))
+                {
+                    failed = true;
+                    failure.where += offset;
+                    return false;
+                }
+                fingerprints->push_back(fingerprint);
+                if (offsets)
+                    offsets->push_back(base + offset);
+                return true;
+            }
+        };
+
+        std::vector<std::vector<std::size_t> > m_keys;
+    };
+
+    //! Header of a saved tap_dedup_set, followed by count fingerprints
+    struct tap_dedup_header
+    {
+        char magic[8];              //!< "TAPDUP1"
+        boost::uint64_t count;      //!< Number of fingerprints
+    };
+
+    //! Set of fingerprints, e.g. of the call events of a day's batches.
+    //! Fingerprints are kept in an open-addressing table; the set can be saved to a file
+    //! and loaded again, or merged with the sets built by other processes.
+    class tap_dedup_set
+    {
+    public:
+
+        tap_dedup_set()
+            : m_size(0)
+            , m_has_zero(false)
+        {
+        }
+
+        std::size_t size() const
+        {
+            return m_size;
+        }
+
+        bool empty() const
+        {
+            return !m_size;
+        }
+
+        void clear()
+        {
+            m_slots.clear();
+            m_size = 0;
+            m_has_zero = false;
+        }
+
+        //! Adds a fingerprint.
+        //! \return true if it was not in the set, false if it is a duplicate.
+        bool insert(const tap_fingerprint &fingerprint)
+        {
+            if (is_zero(fingerprint))
+            {
+                if (m_has_zero)
+                    return false;
+                m_has_zero = true;
+                ++m_size;
+                return true;
+            }
+            if ((m_size + 1) * 2 > m_slots.size())
+                rehash(m_slots.empty() ? 64 : m_slots.size() * 2);
+            tap_fingerprint &slot = m_slots[find_slot(m_slots, fingerprint)];
+            if (!is_zero(slot))
+                return false;
+            slot = fingerprint;
+            ++m_size;
+            return true;
+        }
+
+        bool contains(const tap_fingerprint &fingerprint) const
+        {
+            if (is_zero(fingerprint))
+                return m_has_zero;
+            return !m_slots.empty() && !is_zero(m_slots[find_slot(m_slots, fingerprint)]);
+        }
+
+        //! Adds the fingerprints of another set
+        void merge(const tap_dedup_set &other)
+        {
+            if (other.m_has_zero)
+                insert(tap_fingerprint());
+            for (std::size_t i = 0; i < other.m_slots.size(); ++i)
+                if (!is_zero(other.m_slots[i]))
+                    insert(other.m_slots[i]);
+        }
+
+        //! Writes the set to a file; throws asn1_parser_error on failure.
+        void save(const std::string &filename) const
+        {
+            std::vector<tap_fingerprint> fingerprints;
+            fingerprints.reserve(m_size);
+            if (m_has_zero)
+                fingerprints.push_back(tap_fingerprint());
+            for (std::size_t i = 0; i < m_slots.size(); ++i)
+                if (!is_zero(m_slots[i]))
+                    fingerprints.push_back(m_slots[i]);
+
+            tap_dedup_header header;
+            std::memset(&header, 0, sizeof(header));
+            std::memcpy(header.magic, "TAPDUP1", 8);
+            header.count = fingerprints.size();
+
+            std::ofstream stream(filename.c_str(), std::ios::out | std::ios::binary);
+            if (!stream)
+                BOOST_PROPERTY_TREE_THROW(asn1_parser::asn1_parser_error(
+                    "cannot open file", filename, 0));
+            stream.write(reinterpret_cast<const char *>(&header), sizeof(header));
+            if (!fingerprints.empty())
+                stream.write(reinterpret_cast<const char *>(&fingerprints[0]), fingerprints.size() * sizeof(tap_fingerprint));
+            if (!stream.flush())
+                BOOST_PROPERTY_TREE_THROW(asn1_parser::asn1_parser_error("write error", filename, 0));
+        }
+
+        //! Adds the fingerprints saved in a file; throws asn1_parser_error on failure.
+        void load(const std::string &filename)
+        {
+            std::ifstream stream(filename.c_str(), std::ios::in | std::ios::binary);
+            if (!stream)
+                BOOST_PROPERTY_TREE_THROW(asn1_parser::asn1_parser_error(
+                    "cannot open file", filename, 0));
+            tap_dedup_header header;
+            if (!stream.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+                std::memcmp(header.magic, "TAPDUP1", 8) != 0)
+                BOOST_PROPERTY_TREE_THROW(asn1_parser::asn1_parser_error(
+                    "not a tap dedup set", filename, 0));
+            tap_fingerprint fingerprints[256];
+            boost::uint64_t remaining = header.count;
+            while (remaining)
+            {
+                std::size_t n = remaining < 256 ? static_cast<std::size_t>(remaining) : 256;
+                if (!stream.read(reinterpret_cast<char *>(fingerprints), n * sizeof(tap_fingerprint)))
+                    BOOST_PROPERTY_TREE_THROW(asn1_parser::asn1_parser_error(
+                        "not a tap dedup set", filename, 0));
+                for (std::size_t i = 0; i < n; ++i)
+                    insert(fingerprints[i]);
+                remaining -= n;
+            }
+        }
+
+    private:
+
+        // The zero fingerprint marks empty slots and is kept aside
+        static bool is_zero(const tap_fingerprint &fingerprint)
+        {
+            return !fingerprint.low && !fingerprint.high;
+        }
+
+        // Index of the slot holding fingerprint, or of the empty slot where it belongs; slots has a free slot
+        static std::size_t find_slot(const std::vector<tap_fingerprint> &slots, const tap_fingerprint &fingerprint)
+        {
+            std::size_t mask = slots.size() - 1;
+            std::size_t i = static_cast<std::size_t>(fingerprint.low) & mask;
+            while (!is_zero(slots[i]) && slots[i] != fingerprint)
+                i = (i + 1) & mask;
+            return i;
+        }
+
+        void rehash(std::size_t capacity)
+        {
+            std::vector<tap_fingerprint> slots(capacity, tap_fingerprint());
+            for (std::size_t i = 0; i < m_slots.size(); ++i)
+                if (!is_zero(m_slots[i]))
+                    slots[find_slot(slots, m_slots[i])] = m_slots[i];
+            m_slots.swap(slots);
+        }
+
+        std::vector<tap_fingerprint> m_slots;   // Power of two in size, at most half full
+        std::size_t m_size;
+        bool m_has_zero;
+    };
+
+}}}}
+
+#endif
@@ -0,0 +1,528 @@
+// ----------------------------------------------------------------------------
+// Copyright (C) 2015-2016 zunceng@gmail.com
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+// For more information, see www.boost.org
+// ----------------------------------------------------------------------------
+#ifndef BOOST_PROPERTY_TREE_TAP3_INDEX_HPP_INCLUDED
+#define BOOST_PROPERTY_TREE_TAP3_INDEX_HPP_INCLUDED
+
+#include "asn1_parser_error.hpp"
+#include "asn1_parser_mapped.hpp"
+#include "rapidasn1.hpp"
+#include "tap3_parser_read.hpp"
+#include <boost/cstdint.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace boost { namespace property_tree { namespace detail {namespace tap_parser{
+
+    //! Optional keys stored in a call event index
+    enum tap_index_keys
+    {
+        index_imsi = 0x1,           //!< First Imsi of the call event
+        index_start_time = 0x2,     //!< LocalTimeStamp of CallEventStartTimeStamp
+    };
+
+    //! Location and keys of one call event of a batch.
+    //! Entries are stored as is in the sidecar file.
+    struct tap_index_entry
+    {
+        boost::uint64_t offset;     //!< Position of the call event in the batch
+        boost::uint32_t size;       //!< Size of the call event, header included
+        boost::uint16_t tag;        //!< Tag of the call event (MobileOriginatedCall, GprsCall...)
+        boost::uint16_t keys;       //!< Keys present in this entry
+        unsigned char imsi[8];      //!< Imsi as BCD octets, padded with 0xFF
+        char start_time[14];        //!< LocalTimeStamp, YYYYMMDDhhmmss
+        char reserved[2];
+
+        //! Returns the Imsi digits, or an empty string if the key is absent
+        std::string get_imsi() const
+        {
+            return (keys & index_imsi) ? asn1_parser::binary2BCDString<0>(imsi, sizeof(imsi)) : std::string();
+        }
+
+        //! Returns the start time, or an empty string if the key is absent
+        std::string get_start_time() const
+        {
+            return (keys & index_start_time) ? std::string(start_time, sizeof(start_time)) : std::string();
+        }
+    };
+
+    //! Header of the sidecar file, followed by count entries
+    struct tap_index_header
+    {
+        char magic[8];              //!< "TAPIDX1"
+        boost::uint32_t version;    //!< Version the batch was indexed with
+        boost::uint32_t release;    //!< Release the batch was indexed with
+        boost::uint64_t count;      //!< Number of entries
+        boost::uint64_t batch_size; //!< Size of the indexed batch
+    };
+
+    namespace internal
+    {
+        // Walk handler collecting the children of CallEventDetailList
+        template<int Version, int Release, class Byte>
+        struct index_builder
+        {
+            index_builder(unsigned keys, std::vector<tap_index_entry> &entries)
+                : keys(keys), entries(entries), list_depth(0)
+                , list_tag(find_tap_tag<Version, Release>("CallEventDetailList"))
+                , imsi_tag(find_tap_tag<Version, Release>("Imsi"))
+                , time_tag(find_tap_tag<Version, Release>("LocalTimeStamp"))
+                , start_tag(find_tap_tag<Version, Release>("CallEventStartTimeStamp"))
+            {
+            }
+
+            bool begin_group(std::size_t tag, std::size_t offset, std::size_t depth)
+            {
+                tags[depth] = tag;
+                if (list_depth && depth == list_depth)
+                {
+                    tap_index_entry entry;
+                    std::memset(&entry, 0, sizeof(entry));
+                    std::memset(entry.imsi, 0xFF, sizeof(entry.imsi));
+                    entry.offset = offset;
+                    entry.tag = static_cast<boost::uint16_t>(tag);
+                    entries.push_back(entry);
+                    // Without keys a call event is skipped by its length
+                    return keys != 0;
+                }
+                if (tag == list_tag && !list_depth)
+                    list_depth = depth + 1;
+                // Nothing but the list is of interest outside call events
+                return depth < 1 || list_depth != 0;
+            }
+
+            void end_group(std::size_t, std::size_t end, std::size_t depth)
+            {
+                if (list_depth && depth == list_depth)
+                    entries.back().size = static_cast<boost::uint32_t>(end - entries.back().offset);
+                else if (list_depth && depth + 1 == list_depth)
+                    list_depth = 0;
+            }
+
+            void value(std::size_t tag, const Byte *value, std::size_t size, std::size_t depth)
+            {
+                if (!list_depth || depth <= list_depth)
+                    return;
+                tap_index_entry &entry = entries.back();
+                if (tag == imsi_tag && (keys & index_imsi) && !(entry.keys & index_imsi))
+                {
+                    std::memcpy(entry.imsi, value, size < sizeof(entry.imsi) ? size : sizeof(entry.imsi));
+                    entry.keys |= index_imsi;
+                }
+                else if (tag == time_tag && tags[depth-1] == start_tag && (keys & index_start_time) &&
+                         !(entry.keys & index_start_time) && size == sizeof(entry.start_time))
+                {
+                    std::memcpy(entry.start_time, value, size);
+                    entry.keys |= index_start_time;
+                }
+            }
+
+            unsigned keys;
+            std::vector<tap_index_entry> &entries;
+            std::size_t list_depth;         // Depth of the call events, or 0 outside CallEventDetailList
+            std::size_t tags[BOOST_PROPERTY_TREE_RAPIDASN1_VALIDATE_DEPTH];
+            std::size_t list_tag, imsi_tag, time_tag, start_tag;
+        };
+
+        // Sink of rapidasn1::internal::scan_siblings() indexing call events without keys
+        struct entry_sink
+        {
+            std::vector<tap_index_entry> *entries;
+            std::size_t base;
+
+            bool operator()(std::size_t offset, std::size_t tag, std::size_t size)
+            {
+                tap_index_entry entry;
+                std::memset(&entry, 0, sizeof(entry));
+                std::memset(entry.imsi, 0xFF, sizeof(entry.imsi));
+                entry.offset = base + offset;
+                entry.size = static_cast<boost::uint32_t>(size);
+                entry.tag = static_cast<boost::uint16_t>(tag);
+                entries->push_back(entry);
+                return true;
+            }
+        };
+
+        // Locates the content of CallEventDetailList by jumping over the headers before it.
+        // size receives the size of the content, or the rest of the batch if it has an indefinite length.
+        // Returns false with result set if the batch is malformed; begin is size when there is no list.
+        template<int Version, int Release, class Byte>
+        bool find_call_event_list(const Byte *data, std::size_t &begin, std::size_t &size, rapidasn1::parse_result &result)
+        {
+            using namespace rapidasn1;
+            const std::size_t list_tag = find_tap_tag<Version, Release>("CallEventDetailList");
+            std::size_t tag, len, pos = 0, end = size;
+            int is_varlen = 0;
+            parse_code code = error_none;
+            std::size_t header = size ? rapidasn1::internal::decode_header<parse_default>(data, size, tag, len, is_varlen, code) : 0;
+            if (header && !is_varlen && len > size - header)
+                code = error_overrun;
+            if (header && !code)
+            {
+                // Children of TransferBatch
+                pos = header;
+                if (!is_varlen)
+                    end = header + len;
+                while (pos < end && !(is_varlen && end - pos >= 2 && !data[pos] && !data[pos + 1]))
+                {
+                    int child_varlen = 0;
+                    header = rapidasn1::internal::decode_header<parse_default>(data + pos, end - pos, tag, len, child_varlen, code);
+                    if (!header)
+                        break;
+                    if (!child_varlen && len > end - pos - header)
+                    {
+                        code = error_overrun;
+                        break;
+                    }
+                    pos += header;
+                    if (tag == list_tag)
+                    {
+                        begin = pos;
+                        size = child_varlen ? end - pos : len;
+                        return true;
+                    }
+                    if (!child_varlen)
+                        pos += len;
+                    else if (!rapidasn1::internal::skip_varlen<parse_default>(data, pos, end, code))
+                        break;
+                }
+            }
+            if (!header || code)
+            {
+                result.code = code ? code : error_unexpected_end;
+                result.what = "prase error: find_call_event_list()";
+                result.where = pos;
+                return false;
+            }
+            begin = size;
+            size = 0;
+            return true;
+        }
+
+        // Header of a node of a mapped file
+        struct mapped_header
+        {
+            std::size_t tag;
+            boost::uint64_t len;        // Content length, unless varlen
+            std::size_t size;           // Size of the header
+            bool varlen;
+        };
+
+        // Reads the header of the node at pos, which must end before end;
+        // throws asn1_parser_error with the offset of the header if it is malformed.
+        inline void read_mapped_header(asn1_parser::mapped_file &file, boost::uint64_t pos, boost::uint64_t end,
+                                       mapped_header &header)
+        {
+            // Identifier and 9 length octets at most, for tags up to 2^35
+            std::size_t available = end - pos < 16 ? static_cast<std::size_t>(end - pos) : 16;
+            if (!available)
+                BOOST_PROPERTY_TREE_THROW(asn1_parser::asn1_parser_error(
+                    "unexpect end: for_each_call_event()", file.filename(), 0, pos));
+            int is_varlen = 0;
+            rapidasn1::parse_code code = rapidasn1::error_none;
+            header.size = rapidasn1::internal::decode_header<rapidasn1::parse_default>(
+                file.map(pos, available), available, header.tag, header.len, is_varlen, code);
+            header.varlen = is_varlen != 0;
+            if (!header.size || (!header.varlen && header.len > end - pos - header.size))
+                BOOST_PROPERTY_TREE_THROW(asn1_parser::asn1_parser_error(
+                    "prase error: for_each_call_event()", file.filename(), 0, pos));
+        }
+
+        // Size of the node at pos, header included; an indefinite-length node is scanned
+        // for its end-of-contents marker and must fit the mapping window.
+        inline boost::uint64_t mapped_node_size(asn1_parser::mapped_file &file, boost::uint64_t pos, boost::uint64_t end,
+                                                const mapped_header &header)
+        {
+            if (!header.varlen)
+                return header.size + header.len;
+            std::size_t available = end - pos < file.window_size() ? static_cast<std::size_t>(end - pos) : file.window_size();
+            std::size_t size = header.size;
+            rapidasn1::parse_code code = rapidasn1::error_none;
+            if (!rapidasn1::internal::skip_varlen<rapidasn1::parse_default>(file.map(pos, available), size, available, code))
+                BOOST_PROPERTY_TREE_THROW(asn1_parser::asn1_parser_error(
+                    code == rapidasn1::error_missing_end && available < end - pos
+                        ? "larger than the mapping window: for_each_call_event()" : "prase error: for_each_call_event()",
+                    file.filename(), 0, pos + size));
+            return size;
+        }
+
+        // Checks for the end of a group whose content ends at end, or at an end-of-contents marker if varlen;
+        // pos is moved past the marker.
+        inline bool mapped_group_end(asn1_parser::mapped_file &file, boost::uint64_t &pos, boost::uint64_t end, bool varlen)
+        {
+            if (!varlen)
+                return pos == end;
+            if (end - pos < 2)
+                BOOST_PROPERTY_TREE_THROW(asn1_parser::asn1_parser_error(
+                    "expected end: for_each_call_event()", file.filename(), 0, pos));
+            const unsigned char *marker = file.map(pos, 2);
+            if (marker[0] || marker[1])
+                return false;
+            pos += 2;
+            return true;
+        }
+    }
+
+    //! Finds the positions of the call events of a batch by jumping over their headers,
+    //! without looking into them; see rapidasn1::scan_siblings().
+    //! \param offsets Receives the position of each call event in data.
+    //! \return true on success; false with result set if the batch is malformed.
+    template<int Version, int Release, class Byte>
+    bool scan_call_events(const Byte *data, std::size_t size, std::vector<std::size_t> &offsets,
+                          rapidasn1::parse_result &result)
+    {
+        offsets.clear();
+        std::size_t begin, end;
+        if (!internal::find_call_event_list<Version, Release>(data, begin, size, result))
+            return false;
+        rapidasn1::internal::offset_sink sink = {&offsets, begin};
+        if (rapidasn1::internal::scan_siblings<rapidasn1::parse_default>(data + begin, size, sink, end, result))
+            return true;
+        result.where += begin;
+        return false;
+    }
+
+    //! Counts the call events of a batch without decoding them, for example to check CallEventDetailsCount.
+    //! \return true on success; false with result set if the batch is malformed.
+    template<int Version, int Release, class Byte>
+    bool count_call_events(const Byte *data, std::size_t size, std::size_t &count,
+                           rapidasn1::parse_result &result)
+    {
+        count = 0;
+        std::size_t begin, end;
+        if (!internal::find_call_event_list<Version, Release>(data, begin, size, result))
+            return false;
+        if (rapidasn1::count_siblings<rapidasn1::parse_default>(data + begin, size, count, end, result))
+            return true;
+        result.where += begin;
+        return false;
+    }
+
+    //! Visits the call events of a batch file of any size, mapping it one window at a time,
+    //! so that batches above 4 GB are read on 32-bit targets too. Groups before CallEventDetailList
+    //! are jumped over by their lengths, which may have up to 8 octets.
+    //! <br><code>
+    //! <br>bool handler(boost::uint64_t offset, const unsigned char *data, std::size_t size);
+    //! </code><br>
+    //! is called with the position of each call event in the file and its bytes, header included;
+    //! data is valid until the handler returns, which returns false to stop.
+    //! Call events, and groups of indefinite length before the list, must fit the mapping window.
+    //! Throws asn1_parser_error with the offset of malformed data.
+    //! \return Number of call events visited.
+    template<int Version, int Release, class Handler>
+    boost::uint64_t for_each_call_event(asn1_parser::mapped_file &file, Handler &handler)
+    {
+        const std::size_t list_tag = find_tap_tag<Version, Release>("CallEventDetailList");
+        boost::uint64_t pos = 0, end = file.size(), count = 0;
+        internal::mapped_header header;
+        internal::read_mapped_header(file, pos, end, header);
+        bool varlen = header.varlen;
+        pos = header.size;
+        if (!varlen)
+            end = pos + header.len;
+
+        // Children of TransferBatch
+        while (!internal::mapped_group_end(file, pos, end, varlen))
+        {
+            internal::read_mapped_header(file, pos, end, header);
+            if (header.tag != list_tag)
+            {
+                pos += internal::mapped_node_size(file, pos, end, header);
+                continue;
+            }
+            bool list_varlen = header.varlen;
+            boost::uint64_t list_end = list_varlen ? end : pos + header.size + header.len;
+            pos += header.size;
+            while (!internal::mapped_group_end(file, pos, list_end, list_varlen))
+            {
+                internal::read_mapped_header(file, pos, list_end, header);
+                boost::uint64_t size = internal::mapped_node_size(file, pos, list_end, header);
+                if (size > file.window_size())
+                    BOOST_PROPERTY_TREE_THROW(asn1_parser::asn1_parser_error(
+                        "larger than the mapping window: for_each_call_event()", file.filename(), 0, pos));
+                ++count;
+                if (!handler(pos, file.map(pos, static_cast<std::size_t>(size)), static_cast<std::size_t>(size)))
+                    break;
+                pos += size;
+            }
+            break;
+        }
+        return count;
+    }
+
+    //! Indexes the call events of a batch in one pass, without building a tree.
+    //! Without keys the call events are jumped over by their headers, as by scan_call_events(),
+    //! and their content is not checked.
+    //! \param keys Combination of tap_index_keys to record along with the locations.
+    //! \param result Receives the error if the batch is malformed.
+    //! \return true on success.
+    template<int Version, int Release, class Byte>
+    bool build_tap_index(const Byte *data, std::size_t size, unsigned keys,
+                         std::vector<tap_index_entry> &entries,
+                         rapidasn1::parse_result &result)
+    {
+        entries.clear();
+        if (!keys)
+        {
+            // Locations only: call events are jumped over by their headers
+            std::size_t begin, end;
+            if (!internal::find_call_event_list<Version, Release>(data, begin, size, result))
+                return false;
+            internal::entry_sink sink = {&entries, begin};
+            if (rapidasn1::internal::scan_siblings<rapidasn1::parse_default>(data + begin, size, sink, end, result))
+                return true;
+            result.where += begin;
+            return false;
+        }
+        internal::index_builder<Version, Release, Byte> builder(keys, entries);
+        return rapidasn1::walk<rapidasn1::parse_default>(data, size, builder, result);
+    }
+
+    //! Writes an index built by build_tap_index() to a sidecar file.
+    template<int Version, int Release>
+    void write_tap_index(const std::string &filename,
+                         const std::vector<tap_index_entry> &entries,
+                         std::size_t batch_size)
+    {
+        tap_index_header header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, "TAPIDX1", 8);
+        header.version = Version;
+        header.release = Release;
+        header.count = entries.size();
+        header.batch_size = batch_size;
+
+        std::ofstream stream(filename.c_str(), std::ios::out | std::ios::binary);
+        if (!stream)
+            BOOST_PROPERTY_TREE_THROW(asn1_parser::asn1_parser_error(
+                "cannot open file", filename, 0));
+        stream.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        if (!entries.empty())
+            stream.write(reinterpret_cast<const char *>(&entries[0]), entries.size() * sizeof(tap_index_entry));
+        if (!stream.flush())
+            BOOST_PROPERTY_TREE_THROW(asn1_parser::asn1_parser_error("write error", filename, 0));
+    }
+
+    //! Random access to the call events of a batch through its sidecar index.
+    //! Both files are memory mapped; only the selected call events are ever decoded.
+    template<int Version, int Release>
+    class tap_index_reader
+    {
+    public:
+
+        static const std::size_t npos = static_cast<std::size_t>(-1);
+
+        //! Maps a batch and its sidecar index; throws asn1_parser_error if they do not match
+        //! or an entry lies outside the batch.
+        tap_index_reader(const std::string &batch_filename, const std::string &index_filename)
+            : m_batch(map(batch_filename, m_batch_file))
+            , m_index(map(index_filename, m_index_file))
+        {
+            const tap_index_header *header = static_cast<const tap_index_header *>(m_index.get_address());
+            if (m_index.get_size() < sizeof(tap_index_header) ||
+                std::memcmp(header->magic, "TAPIDX1", 8) != 0 ||
+                header->version != Version || header->release != Release)
+                BOOST_PROPERTY_TREE_THROW(asn1_parser::asn1_parser_error(
+                    "not a tap index", index_filename, 0));
+            if (header->batch_size != m_batch.get_size() ||
+                (m_index.get_size() - sizeof(tap_index_header)) / sizeof(tap_index_entry) < header->count)
+                BOOST_PROPERTY_TREE_THROW(asn1_parser::asn1_parser_error(
+                    "index does not match batch", index_filename, 0));
+            m_count = static_cast<std::size_t>(header->count);
+            m_entries = reinterpret_cast<const tap_index_entry *>(header + 1);
+            for (std::size_t i = 0; i < m_count; ++i)
+                if (m_entries[i].offset > header->batch_size ||
+                    m_entries[i].size > header->batch_size - m_entries[i].offset)
+                    BOOST_PROPERTY_TREE_THROW(asn1_parser::asn1_parser_error(
+                        "entry outside the batch", index_filename, 0,
+                        sizeof(tap_index_header) + i * sizeof(tap_index_entry)));
+        }
+
+        //! Number of indexed call events
+        std::size_t size() const
+        {
+            return m_count;
+        }
+
+        const tap_index_entry &operator[](std::size_t index) const
+        {
+            BOOST_ASSERT(index < m_count);
+            return m_entries[index];
+        }
+
+        //! Mapped batch data
+        const unsigned char *data() const
+        {
+            return static_cast<const unsigned char *>(m_batch.get_address());
+        }
+
+        //! Finds the next call event at or after from with the given Imsi digits.
+        //! \return Index of the call event, or npos.
+        std::size_t find_imsi(const std::string &digits, std::size_t from = 0) const
+        {
+            unsigned char bcd[8];
+            std::memset(bcd, 0xFF, sizeof(bcd));
+            for (std::size_t i = 0; i < digits.size() && i < 2 * sizeof(bcd); ++i)
+            {
+                unsigned char digit = static_cast<unsigned char>(digits[i] - '0');
+                bcd[i/2] = (i & 1) ? ((bcd[i/2] & 0xF0) | digit) : ((digit << 4) | 0x0F);
+            }
+            for (std::size_t i = from; i < m_count; ++i)
+                if ((m_entries[i].keys & index_imsi) && std::memcmp(m_entries[i].imsi, bcd, sizeof(bcd)) == 0)
+                    return i;
+            return npos;
+        }
+
+        //! Decodes one call event into a new top level node of tree.
+        //! Throws asn1_parser_error, positioned in the batch, if the call event is malformed.
+        template<class Byte>
+        rapidasn1::asn1_node<Byte> *decode(rapidasn1::asn1_tree<Byte> &tree, std::size_t index) const
+        {
+            const tap_index_entry &entry = (*this)[index];
+            rapidasn1::asn1_node<Byte> *node = tree.allocate_node(rapidasn1::node_nongroup);
+            rapidasn1::parse_result result;
+            if (!tree.template parse_node<rapidasn1::parse_default>(reinterpret_cast<const Byte *>(data()) + entry.offset, entry.size, node, result))
+                BOOST_PROPERTY_TREE_THROW(asn1_parser::asn1_parser_error(
+                    result.what, m_batch_file.get_name(), 0, entry.offset + result.where));
+            tree.append_node(node);
+            return node;
+        }
+
+    private:
+
+        static boost::interprocess::mapped_region map(const std::string &filename, boost::interprocess::file_mapping &file)
+        {
+            try
+            {
+                boost::interprocess::file_mapping mapping(filename.c_str(), boost::interprocess::read_only);
+                file.swap(mapping);
+                return boost::interprocess::mapped_region(file, boost::interprocess::read_only);
+            }
+            catch (boost::interprocess::interprocess_exception &)
+            {
+                BOOST_PROPERTY_TREE_THROW(asn1_parser::asn1_parser_error(
+                    "cannot open file", filename, 0));
+            }
+        }
+
+        boost::interprocess::file_mapping m_batch_file;
+        boost::interprocess::file_mapping m_index_file;
+        boost::interprocess::mapped_region m_batch;
+        boost::interprocess::mapped_region m_index;
+        const tap_index_entry *m_entries;
+        std::size_t m_count;
+    };
+
+}}}}
+
+#endif
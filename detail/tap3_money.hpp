@@ -0,0 +1,376 @@
+// ----------------------------------------------------------------------------
+// Copyright (C) 2015-2016 zunceng@gmail.com
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+// For more information, see www.boost.org
+// ----------------------------------------------------------------------------
+#ifndef BOOST_PROPERTY_TREE_TAP3_MONEY_HPP_INCLUDED
+#define BOOST_PROPERTY_TREE_TAP3_MONEY_HPP_INCLUDED
+
+//! \file tap3_money.hpp Charges of a batch as fixed-point columns.
+//! Charge, TaxValue and TotalCharge are integers in units of 10^-TapDecimalPlaces of the TAP currency;
+//! ExchangeRate converts them to the local currency with NumberOfDecimalPlaces decimals.
+//! Amounts stay integers from decoding to rounding; nothing goes through double.
+
+#include "rapidasn1.hpp"
+#include "tap3_parser_read.hpp"
+#include "tap3_references.hpp"
+#include <boost/assert.hpp>
+#include <boost/config.hpp>
+#include <boost/cstdint.hpp>
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+namespace boost { namespace property_tree { namespace detail {namespace tap_parser{
+
+    //! Charges of the call events of a batch, one row per Charge or TaxValue, in columns
+    struct tap_charges
+    {
+        std::vector<boost::int64_t> amount;             //!< In units of 10^-tap_decimal_places
+        std::vector<boost::uint16_t> tag;               //!< Tag of Charge or TaxValue
+        std::vector<boost::int16_t> charge_type;        //!< ChargeType of a Charge as a number, -1 for TaxValue or if not numeric
+        std::vector<boost::int32_t> exchange_rate_code; //!< ExchangeRateCode of the ChargeInformation, -1 if none
+        std::vector<boost::uint32_t> call_event;        //!< Index of the call event in CallEventDetailList
+
+        boost::int32_t tap_decimal_places;              //!< TapDecimalPlaces of AccountingInfo
+        boost::int64_t total_charge;                    //!< TotalCharge of AuditControlInfo
+        boost::int64_t total_tax_value;                 //!< TotalTaxValue of AuditControlInfo
+        tap_references references;                      //!< Exchange rates and the other reference tables
+
+        tap_charges()
+            : tap_decimal_places(0)
+            , total_charge(0)
+            , total_tax_value(0)
+        {
+        }
+
+        std::size_t size() const
+        {
+            return amount.size();
+        }
+
+        void clear()
+        {
+            amount.clear();
+            tag.clear();
+            charge_type.clear();
+            exchange_rate_code.clear();
+            call_event.clear();
+            tap_decimal_places = 0;
+            total_charge = total_tax_value = 0;
+            references.clear();
+        }
+    };
+
+    namespace internal
+    {
+    #if defined(BOOST_HAS_INT128)
+        typedef boost::int128_type money_product;
+    #else
+        typedef boost::int64_t money_product;
+    #endif
+
+        // Largest power of ten held by an int64_t
+        const int max_power_of_ten = 18;
+
+        // 10^exponent for exponent in [0, 18]
+        inline boost::int64_t power_of_ten(int exponent)
+        {
+            BOOST_ASSERT(exponent >= 0 && exponent <= max_power_of_ten);
+            boost::int64_t power = 1;
+            while (exponent-- > 0)
+                power *= 10;
+            return power;
+        }
+
+        // Rounds amount * multiplier / divisor half away from zero, for multiplier >= 0 and divisor > 0.
+        // Without a 128-bit type the product itself must fit in 64 bits.
+        // Returns false if the result does not fit in 64 bits.
+        inline bool convert_amount(boost::int64_t amount, boost::int64_t multiplier, boost::int64_t divisor,
+                                   boost::int64_t &result)
+        {
+            const boost::int64_t max = (std::numeric_limits<boost::int64_t>::max)();
+            const boost::int64_t min = (std::numeric_limits<boost::int64_t>::min)();
+        #if !defined(BOOST_HAS_INT128)
+            if (multiplier && (amount > max / multiplier || amount < min / multiplier))
+                return false;
+        #endif
+            money_product value = static_cast<money_product>(amount) * multiplier;
+            money_product quotient = value / divisor;
+            money_product remainder = value % divisor;
+            if (2 * (remainder < 0 ? -remainder : remainder) >= divisor)
+                quotient += value < 0 ? -1 : 1;
+            if (quotient > max || quotient < min)
+                return false;
+            result = static_cast<boost::int64_t>(quotient);
+            return true;
+        }
+
+        // Tags read by charge_reader, resolved once per Version/Release from the element names
+        template<int Version, int Release>
+        struct charge_tags
+        {
+            std::size_t call_event_list, accounting_info, audit_control_info;
+            std::size_t tap_decimal_places, total_charge, total_tax_value;
+            std::size_t charge_information, charge_detail, exchange_rate_code, charge_type, charge, tax_value;
+
+            charge_tags()
+                : call_event_list(find_tap_tag<Version, Release>("CallEventDetailList"))
+                , accounting_info(find_tap_tag<Version, Release>("AccountingInfo"))
+                , audit_control_info(find_tap_tag<Version, Release>("AuditControlInfo"))
+                , tap_decimal_places(find_tap_tag<Version, Release>("TapDecimalPlaces"))
+                , total_charge(find_tap_tag<Version, Release>("TotalCharge"))
+                , total_tax_value(find_tap_tag<Version, Release>("TotalTaxValue"))
+                , charge_information(find_tap_tag<Version, Release>("ChargeInformation"))
+                , charge_detail(find_tap_tag<Version, Release>("ChargeDetail"))
+                , exchange_rate_code(find_tap_tag<Version, Release>("ExchangeRateCode"))
+                , charge_type(find_tap_tag<Version, Release>("ChargeType"))
+                , charge(find_tap_tag<Version, Release>("Charge"))
+                , tax_value(find_tap_tag<Version, Release>("TaxValue"))
+            {
+            }
+
+            static const charge_tags &instance()
+            {
+                static const charge_tags tags;
+                return tags;
+            }
+        };
+
+        // Walk handler filling tap_charges
+        template<int Version, int Release>
+        class charge_reader
+        {
+        public:
+
+            explicit charge_reader(tap_charges &charges)
+                : m_charges(charges)
+                , m_builder(charges.references)
+                , m_tags(charge_tags<Version, Release>::instance())
+                , m_section(0)
+                , m_call_event(0)
+                , m_rate_code(-1)
+                , m_charge_type(-1)
+            {
+            }
+
+            bool begin_group(std::size_t tag, std::size_t offset, std::size_t depth)
+            {
+                if (depth == 1)
+                    m_section = tag;
+                if (m_section != m_tags.call_event_list)
+                    return depth == 0 || (depth == 1 && tag == m_tags.audit_control_info) ||
+                           m_builder.begin_group(tag, offset, depth);
+                if (depth == 2 || tag == m_tags.charge_information)
+                    m_rate_code = -1;
+                else if (tag == m_tags.charge_detail)
+                    m_charge_type = -1;
+                return true;
+            }
+
+            void end_group(std::size_t tag, std::size_t offset, std::size_t depth)
+            {
+                if (m_section != m_tags.call_event_list)
+                    m_builder.end_group(tag, offset, depth);
+                else if (depth == 2)
+                    ++m_call_event;
+            }
+
+            template<class Byte>
+            void value(std::size_t tag, const Byte *value, std::size_t size, std::size_t depth)
+            {
+                const unsigned char *octets = reinterpret_cast<const unsigned char *>(value);
+                if (m_section != m_tags.call_event_list)
+                {
+                    if (depth == 2 && m_section == m_tags.accounting_info && tag == m_tags.tap_decimal_places)
+                        m_charges.tap_decimal_places = static_cast<boost::int32_t>(integer(octets, size));
+                    else if (depth == 2 && m_section == m_tags.audit_control_info && tag == m_tags.total_charge)
+                        m_charges.total_charge = integer(octets, size);
+                    else if (depth == 2 && m_section == m_tags.audit_control_info && tag == m_tags.total_tax_value)
+                        m_charges.total_tax_value = integer(octets, size);
+                    else
+                        m_builder.value(tag, value, size, depth);
+                    return;
+                }
+                if (tag == m_tags.exchange_rate_code)
+                    m_rate_code = static_cast<boost::int32_t>(integer(octets, size));
+                else if (tag == m_tags.charge_type)
+                    m_charge_type = charge_type(octets, size);
+                else if (tag == m_tags.charge || tag == m_tags.tax_value)
+                {
+                    m_charges.amount.push_back(integer(octets, size));
+                    m_charges.tag.push_back(static_cast<boost::uint16_t>(tag));
+                    m_charges.charge_type.push_back(tag == m_tags.charge ? m_charge_type : -1);
+                    m_charges.exchange_rate_code.push_back(m_rate_code);
+                    m_charges.call_event.push_back(m_call_event);
+                }
+            }
+
+        private:
+
+            static boost::int64_t integer(const unsigned char *value, std::size_t size)
+            {
+                return size && size <= 8 ? asn1_parser::binary2Int<rapidasn1::parse_non_validating>(value, size) : 0;
+            }
+
+            // ChargeType digits as a number, or -1 if empty, longer than 4 digits or not numeric
+            static boost::int16_t charge_type(const unsigned char *value, std::size_t size)
+            {
+                if (!size || size > 4)
+                    return -1;
+                boost::int16_t type = 0;
+                for (std::size_t i = 0; i < size; ++i)
+                {
+                    if (value[i] < '0' || value[i] > '9')
+                        return -1;
+                    type = static_cast<boost::int16_t>(type * 10 + (value[i] - '0'));
+                }
+                return type;
+            }
+
+            tap_charges &m_charges;
+            reference_builder<Version, Release> m_builder;
+            const charge_tags<Version, Release> &m_tags;
+            std::size_t m_section;              // Tag of the child of TransferBatch being read
+            boost::uint32_t m_call_event;
+            boost::int32_t m_rate_code;         // ExchangeRateCode of the current ChargeInformation
+            boost::int16_t m_charge_type;       // ChargeType of the current ChargeDetail
+        };
+    }
+
+    //! Decodes the charges of a batch into columns in one pass, along with TapDecimalPlaces,
+    //! the exchange rates and the audit totals.
+    //! \return true on success; false with result set if the batch is malformed.
+    template<int Version, int Release, class Byte>
+    bool read_tap_charges(const Byte *data, std::size_t size, tap_charges &charges, rapidasn1::parse_result &result)
+    {
+        charges.clear();
+        internal::charge_reader<Version, Release> reader(charges);
+        return rapidasn1::walk<rapidasn1::parse_default>(data, size, reader, result);
+    }
+
+    //! Sums the amounts of the rows with the given tag, and ChargeType unless charge_type is -1,
+    //! e.g. the Charge rows of ChargeType 00 to check TotalCharge.
+    inline boost::int64_t sum_charges(const tap_charges &charges, std::size_t tag, int charge_type = -1)
+    {
+        const std::size_t n = charges.size();
+        const boost::int64_t *amount = n ? &charges.amount[0] : 0;
+        const boost::uint16_t *tags = n ? &charges.tag[0] : 0;
+        const boost::int16_t *types = n ? &charges.charge_type[0] : 0;
+        boost::int64_t sum = 0;
+        for (std::size_t i = 0; i < n; ++i)
+            sum += amount[i] & -static_cast<boost::int64_t>(tags[i] == tag && (charge_type < 0 || types[i] == charge_type));
+        return sum;
+    }
+
+    //! Rescales amounts from one number of decimal places to another, rounding halves away from zero.
+    //! \return Number of amounts that cannot be rescaled; they are rescaled to 0. These are the amounts
+    //! that do not fit in 64 bits once rescaled, or all of them if the numbers of decimal places differ by more than 18.
+    inline std::size_t rescale_amounts(const std::vector<boost::int64_t> &amounts, int from_decimals, int to_decimals,
+                                       std::vector<boost::int64_t> &out)
+    {
+        const std::size_t n = amounts.size();
+        out.resize(n);
+        if (!n)
+            return 0;
+        const boost::int64_t *in = &amounts[0];
+        boost::int64_t *result = &out[0];
+        const boost::int64_t difference = static_cast<boost::int64_t>(to_decimals) - from_decimals;
+        if (difference < -internal::max_power_of_ten || difference > internal::max_power_of_ten)
+        {
+            std::fill(out.begin(), out.end(), 0);
+            return n;
+        }
+        std::size_t overflows = 0;
+        if (difference >= 0)
+        {
+            const boost::int64_t factor = internal::power_of_ten(static_cast<int>(difference));
+            const boost::int64_t max = (std::numeric_limits<boost::int64_t>::max)() / factor;
+            const boost::int64_t min = (std::numeric_limits<boost::int64_t>::min)() / factor;
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                bool fits = in[i] <= max && in[i] >= min;
+                result[i] = fits ? in[i] * factor : 0;
+                overflows += !fits;
+            }
+        }
+        else
+        {
+            // Quotient and remainder rather than in + half, which could overflow
+            const boost::int64_t divisor = internal::power_of_ten(static_cast<int>(-difference));
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                boost::int64_t quotient = in[i] / divisor, remainder = in[i] % divisor;
+                if (2 * (remainder < 0 ? -remainder : remainder) >= divisor)
+                    quotient += in[i] < 0 ? -1 : 1;
+                result[i] = quotient;
+            }
+        }
+        return overflows;
+    }
+
+    //! Converts every row to the local currency with the exchange rate of its ExchangeRateCode,
+    //! as a fixed-point amount with decimals decimal places, rounding halves away from zero.
+    //! The rate of each row is gathered first, so that the conversion runs over plain columns.
+    //! \return Number of rows that cannot be converted; they are converted to 0. These are the rows
+    //! without a known, positive exchange rate, those whose decimal places differ by more than 18
+    //! from decimals, and those whose amount in the local currency does not fit in 64 bits.
+    inline std::size_t convert_charges(const tap_charges &charges, int decimals, std::vector<boost::int64_t> &local)
+    {
+        const std::size_t n = charges.size();
+        local.resize(n);
+        if (!n)
+            return 0;
+
+        // Multiplier and divisor of each row
+        std::vector<boost::int64_t> multipliers(n), divisors(n);
+        std::size_t missing = 0;
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            const tap_exchange_rate *rate = charges.references.exchange_rates.find(charges.exchange_rate_code[i]);
+            multipliers[i] = 0;
+            divisors[i] = 1;
+            if (!rate || rate->exchange_rate <= 0)
+            {
+                ++missing;
+                continue;
+            }
+            boost::int64_t exponent = static_cast<boost::int64_t>(charges.tap_decimal_places) + rate->decimal_places - decimals;
+            if (exponent < -internal::max_power_of_ten || exponent > internal::max_power_of_ten)
+            {
+                ++missing;
+                continue;
+            }
+            boost::int64_t power = internal::power_of_ten(static_cast<int>(exponent < 0 ? -exponent : exponent));
+            if (exponent > 0)
+                divisors[i] = power;
+            else if (rate->exchange_rate > (std::numeric_limits<boost::int64_t>::max)() / power)
+            {
+                ++missing;
+                continue;
+            }
+            multipliers[i] = rate->exchange_rate * (exponent < 0 ? power : 1);
+        }
+
+        const boost::int64_t *amount = &charges.amount[0];
+        const boost::int64_t *multiplier = &multipliers[0];
+        const boost::int64_t *divisor = &divisors[0];
+        boost::int64_t *result = &local[0];
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            if (!internal::convert_amount(amount[i], multiplier[i], divisor[i], result[i]))
+            {
+                result[i] = 0;
+                ++missing;
+            }
+        }
+        return missing;
+    }
+
+}}}}
+
+#endif
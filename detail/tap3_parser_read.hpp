@@ -13,7 +13,11 @@
 #include <boost/property_tree/ptree.hpp>
 #include "asn1_parser_read.hpp"
 #include <boost/lexical_cast.hpp>
-#include <set>
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
 
 namespace boost { namespace property_tree { namespace detail {namespace tap_parser{
 
@@ -44,62 +48,372 @@ namespace boost { namespace property_tree { namespace detail {namespace tap_pars
         {
             static const tap_element tap_elements[1024];
         };
+
+        // Length of name without its trailing blanks
+        inline std::size_t trimmed_size(const char *name, std::size_t size)
+        {
+            while (size && name[size - 1] == ' ')
+                --size;
+            return size;
+        }
+
+        // Element name, without trailing blanks, and its tag
+        typedef std::pair<std::string, std::size_t> tag_name;
+
+        // Orders tag_name entries by name, against each other or against a name being looked up
+        struct tag_name_less
+        {
+            const char *name;
+            std::size_t size;
+
+            bool operator()(const tag_name &entry, const tag_name_less &key) const
+            {
+                return entry.first.compare(0, std::string::npos, key.name, key.size) < 0;
+            }
+        };
+
+        // Flat tag -> element table, and names sorted for lookups, built once per Version/Release.
+        template <int Version, int Release>
+        struct tag_index
+        {
+            const tap_element *elements[1024];
+            std::vector<tag_name> names;
+
+            tag_index()
+            {
+                std::fill(elements, elements + 1024, static_cast<const tap_element *>(0));
+                const tap_element *begin = &lookup_tables<Version, Release>::tap_elements[0];
+                const tap_element *end = begin + sizeof(lookup_tables<Version, Release>::tap_elements)/sizeof(tap_element);
+                for (const tap_element *it = begin; it != end; ++it)
+                    if (it->tag && it->tag < 1024)
+                        elements[it->tag] = it;
+                for (std::size_t tag = 1; tag < 1024; ++tag)
+                    if (elements[tag])
+                        names.push_back(tag_name(elements[tag]->name.substr(0,
+                            trimmed_size(elements[tag]->name.data(), elements[tag]->name.size())), tag));
+                std::sort(names.begin(), names.end());
+            }
+
+            static const tag_index &instance()
+            {
+                static const tag_index index;
+                return index;
+            }
+        };
     }
-    
-    template<int flags>
+
+    //! Finds the element definition of a tag in the Version/Release lookup table.
+    //! \return Pointer to the element, or 0 if the tag is unknown.
+    template<int Version, int Release>
+    const tap_element *find_tap_element(std::size_t tag)
+    {
+        return tag < 1024 ? internal::tag_index<Version, Release>::instance().elements[tag] : 0;
+    }
+
+    //! Finds the tag of an element name in the Version/Release lookup table, by binary search.
+    //! Trailing blanks are ignored, in name as in the table names.
+    //! \return Tag of the element, or 0 if the name is unknown.
+    template<int Version, int Release>
+    std::size_t find_tap_tag(const char *name, std::size_t size)
+    {
+        const std::vector<internal::tag_name> &names = internal::tag_index<Version, Release>::instance().names;
+        internal::tag_name_less key = {name, internal::trimmed_size(name, size)};
+        std::vector<internal::tag_name>::const_iterator it = std::lower_bound(names.begin(), names.end(), key, key);
+        if (it == names.end() || it->first.compare(0, std::string::npos, key.name, key.size) != 0)
+            return 0;
+        return it->second;
+    }
+
+    template<int Version, int Release>
+    std::size_t find_tap_tag(const std::string &name)
+    {
+        return find_tap_tag<Version, Release>(name.data(), name.size());
+    }
+
+    template<int Version, int Release>
+    std::size_t find_tap_tag(const char *name)
+    {
+        return find_tap_tag<Version, Release>(name, std::strlen(name));
+    }
+
+    //! Finds a node by a dot separated path of element names, e.g. "TransferBatch.BatchControlInfo".
+    //! A segment may carry a 1-based index to select among repeated children, e.g. "MobileOriginatedCall(3)".
+    //! \param node Node to start from, usually the asn1_tree.
+    //! \return Pointer to found node, or 0 if not found.
+    template<int Version, int Release, class Byte>
+    rapidasn1::asn1_node<Byte> *find_tap_node(const rapidasn1::asn1_node<Byte> &node, const std::string &path)
+    {
+        rapidasn1::asn1_node<Byte> *current = const_cast<rapidasn1::asn1_node<Byte> *>(&node);
+        std::string::size_type begin = 0;
+        while (current && begin < path.size())
+        {
+            std::string::size_type end = path.find('.', begin);
+            if (end == std::string::npos)
+                end = path.size();
+
+            std::string::size_type name_end = end;
+            std::size_t index = 1;
+            std::string::size_type open = path.find('(', begin);
+            if (open < end && path[end - 1] == ')')
+            {
+                index = 0;
+                for (std::string::size_type i = open + 1; i + 1 < end; ++i)
+                {
+                    if (path[i] < '0' || path[i] > '9')
+                        return 0;
+                    index = index * 10 + (path[i] - '0');
+                }
+                name_end = open;
+            }
+
+            std::size_t tag = find_tap_tag<Version, Release>(path.data() + begin, name_end - begin);
+            if (!tag || !index)
+                return 0;
+
+            rapidasn1::asn1_node<Byte> *child = current->first_node(tag);
+            while (child && --index)
+                child = child->next_sibling(tag);
+            current = child;
+            begin = end + 1;
+        }
+        return current;
+    }
+
+    //! Converts a dot separated path of element names to tags, outermost first.
+    //! \return false if a name is unknown.
+    template<int Version, int Release>
+    bool find_tap_path(const std::string &path, std::vector<std::size_t> &tags)
+    {
+        tags.clear();
+        std::string::size_type begin = 0;
+        while (begin <= path.size())
+        {
+            std::string::size_type end = path.find('.', begin);
+            if (end == std::string::npos)
+                end = path.size();
+            std::size_t tag = find_tap_tag<Version, Release>(path.data() + begin, end - begin);
+            if (!tag)
+                return false;
+            tags.push_back(tag);
+            begin = end + 1;
+        }
+        return true;
+    }
+
+    //! Checks whether path, as returned by find_tap_path(), ends the element path
+    //! held in tags[first] .. tags[depth].
+    inline bool match_tap_path(const std::vector<std::size_t> &path, const std::size_t *tags,
+                               std::size_t first, std::size_t depth)
+    {
+        std::size_t n = path.size();
+        if (!n || path[n - 1] != tags[depth] || n > depth - first + 1)
+            return false;
+        for (std::size_t i = 1; i < n; ++i)
+            if (path[n - 1 - i] != tags[depth - i])
+                return false;
+        return true;
+    }
+
+    //! Key of a translated tree pointing at the element of the static lookup table.
+    //! Keys are never copied as strings; they compare by element, i.e. by pointer.
+    //! Use tap_ptree<Version, Release>::type as the translated tree type.
+    template<int Version, int Release>
+    class tap_key
+    {
+    public:
+        typedef char value_type;
+
+        tap_key()
+            : m_element(0)
+        {
+        }
+
+        explicit tap_key(const tap_element *element)
+            : m_element(element)
+        {
+        }
+
+        //! Element of the lookup table, or 0 for an unknown name
+        const tap_element *element() const
+        {
+            return m_element;
+        }
+
+        //! Symbol ID of the key: the tag of the element
+        std::size_t id() const
+        {
+            return m_element ? m_element->tag : 0;
+        }
+
+        const std::string &name() const
+        {
+            static const std::string empty;
+            return m_element ? m_element->name : empty;
+        }
+
+        bool operator<(const tap_key &rhs) const
+        {
+            return m_element < rhs.m_element;
+        }
+
+        bool operator==(const tap_key &rhs) const
+        {
+            return m_element == rhs.m_element;
+        }
+
+        bool operator!=(const tap_key &rhs) const
+        {
+            return m_element != rhs.m_element;
+        }
+
+    private:
+        const tap_element *m_element;
+    };
+
+    //! Path of a tree keyed by tap_key: a dot separated path of element names,
+    //! each name being resolved to its element once, when the path is reduced.
+    template<int Version, int Release>
+    class tap_key_path
+    {
+    public:
+        typedef tap_key<Version, Release> key_type;
+
+        tap_key_path()
+            : m_start(0)
+        {
+        }
+
+        tap_key_path(const std::string &path)
+            : m_path(path)
+            , m_start(0)
+        {
+        }
+
+        tap_key_path(const char *path)
+            : m_path(path)
+            , m_start(0)
+        {
+        }
+
+        //! Takes the first name off the path and returns its key
+        key_type reduce()
+        {
+            BOOST_ASSERT(!empty());
+            std::string::size_type end = m_path.find('.', m_start);
+            if (end == std::string::npos)
+                end = m_path.size();
+            std::size_t tag = find_tap_tag<Version, Release>(m_path.data() + m_start, end - m_start);
+            m_start = end < m_path.size() ? end + 1 : end;
+            return key_type(find_tap_element<Version, Release>(tag));
+        }
+
+        bool empty() const
+        {
+            return m_start == m_path.size();
+        }
+
+        bool single() const
+        {
+            return m_path.find('.', m_start) == std::string::npos;
+        }
+
+        std::string dump() const
+        {
+            return m_path;
+        }
+
+    private:
+        std::string m_path;
+        std::string::size_type m_start;
+    };
+
+    //! Translated tree type with interned keys
+    template<int Version, int Release>
+    struct tap_ptree
+    {
+        typedef boost::property_tree::basic_ptree<tap_key<Version, Release>, std::string> type;
+    };
+
+    namespace internal
+    {
+        // Key of a translated node: a copy of the name for ptree, the element for tap_ptree
+        template<class Key>
+        struct tap_key_of
+        {
+            static const std::string &get(const tap_element *element)
+            {
+                return element->name;
+            }
+        };
+
+        template<int Version, int Release>
+        struct tap_key_of< tap_key<Version, Release> >
+        {
+            static tap_key<Version, Release> get(const tap_element *element)
+            {
+                return tap_key<Version, Release>(element);
+            }
+        };
+    }
+
+    template<int Version, int Release, class Ptree, class OutPtree>
     void trans_asn1_ptree_internal(
-        boost::property_tree::ptree &pt, 
-        boost::property_tree::ptree &new_pt, 
-        const std::set<tap_element>& tap3_lookup_map)
+        const Ptree &pt, 
+        OutPtree &new_pt)
     {
-        boost::property_tree::ptree::assoc_iterator it = pt.ordered_begin();
+        typename Ptree::const_assoc_iterator it = pt.ordered_begin();
         for (;it!=pt.not_found(); it++)
         {
             std::size_t tag = boost::lexical_cast<std::size_t>(it->first);
-            tap_element tmp = {"", tag, Group};
-            
-            std::set<tap_element>::const_iterator lookup_it = tap3_lookup_map.find(tmp);
-            if (lookup_it != tap3_lookup_map.end())
+            const tap_element *element = find_tap_element<Version, Release>(tag);
+            if (element)
             {
-                boost::property_tree::ptree &new_node = new_pt.push_back(
-                    std::make_pair(lookup_it->name, boost::property_tree::ptree()))->second;
+                OutPtree &new_node = new_pt.push_back(std::make_pair(
+                    internal::tap_key_of<typename OutPtree::key_type>::get(element), OutPtree()))->second;
                 
-                switch(lookup_it->type)
+                // Values are decoded from views of the source data, without intermediate copies
+                const typename Ptree::data_type &data = (it->second).data();
+                switch(element->type)
                 {
                     case Integer:
                     case Integer64:
                     {
-                        long long tmp = boost::property_tree::asn1_parser::binary2Int<0>((it->second).data());
+                        long long tmp = boost::property_tree::asn1_parser::binary2Int<0>(data.data(), data.size());
                         new_node.data() = boost::lexical_cast<std::string>(tmp);
                     }break;
                     case OctString:
                     {
-                        new_node.data() = boost::property_tree::asn1_parser::binary2OCTString<0>((it->second).data());
+                        new_node.data().assign(data.data(), data.size());
                     }break;
                     case BcdString:
                     {
-                        new_node.data() = boost::property_tree::asn1_parser::binary2BCDString<0>((it->second).data());
+                        new_node.data() = boost::property_tree::asn1_parser::binary2BCDString<0>(data.data(), data.size());
                     }break;
                     default:
                         break;
                 }
                 
-                trans_asn1_ptree_internal<0>(it->second, new_node, tap3_lookup_map);
+                trans_asn1_ptree_internal<Version, Release>(it->second, new_node);
             }
             
            
         }
     }
 
-    template<int Version, int Release>
-    void trans_asn1_ptree(boost::property_tree::ptree &pt, boost::property_tree::ptree& new_pt)
+    //! Translates a tree read by read_asn1 (tags as keys) into TAP element names.
+    //! pt may be a boost::property_tree::ptree or an asn1_view_ptree.
+    template<int Version, int Release, class Ptree>
+    void trans_asn1_ptree(const Ptree &pt, boost::property_tree::ptree& new_pt)
     {
-        static const std::set<tap_element> tap3_lookup_map(
-            &(internal::lookup_tables<Version, Release>::tap_elements[0]), 
-            &(internal::lookup_tables<Version, Release>::tap_elements[0]) + sizeof(internal::lookup_tables<Version, Release>::tap_elements)/sizeof(tap_element));
-    
-        
-        trans_asn1_ptree_internal<0>(pt, new_pt, tap3_lookup_map);
+        trans_asn1_ptree_internal<Version, Release>(pt, new_pt);
+    }
+
+    //! Translates a tree read by read_asn1 into a tree keyed by the interned element names.
+    //! No key string is allocated, and key lookups compare element pointers.
+    template<int Version, int Release, class Ptree>
+    void trans_asn1_ptree(const Ptree &pt, typename tap_ptree<Version, Release>::type &new_pt)
+    {
+        trans_asn1_ptree_internal<Version, Release>(pt, new_pt);
     }
     
     namespace internal
@@ -425,4 +739,14 @@ namespace boost { namespace property_tree { namespace detail {namespace tap_pars
 
 }}}}
 
+namespace boost { namespace property_tree {
+
+    template<int Version, int Release>
+    struct path_of< detail::tap_parser::tap_key<Version, Release> >
+    {
+        typedef detail::tap_parser::tap_key_path<Version, Release> type;
+    };
+
+} }
+
 #endif
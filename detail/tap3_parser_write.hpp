@@ -0,0 +1,709 @@
+// ----------------------------------------------------------------------------
+// Copyright (C) 2015-2016 zunceng@gmail.com
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+// For more information, see www.boost.org
+// ----------------------------------------------------------------------------
+#ifndef BOOST_PROPERTY_TREE_TAP3_PARSER_WRITE_HPP_INCLUDED
+#define BOOST_PROPERTY_TREE_TAP3_PARSER_WRITE_HPP_INCLUDED
+
+#include "asn1_parser_error.hpp"
+#include "rapidasn1.hpp"
+#include "tap3_parser_read.hpp"
+#include <bitset>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#ifndef BOOST_PROPERTY_TREE_TAP_OUTPUT_BUFFER_SIZE
+    // Size of the output buffer used by the direct emitters.
+    // Define BOOST_PROPERTY_TREE_TAP_OUTPUT_BUFFER_SIZE before including this file if you want to override the default value.
+    // Output is handed to the stream only when this many bytes have been collected.
+    #define BOOST_PROPERTY_TREE_TAP_OUTPUT_BUFFER_SIZE (1024 * 1024)
+#endif
+
+namespace boost { namespace property_tree { namespace detail {namespace tap_parser{
+
+    //! Output buffer used by the direct emitters.
+    //! Bytes are collected in one large block and handed to the stream in big chunks.
+    //! The buffer can be reused for many files, see attach().
+    class output_buffer
+    {
+    public:
+
+        //! Constructs a buffer writing to stream.
+        explicit output_buffer(std::ostream &stream,
+                               std::size_t capacity = BOOST_PROPERTY_TREE_TAP_OUTPUT_BUFFER_SIZE)
+            : m_stream(&stream)
+            , m_data(capacity < 64 ? 64 : capacity)
+            , m_ptr(0)
+        {
+        }
+
+        //! Flushes pending output.
+        ~output_buffer()
+        {
+            flush();
+        }
+
+        //! Flushes pending output and redirects the buffer to another stream.
+        void attach(std::ostream &stream)
+        {
+            flush();
+            m_stream = &stream;
+        }
+
+        void put(char c)
+        {
+            if (m_ptr == m_data.size())
+                flush();
+            m_data[m_ptr++] = c;
+        }
+
+        void write(const char *data, std::size_t size)
+        {
+            if (size > m_data.size() - m_ptr)
+            {
+                flush();
+                if (size >= m_data.size())
+                {
+                    m_stream->write(data, size);
+                    return;
+                }
+            }
+            std::memcpy(&m_data[m_ptr], data, size);
+            m_ptr += size;
+        }
+
+        void write(const char *data)
+        {
+            write(data, std::strlen(data));
+        }
+
+        //! Returns room for at least size bytes; finish with commit().
+        //! The buffer grows if size exceeds its capacity.
+        char *reserve(std::size_t size)
+        {
+            if (size > m_data.size() - m_ptr)
+            {
+                flush();
+                if (size > m_data.size())
+                    m_data.resize(size);
+            }
+            return &m_data[m_ptr];
+        }
+
+        //! Current capacity of the buffer
+        std::size_t capacity() const
+        {
+            return m_data.size();
+        }
+
+        void commit(std::size_t size)
+        {
+            m_ptr += size;
+        }
+
+        void flush()
+        {
+            if (m_ptr)
+            {
+                m_stream->write(&m_data[0], m_ptr);
+                m_ptr = 0;
+            }
+        }
+
+    private:
+
+        std::ostream *m_stream;
+        std::vector<char> m_data;
+        std::size_t m_ptr;
+    };
+
+    //! \cond internal
+    namespace internal
+    {
+        // Escape tables for the emitters: 0 means the byte is copied as is,
+        // anything else is an index into the replacement table of the format.
+        // It must be a template to allow correct linking (because it has static data members, which are defined in a header file).
+        template<int Dummy>
+        struct escape_tables
+        {
+            static const unsigned char lookup_xml[256];
+            static const unsigned char lookup_json[256];
+            static const char *const replacement_xml[6];
+        };
+
+        template<int Dummy>
+        const unsigned char escape_tables<Dummy>::lookup_xml[256] =
+        {
+          // 0   1   2   3   4   5   6   7   8   9   A   B   C   D   E   F
+             0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  // 0
+             0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  // 1
+             0,  0,  4,  0,  0,  0,  1,  5,  0,  0,  0,  0,  0,  0,  0,  0,  // 2
+             0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  2,  0,  3,  0,  // 3
+             0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  // 4
+             0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  // 5
+             0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  // 6
+             0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  // 7
+             0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  // 8
+             0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  // 9
+             0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  // A
+             0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  // B
+             0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  // C
+             0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  // D
+             0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  // E
+             0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0   // F
+        };
+
+        template<int Dummy>
+        const char *const escape_tables<Dummy>::replacement_xml[6] =
+        {
+            "", "&amp;", "&lt;", "&gt;", "&quot;", "&apos;"
+        };
+
+        // JSON: 1 = "\"", 2 = "\\", 3 = control character, or octet above 0x7F read as Latin-1, written as \u00XX
+        template<int Dummy>
+        const unsigned char escape_tables<Dummy>::lookup_json[256] =
+        {
+          // 0   1   2   3   4   5   6   7   8   9   A   B   C   D   E   F
+             3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  // 0
+             3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  // 1
+             0,  0,  1,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  // 2
+             0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  // 3
+             0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  // 4
+             0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  2,  0,  0,  0,  // 5
+             0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  // 6
+             0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  3,  // 7
+             3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  // 8
+             3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  // 9
+             3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  // A
+             3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  // B
+             3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  // C
+             3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  // D
+             3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  // E
+             3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3   // F
+        };
+
+        template<class Byte>
+        void write_escaped_xml(output_buffer &out, const Byte *data, std::size_t size)
+        {
+            const unsigned char *table = escape_tables<0>::lookup_xml;
+            std::size_t run = 0;
+            for (std::size_t i = 0; i < size; ++i)
+            {
+                unsigned char c = static_cast<unsigned char>(data[i]);
+                if (table[c])
+                {
+                    out.write(reinterpret_cast<const char *>(data) + run, i - run);
+                    out.write(escape_tables<0>::replacement_xml[table[c]]);
+                    run = i + 1;
+                }
+            }
+            out.write(reinterpret_cast<const char *>(data) + run, size - run);
+        }
+
+        template<class Byte>
+        void write_escaped_json(output_buffer &out, const Byte *data, std::size_t size)
+        {
+            static const char hex[] = "0123456789abcdef";
+            const unsigned char *table = escape_tables<0>::lookup_json;
+            std::size_t run = 0;
+            for (std::size_t i = 0; i < size; ++i)
+            {
+                unsigned char c = static_cast<unsigned char>(data[i]);
+                if (table[c])
+                {
+                    out.write(reinterpret_cast<const char *>(data) + run, i - run);
+                    switch (table[c])
+                    {
+                        case 1: out.write("\\\"", 2); break;
+                        case 2: out.write("\\\\", 2); break;
+                        default:
+                        {
+                            char *p = out.reserve(6);
+                            p[0] = '\\'; p[1] = 'u'; p[2] = '0'; p[3] = '0';
+                            p[4] = hex[c >> 4]; p[5] = hex[c & 0x0F];
+                            out.commit(6);
+                        }break;
+                    }
+                    run = i + 1;
+                }
+            }
+            out.write(reinterpret_cast<const char *>(data) + run, size - run);
+        }
+
+        // Writes octets as uppercase hex digits, in chunks within the capacity chosen for the buffer
+        template<class Byte>
+        void write_hex(output_buffer &out, const Byte *data, std::size_t size)
+        {
+            static const char digits[] = "0123456789ABCDEF";
+            while (size)
+            {
+                std::size_t limit = out.capacity() < 4096 ? out.capacity() / 2 : 2048;
+                std::size_t chunk = size < limit ? size : limit;
+                char *p = out.reserve(2 * chunk);
+                for (std::size_t i = 0; i < chunk; ++i)
+                {
+                    p[2 * i] = digits[static_cast<unsigned char>(data[i]) >> 4];
+                    p[2 * i + 1] = digits[static_cast<unsigned char>(data[i]) & 0x0F];
+                }
+                out.commit(2 * chunk);
+                data += chunk;
+                size -= chunk;
+            }
+        }
+
+        // Integers of 1 to 8 octets fit in a number
+        inline bool is_number(std::size_t size)
+        {
+            return size - 1 < 8;
+        }
+
+        // Writes an Integer in decimal, or in hex if it is empty or longer than 8 octets
+        template<class Byte>
+        void write_integer(output_buffer &out, const Byte *data, std::size_t size)
+        {
+            if (!is_number(size))
+            {
+                write_hex(out, data, size);
+                return;
+            }
+            unsigned long long raw = static_cast<unsigned long long>(asn1_parser::binary2Int<0>(data, size));
+
+            // Digits are produced backwards into a scratch buffer
+            char digits[24];
+            char *end = digits + sizeof(digits);
+            char *p = end;
+            bool negative = (raw >> 63) != 0;
+            unsigned long long value = negative ? (~raw + 1) : raw;
+            do
+            {
+                *--p = static_cast<char>('0' + value % 10);
+                value /= 10;
+            } while (value);
+            if (negative)
+                *--p = '-';
+            out.write(p, end - p);
+        }
+
+        template<class Byte>
+        void write_bcd(output_buffer &out, const Byte *data, std::size_t size)
+        {
+            out.commit(asn1_parser::binary2BCDString<0>(data, size, out.reserve(2 * size)));
+        }
+
+        template<int Version, int Release, class Byte>
+        struct xml_emitter
+        {
+            output_buffer &out;
+            bool pretty;
+
+            void indent(std::size_t level)
+            {
+                out.put('\n');
+                for (std::size_t i = 0; i < level; ++i)
+                    out.write("  ", 2);
+            }
+
+            void children(const rapidasn1::asn1_node<Byte> *node, std::size_t level)
+            {
+                for (rapidasn1::asn1_node<Byte> *child = node->first_node(); child; child = child->next_sibling())
+                {
+                    const tap_element *element = find_tap_element<Version, Release>(child->tag());
+                    if (!element)
+                        continue;
+
+                    if (pretty)
+                        indent(level);
+                    out.put('<');
+                    out.write(element->name.data(), element->name.size());
+                    out.put('>');
+                    if (child->type() == rapidasn1::node_group)
+                    {
+                        children(child, level + 1);
+                        if (pretty && child->first_node())
+                            indent(level);
+                    }
+                    else
+                    {
+                        switch (element->type)
+                        {
+                            case Integer:
+                            case Integer64:
+                                write_integer(out, child->value(), child->value_size());
+                                break;
+                            case BcdString:
+                                write_bcd(out, child->value(), child->value_size());
+                                break;
+                            case OctString:
+                                write_escaped_xml(out, child->value(), child->value_size());
+                                break;
+                            default:
+                                break;
+                        }
+                    }
+                    out.write("</", 2);
+                    out.write(element->name.data(), element->name.size());
+                    out.put('>');
+                }
+            }
+        };
+
+        template<int Version, int Release, class Byte>
+        struct json_emitter
+        {
+            output_buffer &out;
+
+            // Groups named "...List" become arrays of single-member objects,
+            // everything else becomes an object.
+            static bool is_list(const tap_element *element)
+            {
+                const std::string &name = element->name;
+                return name.size() >= 4 && name.compare(name.size() - 4, 4, "List") == 0;
+            }
+
+            void member(const rapidasn1::asn1_node<Byte> *node, const tap_element *element)
+            {
+                out.put('"');
+                write_escaped_json(out, element->name.data(), element->name.size());
+                out.write("\":", 2);
+                value(node, element);
+            }
+
+            // Writes the known children of node as an object. Children sharing a tag
+            // become one member whose value is the array of their values, in data order.
+            void object(const rapidasn1::asn1_node<Byte> *node)
+            {
+                std::bitset<1024> pending, repeated;
+                for (rapidasn1::asn1_node<Byte> *child = node->first_node(); child; child = child->next_sibling())
+                {
+                    if (!find_tap_element<Version, Release>(child->tag()))
+                        continue;
+                    if (pending[child->tag()])
+                        repeated.set(child->tag());
+                    pending.set(child->tag());
+                }
+
+                out.put('{');
+                bool first = true;
+                for (rapidasn1::asn1_node<Byte> *child = node->first_node(); child; child = child->next_sibling())
+                {
+                    const tap_element *element = find_tap_element<Version, Release>(child->tag());
+                    if (!element || !pending[child->tag()])
+                        continue;
+                    pending.reset(child->tag());
+                    if (!first)
+                        out.put(',');
+                    first = false;
+                    if (!repeated[child->tag()])
+                    {
+                        member(child, element);
+                        continue;
+                    }
+                    out.put('"');
+                    write_escaped_json(out, element->name.data(), element->name.size());
+                    out.write("\":[", 3);
+                    for (rapidasn1::asn1_node<Byte> *same = child; same; same = same->next_sibling())
+                    {
+                        if (same->tag() != child->tag())
+                            continue;
+                        if (same != child)
+                            out.put(',');
+                        value(same, element);
+                    }
+                    out.put(']');
+                }
+                out.put('}');
+            }
+
+            void value(const rapidasn1::asn1_node<Byte> *node, const tap_element *element)
+            {
+                if (node->type() == rapidasn1::node_group)
+                {
+                    if (!is_list(element))
+                    {
+                        object(node);
+                        return;
+                    }
+                    out.put('[');
+                    bool first = true;
+                    for (rapidasn1::asn1_node<Byte> *child = node->first_node(); child; child = child->next_sibling())
+                    {
+                        const tap_element *child_element = find_tap_element<Version, Release>(child->tag());
+                        if (!child_element)
+                            continue;
+                        if (!first)
+                            out.put(',');
+                        first = false;
+                        out.put('{');
+                        member(child, child_element);
+                        out.put('}');
+                    }
+                    out.put(']');
+                    return;
+                }
+
+                switch (element->type)
+                {
+                    case Integer:
+                    case Integer64:
+                        if (is_number(node->value_size()))
+                            write_integer(out, node->value(), node->value_size());
+                        else
+                        {
+                            out.put('"');
+                            write_hex(out, node->value(), node->value_size());
+                            out.put('"');
+                        }
+                        break;
+                    case BcdString:
+                        out.put('"');
+                        write_bcd(out, node->value(), node->value_size());
+                        out.put('"');
+                        break;
+                    case OctString:
+                        out.put('"');
+                        write_escaped_json(out, node->value(), node->value_size());
+                        out.put('"');
+                        break;
+                    default:
+                        out.write("null", 4);
+                        break;
+                }
+            }
+        };
+
+        template<int Version, int Release, class Byte>
+        struct dump_writer
+        {
+            output_buffer &out;
+
+            // Column of the first value character, as in the README layout
+            static const std::size_t value_column = 54;
+
+            void name(const rapidasn1::asn1_node<Byte> *node, const tap_element *element,
+                      std::size_t level, std::size_t index)
+            {
+                std::size_t width = 2 * level;
+                char *p = out.reserve(width);
+                std::memset(p, ' ', width);
+                out.commit(width);
+
+                char scratch[32];
+                if (element)
+                {
+                    std::size_t length = element->name.size();
+                    while (length && element->name[length - 1] == ' ')
+                        --length;
+                    out.write(element->name.data(), length);
+                    width += length;
+                }
+                else
+                {
+                    std::size_t length = std::sprintf(scratch, "Tag[%lu]", static_cast<unsigned long>(node->tag()));
+                    out.write(scratch, length);
+                    width += length;
+                }
+                if (index)
+                {
+                    std::size_t length = std::sprintf(scratch, "(%lu)", static_cast<unsigned long>(index));
+                    out.write(scratch, length);
+                    width += length;
+                }
+
+                if (node->type() != rapidasn1::node_group)
+                {
+                    std::size_t dots = width + 5 < value_column ? value_column - width - 2 : 3;
+                    p = out.reserve(dots + 2);
+                    p[0] = ' ';
+                    std::memset(p + 1, '.', dots);
+                    p[dots + 1] = ' ';
+                    out.commit(dots + 2);
+                }
+            }
+
+            void printable(const Byte *data, std::size_t size)
+            {
+                while (size)
+                {
+                    // Chunks stay within the capacity chosen for the buffer
+                    std::size_t limit = out.capacity() < 4096 ? out.capacity() : 4096;
+                    std::size_t chunk = size < limit ? size : limit;
+                    char *p = out.reserve(chunk);
+                    for (std::size_t i = 0; i < chunk; ++i)
+                    {
+                        unsigned char c = static_cast<unsigned char>(data[i]);
+                        p[i] = (c >= 0x20 && c < 0x7F) ? static_cast<char>(c) : '.';
+                    }
+                    out.commit(chunk);
+                    data += chunk;
+                    size -= chunk;
+                }
+            }
+
+            void hex(const Byte *data, std::size_t size)
+            {
+                std::size_t shown = size > 32 ? 32 : size;
+                write_hex(out, data, shown);
+                if (shown < size)
+                    out.write("...", 3);
+            }
+
+            void node(const rapidasn1::asn1_node<Byte> *node, std::size_t level, std::size_t index)
+            {
+                const tap_element *element = find_tap_element<Version, Release>(node->tag());
+                name(node, element, level, index);
+
+                if (node->type() == rapidasn1::node_group)
+                {
+                    out.put('\n');
+                    children(node, element, level + 1);
+                    return;
+                }
+
+                switch (element ? element->type : Group)
+                {
+                    case Integer:
+                    case Integer64:
+                        write_integer(out, node->value(), node->value_size());
+                        break;
+                    case BcdString:
+                        write_bcd(out, node->value(), node->value_size());
+                        break;
+                    case OctString:
+                        printable(node->value(), node->value_size());
+                        break;
+                    default:
+                        hex(node->value(), node->value_size());
+                        break;
+                }
+                out.put('\n');
+            }
+
+            // Children of "...List" groups are numbered from 1
+            void children(const rapidasn1::asn1_node<Byte> *parent, const tap_element *element, std::size_t level)
+            {
+                bool list = element && element->name.size() >= 4 &&
+                            element->name.compare(element->name.size() - 4, 4, "List") == 0;
+                std::size_t index = 0;
+                for (rapidasn1::asn1_node<Byte> *child = parent->first_node(); child; child = child->next_sibling())
+                    node(child, level, list ? ++index : 0);
+            }
+        };
+    }
+    //! \endcond
+
+    //! Writes the children of node (usually a whole asn1_tree) as XML,
+    //! translating tags through the Version/Release lookup table.
+    //! Produces the elements and values of trans_asn1_ptree followed by write_xml,
+    //! without building either property tree. Unknown tags are skipped with their subtrees,
+    //! and Integers that do not fit in 8 octets are written in hex.
+    //! Elements are written in the order of the data, whereas trans_asn1_ptree lists
+    //! the children of each group sorted by their tag as a string.
+    //! \param out Output buffer; can be reused between files.
+    //! \param node Node whose children are written.
+    //! \param pretty Put every element on its own indented line.
+    template<int Version, int Release, class Byte>
+    void write_tap_xml(output_buffer &out, const rapidasn1::asn1_node<Byte> &node, bool pretty = false)
+    {
+        out.write("<?xml version=\"1.0\" encoding=\"utf-8\"?>");
+        if (!pretty)
+            out.put('\n');
+        internal::xml_emitter<Version, Release, Byte> emitter = {out, pretty};
+        emitter.children(&node, 0);
+        out.put('\n');
+        out.flush();
+    }
+
+    template<int Version, int Release, class Byte>
+    void write_tap_xml(std::ostream &stream, const rapidasn1::asn1_node<Byte> &node, bool pretty = false)
+    {
+        output_buffer out(stream);
+        write_tap_xml<Version, Release>(out, node, pretty);
+    }
+
+    template<int Version, int Release, class Byte>
+    void write_tap_xml(const std::string &filename, const rapidasn1::asn1_node<Byte> &node, bool pretty = false)
+    {
+        std::ofstream stream(filename.c_str(), std::ios::out | std::ios::binary);
+        if (!stream)
+            BOOST_PROPERTY_TREE_THROW(asn1_parser::asn1_parser_error(
+                "cannot open file", filename, 0));
+        write_tap_xml<Version, Release>(stream, node, pretty);
+        if (!stream.good())
+            BOOST_PROPERTY_TREE_THROW(asn1_parser::asn1_parser_error("write error", filename, 0));
+    }
+
+    //! Writes the children of node (usually a whole asn1_tree) as one JSON object,
+    //! translating tags through the Version/Release lookup table.
+    //! Integers are written as numbers, BCD and octet strings as strings,
+    //! and groups whose name ends with "List" as arrays. Children of other groups that share
+    //! a name are written as one member holding an array. Octets above 0x7F are read as Latin-1
+    //! and escaped as \u0080 to \u00FF, and Integers that do not fit in 8 octets are written as
+    //! hex strings. Unknown tags are skipped with their subtrees.
+    //! \param out Output buffer; can be reused between files.
+    //! \param node Node whose children are written.
+    template<int Version, int Release, class Byte>
+    void write_tap_json(output_buffer &out, const rapidasn1::asn1_node<Byte> &node)
+    {
+        internal::json_emitter<Version, Release, Byte> emitter = {out};
+        emitter.object(&node);
+        out.put('\n');
+        out.flush();
+    }
+
+    template<int Version, int Release, class Byte>
+    void write_tap_json(std::ostream &stream, const rapidasn1::asn1_node<Byte> &node)
+    {
+        output_buffer out(stream);
+        write_tap_json<Version, Release>(out, node);
+    }
+
+    template<int Version, int Release, class Byte>
+    void write_tap_json(const std::string &filename, const rapidasn1::asn1_node<Byte> &node)
+    {
+        std::ofstream stream(filename.c_str(), std::ios::out | std::ios::binary);
+        if (!stream)
+            BOOST_PROPERTY_TREE_THROW(asn1_parser::asn1_parser_error(
+                "cannot open file", filename, 0));
+        write_tap_json<Version, Release>(stream, node);
+        if (!stream.good())
+            BOOST_PROPERTY_TREE_THROW(asn1_parser::asn1_parser_error("write error", filename, 0));
+    }
+
+    //! Writes node and its subtree in the indented "Name ...... value" debugging layout.
+    //! Values are typed through the Version/Release lookup table; unknown tags are shown as
+    //! Tag[n] with a hex value, and Integers that do not fit in 8 octets in hex.
+    //! Passing an asn1_tree dumps all top level nodes.
+    //! Use find_tap_node() to select a subtree.
+    //! \param out Output buffer; can be reused between dumps.
+    //! \param node Node to dump.
+    //! \param level Indentation level of node.
+    template<int Version, int Release, class Byte>
+    void write_tap_dump(output_buffer &out, const rapidasn1::asn1_node<Byte> &node, std::size_t level = 0)
+    {
+        internal::dump_writer<Version, Release, Byte> writer = {out};
+        if (node.parent())
+            writer.node(&node, level, 0);
+        else
+            writer.children(&node, 0, level);
+        out.flush();
+    }
+
+    template<int Version, int Release, class Byte>
+    void write_tap_dump(std::ostream &stream, const rapidasn1::asn1_node<Byte> &node, std::size_t level = 0)
+    {
+        output_buffer out(stream);
+        write_tap_dump<Version, Release>(out, node, level);
+    }
+
+}}}}
+
+#endif
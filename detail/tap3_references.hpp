@@ -0,0 +1,376 @@
+// ----------------------------------------------------------------------------
+// Copyright (C) 2015-2016 zunceng@gmail.com
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+// For more information, see www.boost.org
+// ----------------------------------------------------------------------------
+#ifndef BOOST_PROPERTY_TREE_TAP3_REFERENCES_HPP_INCLUDED
+#define BOOST_PROPERTY_TREE_TAP3_REFERENCES_HPP_INCLUDED
+
+//! \file tap3_references.hpp Reference codes of a batch, resolved through flat arrays.
+//! Call events give codes (ExchangeRateCode, TaxCode, RecEntityCode, UtcTimeOffsetCode,
+//! MessageDescriptionCode) for values listed once in AccountingInfo, NetworkInfo and
+//! MessageDescriptionInfoList, which all precede CallEventDetailList.
+
+#include "asn1_parser_read.hpp"
+#include "rapidasn1.hpp"
+#include "tap3_parser_read.hpp"
+#include "tap3_time.hpp"
+#include <boost/cstdint.hpp>
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifndef BOOST_PROPERTY_TREE_TAP_MAX_CODE
+    // Largest reference code kept in the code-indexed tables of a batch; larger codes are ignored.
+    // Define BOOST_PROPERTY_TREE_TAP_MAX_CODE before including asn1_parser.hpp if you want to override the default value.
+    #define BOOST_PROPERTY_TREE_TAP_MAX_CODE 65535
+#endif
+
+namespace boost { namespace property_tree { namespace detail {namespace tap_parser{
+
+    //! Values of a batch by reference code. Codes index an array directly;
+    //! senders allocate them from 0, so the arrays stay as small as the lists.
+    template<class T>
+    class tap_code_table
+    {
+    public:
+
+        void clear()
+        {
+            m_values.clear();
+            m_present.clear();
+        }
+
+        //! Records the value of a code; codes above BOOST_PROPERTY_TREE_TAP_MAX_CODE are ignored.
+        void set(boost::int64_t code, const T &value)
+        {
+            if (code < 0 || code > BOOST_PROPERTY_TREE_TAP_MAX_CODE)
+                return;
+            std::size_t index = static_cast<std::size_t>(code);
+            if (index >= m_values.size())
+            {
+                m_values.resize(index + 1, T());
+                m_present.resize(index + 1, false);
+            }
+            m_values[index] = value;
+            m_present[index] = true;
+        }
+
+        //! Finds the value of a code.
+        //! \return Pointer to the value, or 0 if the code is not listed.
+        const T *find(boost::int64_t code) const
+        {
+            if (code < 0 || static_cast<boost::uint64_t>(code) >= m_values.size() || !m_present[static_cast<std::size_t>(code)])
+                return 0;
+            return &m_values[static_cast<std::size_t>(code)];
+        }
+
+    private:
+
+        std::vector<T> m_values;
+        std::vector<bool> m_present;
+    };
+
+    //! CurrencyConversion of AccountingInfo; the rate is exchange_rate / 10^decimal_places
+    struct tap_exchange_rate
+    {
+        boost::int64_t exchange_rate;
+        boost::int32_t decimal_places;
+    };
+
+    //! Taxation of AccountingInfo, as null terminated text
+    struct tap_taxation
+    {
+        char tax_type[3];
+        char tax_rate[8];
+        char charge_type[4];
+    };
+
+    //! RecEntityInformation of NetworkInfo
+    struct tap_rec_entity
+    {
+        boost::int32_t type;
+        char id[46];
+    };
+
+    //! UTC offsets, in seconds east of UTC
+    typedef tap_code_table<boost::int32_t> tap_utc_offsets;
+
+    //! Code-indexed tables of the reference lists of a batch
+    struct tap_references
+    {
+        tap_code_table<tap_exchange_rate> exchange_rates;   //!< By ExchangeRateCode, from CurrencyConversionList
+        tap_code_table<tap_taxation> taxations;             //!< By TaxCode, from TaxationList
+        tap_code_table<tap_rec_entity> rec_entities;        //!< By RecEntityCode, from RecEntityInfoList
+        tap_utc_offsets utc_offsets;                        //!< By UtcTimeOffsetCode, from UtcTimeOffsetInfoList
+        tap_code_table<std::string> message_descriptions;   //!< By MessageDescriptionCode, from MessageDescriptionInfoList
+
+        void clear()
+        {
+            exchange_rates.clear();
+            taxations.clear();
+            rec_entities.clear();
+            utc_offsets.clear();
+            message_descriptions.clear();
+        }
+    };
+
+    namespace internal
+    {
+        // Copies value as null terminated text, truncated to capacity
+        inline void copy_text(char *out, std::size_t capacity, const unsigned char *value, std::size_t size)
+        {
+            std::size_t n = size < capacity ? size : capacity - 1;
+            std::memcpy(out, value, n);
+            out[n] = 0;
+        }
+
+        // What an element stands for in the reference lists
+        enum reference_role
+        {
+            role_none,
+            role_section,                   // AccountingInfo, NetworkInfo, MessageDescriptionInfoList
+            role_list,                      // CurrencyConversionList, TaxationList, RecEntityInfoList, UtcTimeOffsetInfoList
+            role_exchange_rate_entry,       // CurrencyConversion
+            role_taxation_entry,            // Taxation
+            role_rec_entity_entry,          // RecEntityInformation
+            role_utc_offset_entry,          // UtcTimeOffsetInfo
+            role_description_entry,         // MessageDescriptionInformation
+            role_code,                      // ExchangeRateCode, TaxCode, RecEntityCode, UtcTimeOffsetCode, MessageDescriptionCode
+            role_exchange_rate,
+            role_decimal_places,
+            role_tax_type,
+            role_tax_rate,
+            role_charge_type,
+            role_rec_entity_type,
+            role_rec_entity_id,
+            role_utc_offset,
+            role_message_description
+        };
+
+        // Tag -> reference_role table, resolved once per Version/Release from the element names.
+        template <int Version, int Release>
+        struct reference_roles
+        {
+            unsigned char roles[1024];
+
+            reference_roles()
+            {
+                std::fill(roles, roles + 1024, static_cast<unsigned char>(role_none));
+                set("AccountingInfo", role_section);
+                set("NetworkInfo", role_section);
+                set("MessageDescriptionInfoList", role_section);
+                set("CurrencyConversionList", role_list);
+                set("TaxationList", role_list);
+                set("RecEntityInfoList", role_list);
+                set("UtcTimeOffsetInfoList", role_list);
+                set("CurrencyConversion", role_exchange_rate_entry);
+                set("Taxation", role_taxation_entry);
+                set("RecEntityInformation", role_rec_entity_entry);
+                set("UtcTimeOffsetInfo", role_utc_offset_entry);
+                set("MessageDescriptionInformation", role_description_entry);
+                set("ExchangeRateCode", role_code);
+                set("TaxCode", role_code);
+                set("RecEntityCode", role_code);
+                set("UtcTimeOffsetCode", role_code);
+                set("MessageDescriptionCode", role_code);
+                set("ExchangeRate", role_exchange_rate);
+                set("NumberOfDecimalPlaces", role_decimal_places);
+                set("TaxType", role_tax_type);
+                set("TaxRate", role_tax_rate);
+                set("ChargeType", role_charge_type);
+                set("RecEntityType", role_rec_entity_type);
+                set("RecEntityId", role_rec_entity_id);
+                set("UtcTimeOffset", role_utc_offset);
+                set("MessageDescription", role_message_description);
+            }
+
+            reference_role operator[](std::size_t tag) const
+            {
+                return tag < 1024 ? static_cast<reference_role>(roles[tag]) : role_none;
+            }
+
+            static const reference_roles &instance()
+            {
+                static const reference_roles roles;
+                return roles;
+            }
+
+        private:
+
+            void set(const char *name, reference_role role)
+            {
+                std::size_t tag = find_tap_tag<Version, Release>(name);
+                if (tag && tag < 1024)
+                    roles[tag] = static_cast<unsigned char>(role);
+            }
+        };
+
+        // Walk handler filling tap_references from the header sections of a batch.
+        // Only the reference lists are entered; CallEventDetailList is skipped by its length.
+        template<int Version, int Release>
+        class reference_builder
+        {
+        public:
+
+            explicit reference_builder(tap_references &references)
+                : m_references(references)
+                , m_roles(reference_roles<Version, Release>::instance())
+                , m_entry(0)
+            {
+            }
+
+            bool begin_group(std::size_t tag, std::size_t, std::size_t depth)
+            {
+                reference_role role = m_roles[tag];
+                switch (role)
+                {
+                    case role_section:
+                        return depth == 1;
+                    case role_list:
+                        return depth == 2;
+                    case role_description_entry:
+                    case role_exchange_rate_entry:
+                    case role_taxation_entry:
+                    case role_rec_entity_entry:
+                    case role_utc_offset_entry:
+                        // MessageDescriptionInformation is a direct child of its section
+                        if (depth != (role == role_description_entry ? 2u : 3u))
+                            return false;
+                        m_entry = tag;
+                        m_has_code = m_has_value = false;
+                        std::memset(&m_rate, 0, sizeof(m_rate));
+                        std::memset(&m_taxation, 0, sizeof(m_taxation));
+                        std::memset(&m_rec_entity, 0, sizeof(m_rec_entity));
+                        m_description.clear();
+                        return true;
+                    default:
+                        return depth == 0;
+                }
+            }
+
+            void end_group(std::size_t tag, std::size_t, std::size_t)
+            {
+                if (!m_entry || tag != m_entry)
+                    return;
+                m_entry = 0;
+                if (!m_has_code)
+                    return;
+                switch (m_roles[tag])
+                {
+                    case role_exchange_rate_entry:
+                        m_references.exchange_rates.set(m_code, m_rate);
+                        break;
+                    case role_taxation_entry:
+                        m_references.taxations.set(m_code, m_taxation);
+                        break;
+                    case role_rec_entity_entry:
+                        m_references.rec_entities.set(m_code, m_rec_entity);
+                        break;
+                    case role_utc_offset_entry:
+                        if (m_has_value)
+                            m_references.utc_offsets.set(m_code, m_offset);
+                        break;
+                    case role_description_entry:
+                        m_references.message_descriptions.set(m_code, m_description);
+                        break;
+                    default:
+                        break;
+                }
+            }
+
+            template<class Byte>
+            void value(std::size_t tag, const Byte *value, std::size_t size, std::size_t)
+            {
+                if (!m_entry)
+                    return;
+                const unsigned char *octets = reinterpret_cast<const unsigned char *>(value);
+                switch (m_roles[tag])
+                {
+                    case role_code:
+                        m_has_code = integer(octets, size, m_code);
+                        break;
+                    case role_exchange_rate:
+                        integer(octets, size, m_rate.exchange_rate);
+                        break;
+                    case role_decimal_places:
+                    {
+                        boost::int64_t places = 0;
+                        integer(octets, size, places);
+                        m_rate.decimal_places = static_cast<boost::int32_t>(places);
+                        break;
+                    }
+                    case role_tax_type:
+                        copy_text(m_taxation.tax_type, sizeof(m_taxation.tax_type), octets, size);
+                        break;
+                    case role_tax_rate:
+                        copy_text(m_taxation.tax_rate, sizeof(m_taxation.tax_rate), octets, size);
+                        break;
+                    case role_charge_type:
+                        copy_text(m_taxation.charge_type, sizeof(m_taxation.charge_type), octets, size);
+                        break;
+                    case role_rec_entity_type:
+                    {
+                        boost::int64_t type = 0;
+                        integer(octets, size, type);
+                        m_rec_entity.type = static_cast<boost::int32_t>(type);
+                        break;
+                    }
+                    case role_rec_entity_id:
+                        copy_text(m_rec_entity.id, sizeof(m_rec_entity.id), octets, size);
+                        break;
+                    case role_utc_offset:
+                        m_has_value = utc_offset_seconds(octets, size, m_offset);
+                        break;
+                    case role_message_description:
+                        m_description.assign(reinterpret_cast<const char *>(octets), size);
+                        break;
+                    default:
+                        break;
+                }
+            }
+
+        private:
+
+            static bool integer(const unsigned char *value, std::size_t size, boost::int64_t &number)
+            {
+                if (!size || size > 8)
+                    return false;
+                number = asn1_parser::binary2Int<rapidasn1::parse_non_validating>(value, size);
+                return true;
+            }
+
+            tap_references &m_references;
+            const reference_roles<Version, Release> &m_roles;
+            std::size_t m_entry;                // Tag of the list entry being read, or 0
+            boost::int64_t m_code;
+            bool m_has_code;
+            bool m_has_value;
+            tap_exchange_rate m_rate;
+            tap_taxation m_taxation;
+            tap_rec_entity m_rec_entity;
+            boost::int32_t m_offset;
+            std::string m_description;
+        };
+    }
+
+    //! Builds the code-indexed tables of a batch from its header sections,
+    //! jumping over CallEventDetailList by its length.
+    //! \return true on success; false with result set if the batch is malformed.
+    template<int Version, int Release, class Byte>
+    bool build_tap_references(const Byte *data, std::size_t size, tap_references &references,
+                              rapidasn1::parse_result &result)
+    {
+        references.clear();
+        internal::reference_builder<Version, Release> builder(references);
+        return rapidasn1::walk<rapidasn1::parse_default>(data, size, builder, result);
+    }
+
+}}}}
+
+#endif
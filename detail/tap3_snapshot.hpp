@@ -0,0 +1,403 @@
+// ----------------------------------------------------------------------------
+// Copyright (C) 2015-2016 zunceng@gmail.com
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+// For more information, see www.boost.org
+// ----------------------------------------------------------------------------
+#ifndef BOOST_PROPERTY_TREE_TAP3_SNAPSHOT_HPP_INCLUDED
+#define BOOST_PROPERTY_TREE_TAP3_SNAPSHOT_HPP_INCLUDED
+
+//! \file tap3_snapshot.hpp Translated TAP trees saved as flat binary images.
+//! An image is a header, the nodes in document order, then their values. Nodes refer to
+//! each other and to their values by offsets from themselves, so an image is used in place
+//! wherever it is mapped: loading it is one mmap, with no parsing and no allocation.
+
+#include "asn1_parser_error.hpp"
+#include "tap3_parser_read.hpp"
+#include "tap3_tree.hpp"
+#include <boost/cstdint.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace boost { namespace property_tree { namespace detail {namespace tap_parser{
+
+    //! Header of a snapshot image, followed by count nodes and their values
+    struct tap_snapshot_header
+    {
+        char magic[8];              //!< "TAPSNP1"
+        boost::uint32_t version;    //!< Version of the translated tree
+        boost::uint32_t release;    //!< Release of the translated tree
+        boost::uint64_t count;      //!< Number of nodes, the document node included
+        boost::uint64_t size;       //!< Size of the image
+    };
+
+    //! Node of a snapshot image as stored. Links are offsets in nodes from this node,
+    //! 0 for none; the value is at an offset in bytes from this node and is null-terminated.
+    struct tap_snapshot_record
+    {
+        boost::uint32_t tag;            //!< Tag of the element, 0 for the document node
+        boost::uint32_t type;           //!< tap_type of the element
+        boost::int32_t parent;
+        boost::int32_t first_node;
+        boost::int32_t last_node;
+        boost::int32_t next_sibling;
+        boost::uint64_t value;
+        boost::uint64_t value_size;
+        boost::int64_t integer;         //!< Value of an Integer or Integer64, 0 otherwise
+    };
+
+    //! Node of a snapshot image, navigated like tap_node.
+    //! Nodes are only ever used in place, through pointers into an image.
+    template<int Version, int Release>
+    class tap_snapshot_node : private tap_snapshot_record
+    {
+    public:
+
+        //! Element of the lookup table, or 0 for the document node
+        const tap_element *element() const
+        {
+            return tap_snapshot_record::tag ? find_tap_element<Version, Release>(tap_snapshot_record::tag) : 0;
+        }
+
+        //! Element name, as in the lookup table
+        const std::string &name() const
+        {
+            static const std::string empty;
+            const tap_element *e = element();
+            return e ? e->name : empty;
+        }
+
+        std::size_t tag() const
+        {
+            return tap_snapshot_record::tag;
+        }
+
+        tap_type type() const
+        {
+            return static_cast<tap_type>(tap_snapshot_record::type);
+        }
+
+        //! Decoded value, null-terminated
+        const char *value() const
+        {
+            return reinterpret_cast<const char *>(this) + tap_snapshot_record::value;
+        }
+
+        std::size_t value_size() const
+        {
+            return static_cast<std::size_t>(tap_snapshot_record::value_size);
+        }
+
+        //! Decoded value as a string, like ptree::data()
+        std::string data() const
+        {
+            return std::string(value(), value_size());
+        }
+
+        //! Value of an Integer or Integer64 node, without converting its text
+        boost::int64_t integer() const
+        {
+            return tap_snapshot_record::integer;
+        }
+
+        const tap_snapshot_node *parent() const
+        {
+            return link(tap_snapshot_record::parent);
+        }
+
+        //! Gets first child node, optionally matching its name.
+        //! Trailing blanks of the table names are ignored.
+        const tap_snapshot_node *first_node(const char *name = 0) const
+        {
+            const tap_snapshot_node *child = link(tap_snapshot_record::first_node);
+            if (name)
+            {
+                std::size_t size = std::strlen(name);
+                while (child && !child->is(name, size))
+                    child = child->link(child->tap_snapshot_record::next_sibling);
+            }
+            return child;
+        }
+
+        const tap_snapshot_node *last_node() const
+        {
+            return link(tap_snapshot_record::last_node);
+        }
+
+        //! Gets next sibling node, optionally matching its name.
+        const tap_snapshot_node *next_sibling(const char *name = 0) const
+        {
+            const tap_snapshot_node *sibling = link(tap_snapshot_record::next_sibling);
+            if (name)
+            {
+                std::size_t size = std::strlen(name);
+                while (sibling && !sibling->is(name, size))
+                    sibling = sibling->link(sibling->tap_snapshot_record::next_sibling);
+            }
+            return sibling;
+        }
+
+        //! Finds a node by a dot separated path of element names, like tap_node::find_node().
+        //! \return Pointer to found node, or 0 if not found.
+        const tap_snapshot_node *find_node(const std::string &path) const
+        {
+            const tap_snapshot_node *current = this;
+            std::string::size_type begin = 0;
+            while (current && begin < path.size())
+            {
+                std::string::size_type end = path.find('.', begin);
+                if (end == std::string::npos)
+                    end = path.size();
+                std::string::size_type name_end = end;
+                std::size_t index = 1;
+                std::string::size_type open = path.find('(', begin);
+                if (open < end && path[end - 1] == ')')
+                {
+                    index = std::strtoul(path.c_str() + open + 1, 0, 10);
+                    name_end = open;
+                }
+                const tap_snapshot_node *child = current->link(current->tap_snapshot_record::first_node);
+                while (child && (!child->is(path.data() + begin, name_end - begin) || --index))
+                    child = child->link(child->tap_snapshot_record::next_sibling);
+                current = index ? 0 : child;
+                begin = end + 1;
+            }
+            return current;
+        }
+
+        //! Gets the value at path, like ptree::get<std::string>(path, default_value)
+        std::string get(const std::string &path, const std::string &default_value = std::string()) const
+        {
+            const tap_snapshot_node *node = find_node(path);
+            return node ? node->data() : default_value;
+        }
+
+    private:
+
+        const tap_snapshot_node *link(boost::int32_t offset) const
+        {
+            return offset ? this + offset : 0;
+        }
+
+        bool is(const char *name, std::size_t size) const
+        {
+            const tap_element *e = element();
+            if (!e)
+                return false;
+            const std::string &candidate = e->name;
+            std::size_t length = candidate.size();
+            while (length && candidate[length - 1] == ' ')
+                --length;
+            return length == size && candidate.compare(0, length, name, size) == 0;
+        }
+    };
+
+    namespace internal
+    {
+        // Numbers the nodes of a tree in document order and sizes their values
+        inline void count_snapshot_nodes(const tap_node &node, boost::uint64_t &count, boost::uint64_t &values)
+        {
+            ++count;
+            values += node.value_size() + 1;
+            for (const tap_node *child = node.first_node(); child; child = child->next_sibling())
+                count_snapshot_nodes(*child, count, values);
+        }
+
+        // Writes node at index and its descendants after it; returns the index past them
+        inline std::size_t write_snapshot_node(const tap_node &node, std::size_t index, std::size_t parent,
+                                               tap_snapshot_record *records, char *values, std::size_t &value_pos)
+        {
+            tap_snapshot_record &record = records[index];
+            const tap_element *element = node.element();
+            record.tag = static_cast<boost::uint32_t>(node.tag());
+            record.type = element ? static_cast<boost::uint32_t>(element->type) : static_cast<boost::uint32_t>(Group);
+            record.parent = index ? static_cast<boost::int32_t>(parent) - static_cast<boost::int32_t>(index) : 0;
+            record.first_node = record.last_node = record.next_sibling = 0;
+            record.value = static_cast<boost::uint64_t>((values + value_pos) - reinterpret_cast<char *>(&record));
+            record.value_size = node.value_size();
+            record.integer = node.integer();
+            std::memcpy(values + value_pos, node.value(), node.value_size());
+            values[value_pos + node.value_size()] = 0;
+            value_pos += node.value_size() + 1;
+
+            std::size_t next = index + 1, previous = 0;
+            for (const tap_node *child = node.first_node(); child; child = child->next_sibling())
+            {
+                if (previous)
+                    records[previous].next_sibling = static_cast<boost::int32_t>(next - previous);
+                else
+                    record.first_node = static_cast<boost::int32_t>(next - index);
+                record.last_node = static_cast<boost::int32_t>(next - index);
+                previous = next;
+                next = write_snapshot_node(*child, next, index, records, values, value_pos);
+            }
+            return next;
+        }
+    }
+
+    //! Builds the snapshot image of a translated tree, such as a tap_tree filled by trans_asn1_tree().
+    template<int Version, int Release>
+    void build_tap_snapshot(const tap_node &tree, std::vector<char> &image)
+    {
+        boost::uint64_t count = 0, values = 0;
+        internal::count_snapshot_nodes(tree, count, values);
+        if (count > 0x7FFFFFFF)
+            BOOST_PROPERTY_TREE_THROW(asn1_parser::asn1_parser_error(
+                "too many nodes for a tap snapshot", "", 0));
+        std::size_t records = sizeof(tap_snapshot_header) + static_cast<std::size_t>(count) * sizeof(tap_snapshot_record);
+        image.assign(records + static_cast<std::size_t>(values), 0);
+
+        tap_snapshot_header &header = *reinterpret_cast<tap_snapshot_header *>(&image[0]);
+        std::memcpy(header.magic, "TAPSNP1", 8);
+        header.version = Version;
+        header.release = Release;
+        header.count = count;
+        header.size = image.size();
+
+        std::size_t value_pos = 0;
+        internal::write_snapshot_node(tree, 0, 0, reinterpret_cast<tap_snapshot_record *>(&image[sizeof(tap_snapshot_header)]),
+                                      &image[records], value_pos);
+    }
+
+    //! Writes the snapshot image of a translated tree to a file; throws asn1_parser_error on failure.
+    template<int Version, int Release>
+    void write_tap_snapshot(const std::string &filename, const tap_node &tree)
+    {
+        std::vector<char> image;
+        build_tap_snapshot<Version, Release>(tree, image);
+        std::ofstream stream(filename.c_str(), std::ios::out | std::ios::binary);
+        if (!stream)
+            BOOST_PROPERTY_TREE_THROW(asn1_parser::asn1_parser_error(
+                "cannot open file", filename, 0));
+        stream.write(&image[0], image.size());
+        if (!stream.flush())
+            BOOST_PROPERTY_TREE_THROW(asn1_parser::asn1_parser_error("write error", filename, 0));
+    }
+
+    //! Snapshot image, mapped from a file or over memory.
+    //! Only the header is checked when opening; call validate() on images from untrusted sources.
+    //! <br><code>
+    //! <br>tap_snapshot<3, 11> snapshot("batch.snap");
+    //! <br>std::string sender = snapshot.get("TransferBatch.BatchControlInfo.Sender");
+    //! </code><br>
+    template<int Version, int Release>
+    class tap_snapshot
+    {
+    public:
+
+        typedef tap_snapshot_node<Version, Release> node_type;
+
+        //! Maps a snapshot file; throws asn1_parser_error if it is not one.
+        explicit tap_snapshot(const std::string &filename)
+        {
+            try
+            {
+                boost::interprocess::file_mapping mapping(filename.c_str(), boost::interprocess::read_only);
+                m_file.swap(mapping);
+                boost::interprocess::mapped_region region(m_file, boost::interprocess::read_only);
+                m_region.swap(region);
+            }
+            catch (boost::interprocess::interprocess_exception &)
+            {
+                BOOST_PROPERTY_TREE_THROW(asn1_parser::asn1_parser_error(
+                    "cannot open file", filename, 0));
+            }
+            open(m_region.get_address(), m_region.get_size(), filename);
+        }
+
+        //! Uses an image already in memory, aligned on 8 bytes, which must outlive the snapshot
+        tap_snapshot(const void *image, std::size_t size)
+        {
+            open(image, size, "");
+        }
+
+        //! Document node; its only child is TransferBatch
+        const node_type *root() const
+        {
+            return m_root;
+        }
+
+        //! Number of nodes, the document node included
+        std::size_t size() const
+        {
+            return m_count;
+        }
+
+        const node_type *find_node(const std::string &path) const
+        {
+            return m_root->find_node(path);
+        }
+
+        std::string get(const std::string &path, const std::string &default_value = std::string()) const
+        {
+            return m_root->get(path, default_value);
+        }
+
+        //! Checks that every link and value of the image stays within it, that links follow
+        //! document order, so that no walk through them can loop, and that types are known.
+        //! \return false if the image is corrupt.
+        bool validate() const
+        {
+            const tap_snapshot_record *records = reinterpret_cast<const tap_snapshot_record *>(m_root);
+            const char *end = m_image + m_size;
+            for (std::size_t i = 0; i < m_count; ++i)
+            {
+                const tap_snapshot_record &record = records[i];
+                const boost::int32_t links[4] = {record.parent, record.first_node, record.last_node, record.next_sibling};
+                for (int k = 0; k < 4; ++k)
+                    if (links[k] < -static_cast<boost::int64_t>(i) || links[k] >= static_cast<boost::int64_t>(m_count - i))
+                        return false;
+                // Parents precede their nodes, children and siblings follow them; the document node has neither
+                if (record.first_node < 0 || record.last_node < 0 || record.next_sibling < 0 ||
+                    (i ? record.parent >= 0 : record.parent != 0 || record.next_sibling != 0) ||
+                    record.first_node > record.last_node || (record.first_node == 0) != (record.last_node == 0) ||
+                    (record.first_node && (records[i + record.first_node].parent != -record.first_node ||
+                                           records[i + record.last_node].parent != -record.last_node)) ||
+                    record.type > static_cast<boost::uint32_t>(BcdString))
+                    return false;
+                const char *value = reinterpret_cast<const char *>(&record);
+                if (record.value > static_cast<boost::uint64_t>(end - value) ||
+                    record.value_size >= static_cast<boost::uint64_t>(end - value) - record.value ||
+                    value[record.value + record.value_size] != 0)
+                    return false;
+            }
+            return true;
+        }
+
+    private:
+
+        void open(const void *image, std::size_t size, const std::string &filename)
+        {
+            m_image = static_cast<const char *>(image);
+            m_size = size;
+            const tap_snapshot_header *header = static_cast<const tap_snapshot_header *>(image);
+            if (size < sizeof(tap_snapshot_header) || (reinterpret_cast<std::size_t>(image) & 7) ||
+                std::memcmp(header->magic, "TAPSNP1", 8) != 0 ||
+                header->version != Version || header->release != Release ||
+                header->size != size || !header->count ||
+                (size - sizeof(tap_snapshot_header)) / sizeof(tap_snapshot_record) < header->count)
+                BOOST_PROPERTY_TREE_THROW(asn1_parser::asn1_parser_error(
+                    "not a tap snapshot", filename, 0));
+            m_count = static_cast<std::size_t>(header->count);
+            m_root = reinterpret_cast<const node_type *>(m_image + sizeof(tap_snapshot_header));
+        }
+
+        boost::interprocess::file_mapping m_file;
+        boost::interprocess::mapped_region m_region;
+        const char *m_image;
+        std::size_t m_size;
+        std::size_t m_count;
+        const node_type *m_root;
+    };
+
+}}}}
+
+#endif
@@ -0,0 +1,79 @@
+// ----------------------------------------------------------------------------
+// Copyright (C) 2015-2016 zunceng@gmail.com
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+// For more information, see www.boost.org
+// ----------------------------------------------------------------------------
+#ifndef BOOST_PROPERTY_TREE_TAP3_TIME_HPP_INCLUDED
+#define BOOST_PROPERTY_TREE_TAP3_TIME_HPP_INCLUDED
+
+//! \file tap3_time.hpp Conversion of TAP timestamps to UTC seconds since 1970-01-01.
+//! A timestamp group holds a LocalTimeStamp, YYYYMMDDhhmmss, and either a UtcTimeOffset, +hhmm,
+//! or a UtcTimeOffsetCode resolved through the UtcTimeOffsetInfoList of NetworkInfo (see tap3_references.hpp).
+
+#include <boost/cstdint.hpp>
+#include <cstddef>
+
+namespace boost { namespace property_tree { namespace detail {namespace tap_parser{
+
+    //! Converts a LocalTimeStamp to seconds since 1970-01-01 00:00:00, as if it were UTC.
+    //! The digits are combined without a branch per digit or field; days are counted from
+    //! the civil date arithmetically, with March as the first month so that February comes last.
+    //! \return false if text is not 14 digits of a valid date and time, from year 0001 on.
+    template<class Byte>
+    inline bool local_time_seconds(const Byte *text, std::size_t size, boost::int64_t &seconds)
+    {
+        if (size != 14)
+            return false;
+        unsigned d[14];
+        unsigned bad = 0;
+        for (std::size_t i = 0; i < 14; ++i)
+        {
+            d[i] = static_cast<unsigned char>(text[i]) - static_cast<unsigned>('0');
+            bad |= d[i] > 9;
+        }
+        unsigned year = d[0] * 1000 + d[1] * 100 + d[2] * 10 + d[3];
+        unsigned month = d[4] * 10 + d[5];
+        unsigned day = d[6] * 10 + d[7];
+        unsigned hour = d[8] * 10 + d[9];
+        unsigned minute = d[10] * 10 + d[11];
+        unsigned second = d[12] * 10 + d[13];
+        unsigned leap = (year % 4 == 0) & ((year % 100 != 0) | (year % 400 == 0));
+        unsigned month_days = month == 2 ? 28 + leap : 30 + ((month ^ (month >> 3)) & 1);
+        bad |= (year == 0) | (month - 1 > 11) | (day - 1 >= month_days) | (hour > 23) | (minute > 59) | (second > 60);
+
+        // Days from 0000-03-01, then from 1970-01-01
+        unsigned before_march = month <= 2;
+        unsigned y = year - before_march;
+        unsigned m = month + 12 * before_march - 3;
+        boost::int64_t days = 365 * static_cast<boost::int64_t>(y) + y / 4 - y / 100 + y / 400
+                            + (153 * m + 2) / 5 + day - 1 - 719468;
+        seconds = days * 86400 + hour * 3600 + minute * 60 + second;
+        return !bad;
+    }
+
+    //! Converts a UtcTimeOffset, +hhmm or -hhmm, to seconds east of UTC.
+    //! \return false if text is malformed.
+    template<class Byte>
+    inline bool utc_offset_seconds(const Byte *text, std::size_t size, boost::int32_t &seconds)
+    {
+        if (size != 5 || (text[0] != '+' && text[0] != '-'))
+            return false;
+        unsigned d[4];
+        unsigned bad = 0;
+        for (std::size_t i = 0; i < 4; ++i)
+        {
+            d[i] = static_cast<unsigned char>(text[i + 1]) - static_cast<unsigned>('0');
+            bad |= d[i] > 9;
+        }
+        boost::int32_t magnitude = static_cast<boost::int32_t>((d[0] * 10 + d[1]) * 3600 + (d[2] * 10 + d[3]) * 60);
+        seconds = text[0] == '-' ? -magnitude : magnitude;
+        return !bad;
+    }
+
+}}}}
+
+#endif
@@ -0,0 +1,292 @@
+// ----------------------------------------------------------------------------
+// Copyright (C) 2015-2016 zunceng@gmail.com
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+// For more information, see www.boost.org
+// ----------------------------------------------------------------------------
+#ifndef BOOST_PROPERTY_TREE_TAP3_TREE_HPP_INCLUDED
+#define BOOST_PROPERTY_TREE_TAP3_TREE_HPP_INCLUDED
+
+#include "rapidasn1.hpp"
+#include "tap3_parser_read.hpp"
+#include <boost/cstdint.hpp>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+namespace boost { namespace property_tree { namespace detail {namespace tap_parser{
+
+    //! Node of a translated TAP tree.
+    //! The key is the element of the static lookup table, so names are never copied;
+    //! the value is the decoded text, allocated from the memory pool of the tap_tree.
+    //! Integers also keep their number, so that it need not be parsed back from the text.
+    class tap_node
+    {
+    public:
+
+        tap_node()
+            : m_element(0)
+            , m_value(0)
+            , m_value_size(0)
+            , m_integer(0)
+            , m_parent(0)
+            , m_first_node(0)
+            , m_last_node(0)
+            , m_next_sibling(0)
+        {
+        }
+
+        //! Element of the lookup table, or 0 for the tree itself
+        const tap_element *element() const
+        {
+            return m_element;
+        }
+
+        //! Element name, as in the lookup table
+        const std::string &name() const
+        {
+            static const std::string empty;
+            return m_element ? m_element->name : empty;
+        }
+
+        std::size_t tag() const
+        {
+            return m_element ? m_element->tag : 0;
+        }
+
+        //! Decoded value; not null-terminated, use value_size()
+        const char *value() const
+        {
+            return m_value ? m_value : "";
+        }
+
+        std::size_t value_size() const
+        {
+            return m_value_size;
+        }
+
+        //! Decoded value as a string, like ptree::data()
+        std::string data() const
+        {
+            return std::string(value(), m_value_size);
+        }
+
+        //! Value of an Integer or Integer64 element, 0 otherwise
+        boost::int64_t integer() const
+        {
+            return m_integer;
+        }
+
+        tap_node *parent() const
+        {
+            return m_parent;
+        }
+
+        //! Gets first child node, optionally matching its name.
+        //! Trailing blanks of the table names are ignored.
+        tap_node *first_node(const char *name = 0) const
+        {
+            tap_node *child = m_first_node;
+            if (name)
+            {
+                std::size_t size = std::strlen(name);
+                while (child && !child->is(name, size))
+                    child = child->m_next_sibling;
+            }
+            return child;
+        }
+
+        tap_node *last_node() const
+        {
+            return m_last_node;
+        }
+
+        //! Gets next sibling node, optionally matching its name.
+        tap_node *next_sibling(const char *name = 0) const
+        {
+            tap_node *sibling = m_next_sibling;
+            if (name)
+            {
+                std::size_t size = std::strlen(name);
+                while (sibling && !sibling->is(name, size))
+                    sibling = sibling->m_next_sibling;
+            }
+            return sibling;
+        }
+
+        //! Finds a node by a dot separated path of element names, like find_tap_node().
+        //! \return Pointer to found node, or 0 if not found.
+        tap_node *find_node(const std::string &path) const
+        {
+            tap_node *current = const_cast<tap_node *>(this);
+            std::string::size_type begin = 0;
+            while (current && begin < path.size())
+            {
+                std::string::size_type end = path.find('.', begin);
+                if (end == std::string::npos)
+                    end = path.size();
+                std::string::size_type name_end = end;
+                std::size_t index = 1;
+                std::string::size_type open = path.find('(', begin);
+                if (open < end && path[end - 1] == ')')
+                {
+                    index = std::strtoul(path.c_str() + open + 1, 0, 10);
+                    name_end = open;
+                }
+                tap_node *child = current->m_first_node;
+                while (child && (!child->is(path.data() + begin, name_end - begin) || --index))
+                    child = child->m_next_sibling;
+                current = index ? 0 : child;
+                begin = end + 1;
+            }
+            return current;
+        }
+
+        //! Gets the value at path, like ptree::get<std::string>(path, default_value)
+        std::string get(const std::string &path, const std::string &default_value = std::string()) const
+        {
+            const tap_node *node = find_node(path);
+            return node ? node->data() : default_value;
+        }
+
+        //! Appends a new child node
+        void append_node(tap_node *child)
+        {
+            BOOST_ASSERT(child && !child->m_parent);
+            if (m_last_node)
+                m_last_node->m_next_sibling = child;
+            else
+                m_first_node = child;
+            m_last_node = child;
+            child->m_parent = this;
+            child->m_next_sibling = 0;
+        }
+
+        void element(const tap_element *element)
+        {
+            m_element = element;
+        }
+
+        void value(const char *value, std::size_t size)
+        {
+            m_value = value;
+            m_value_size = size;
+        }
+
+        void integer(boost::int64_t value)
+        {
+            m_integer = value;
+        }
+
+    protected:
+
+        void remove_all_nodes()
+        {
+            m_first_node = m_last_node = 0;
+        }
+
+    private:
+
+        bool is(const char *name, std::size_t size) const
+        {
+            const std::string &candidate = m_element->name;
+            std::size_t length = candidate.size();
+            while (length && candidate[length - 1] == ' ')
+                --length;
+            return length == size && candidate.compare(0, length, name, size) == 0;
+        }
+
+        const tap_element *m_element;
+        const char *m_value;
+        std::size_t m_value_size;
+        boost::int64_t m_integer;
+        tap_node *m_parent;
+        tap_node *m_first_node;
+        tap_node *m_last_node;
+        tap_node *m_next_sibling;
+    };
+
+    //! Translated TAP document.
+    //! Nodes and values live in the memory pool of the tree: building it costs no heap allocation
+    //! per node, and clear() or the destructor release a whole batch by freeing the pool blocks,
+    //! without visiting the nodes.
+    class tap_tree : public tap_node, public rapidasn1::memory_pool<char>
+    {
+    public:
+
+        //! Allocates a node from the pool
+        tap_node *allocate_node(const tap_element *element, const char *value = 0, std::size_t value_size = 0)
+        {
+            tap_node *node = new(allocate_memory(sizeof(tap_node))) tap_node();
+            node->element(element);
+            if (value_size)
+                node->value(allocate_string(value, value_size), value_size);
+            return node;
+        }
+
+        //! Removes all nodes and releases the pool
+        void clear()
+        {
+            remove_all_nodes();
+            rapidasn1::memory_pool<char>::clear();
+        }
+    };
+
+    namespace internal
+    {
+        template<int Version, int Release, class Byte>
+        void trans_asn1_tree_internal(const rapidasn1::asn1_node<Byte> &source, tap_node &dest, tap_tree &tree)
+        {
+            for (const rapidasn1::asn1_node<Byte> *child = source.first_node(); child; child = child->next_sibling())
+            {
+                const tap_element *element = find_tap_element<Version, Release>(child->tag());
+                if (!element)
+                    continue;
+
+                tap_node *node = tree.allocate_node(element);
+                dest.append_node(node);
+                const Byte *data = child->value();
+                std::size_t size = child->value_size();
+                switch (element->type)
+                {
+                    case Integer:
+                    case Integer64:
+                    {
+                        long long number = size && size <= 8 ? asn1_parser::binary2Int<0>(data, size) : 0LL;
+                        char *text = tree.allocate_string(0, 24);
+                        node->value(text, std::sprintf(text, "%lld", number));
+                        node->integer(number);
+                    }break;
+                    case OctString:
+                    {
+                        if (size)
+                            node->value(tree.allocate_string(reinterpret_cast<const char *>(data), size), size);
+                    }break;
+                    case BcdString:
+                    {
+                        char *text = tree.allocate_string(0, 2 * size);
+                        node->value(text, asn1_parser::binary2BCDString<0>(data, size, text));
+                    }break;
+                    default:
+                        trans_asn1_tree_internal<Version, Release>(*child, *node, tree);
+                        break;
+                }
+            }
+        }
+    }
+
+    //! Translates a BER tree into TAP element names, like trans_asn1_ptree() but into an arena-backed tap_tree.
+    //! The result does not refer to the BER data or to source.
+    template<int Version, int Release, class Byte>
+    void trans_asn1_tree(const rapidasn1::asn1_node<Byte> &source, tap_tree &tree)
+    {
+        tree.clear();
+        internal::trans_asn1_tree_internal<Version, Release>(source, tree, tree);
+    }
+
+}}}}
+
+#endif
@@ -0,0 +1,484 @@
+// ----------------------------------------------------------------------------
+// Copyright (C) 2015-2016 zunceng@gmail.com
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+// For more information, see www.boost.org
+// ----------------------------------------------------------------------------
+#ifndef BOOST_PROPERTY_TREE_TAP3_VALIDATE_HPP_INCLUDED
+#define BOOST_PROPERTY_TREE_TAP3_VALIDATE_HPP_INCLUDED
+
+#include "rapidasn1.hpp"
+#include "tap3_parser_read.hpp"
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace boost { namespace property_tree { namespace detail {namespace tap_parser{
+
+    //! Kinds of TAP validation rules.
+    enum tap_rule_kind
+    {
+        rule_mandatory,     //!< every group must contain element
+        rule_range,         //!< integer element must lie within [min, max]
+        rule_total,         //!< sum of element over all groups must equal the declared total
+        rule_count,         //!< number of children of group must equal the declared total
+    };
+
+    //! Definition of a validation rule, by element names.
+    struct tap_rule
+    {
+        tap_rule_kind kind;
+        const char *group;              //!< mandatory: parent element; total: element whose instances are summed; count: counted list
+        const char *element;            //!< mandatory: required child; range: checked element; total: summed child of group
+        long long min;                  //!< range: lowest allowed value
+        long long max;                  //!< range: highest allowed value
+        const char *total;              //!< total, count: element holding the declared value
+        const char *condition;          //!< total: child of group that must equal condition_value for the instance to count, or 0
+        const char *condition_value;    //!< total: expected octets of condition
+    };
+
+    //! One failed check reported by tap_validator::run().
+    struct tap_rule_failure
+    {
+        std::size_t record;             //!< Index of the call event in CallEventDetailList, or npos outside call events
+        std::size_t offset;             //!< Position of the failing element, or of the group missing an element
+        std::size_t tag;                //!< Tag of the failing or missing element
+        const tap_rule *rule;           //!< Rule that failed, or 0 for a malformed integer
+        long long value;                //!< Value found, for range, total and count rules
+
+        static const std::size_t npos = static_cast<std::size_t>(-1);
+    };
+
+    namespace internal
+    {
+        // Rules checked by default for each Version/Release.
+        // Unused entries are zero, which ends the table.
+        template <int Version, int Release>
+        struct rule_tables
+        {
+            static const tap_rule rules[128];
+        };
+
+        template <int Version, int Release>
+        const tap_rule rule_tables<Version, Release>::rules[] = {};
+
+        template <>
+        const tap_rule rule_tables<3, 11>::rules[] = {
+            {rule_mandatory, "TransferBatch", "BatchControlInfo", 0, 0, 0, 0, 0},
+            {rule_mandatory, "TransferBatch", "NetworkInfo", 0, 0, 0, 0, 0},
+            {rule_mandatory, "TransferBatch", "AuditControlInfo", 0, 0, 0, 0, 0},
+            {rule_mandatory, "BatchControlInfo", "Sender", 0, 0, 0, 0, 0},
+            {rule_mandatory, "BatchControlInfo", "Recipient", 0, 0, 0, 0, 0},
+            {rule_mandatory, "BatchControlInfo", "FileSequenceNumber", 0, 0, 0, 0, 0},
+            {rule_mandatory, "BatchControlInfo", "FileAvailableTimeStamp", 0, 0, 0, 0, 0},
+            {rule_mandatory, "BatchControlInfo", "SpecificationVersionNumber", 0, 0, 0, 0, 0},
+            {rule_mandatory, "BatchControlInfo", "ReleaseVersionNumber", 0, 0, 0, 0, 0},
+            {rule_mandatory, "AccountingInfo", "LocalCurrency", 0, 0, 0, 0, 0},
+            {rule_mandatory, "AccountingInfo", "TapDecimalPlaces", 0, 0, 0, 0, 0},
+            {rule_mandatory, "NetworkInfo", "UtcTimeOffsetInfoList", 0, 0, 0, 0, 0},
+            {rule_mandatory, "UtcTimeOffsetInfo", "UtcTimeOffsetCode", 0, 0, 0, 0, 0},
+            {rule_mandatory, "UtcTimeOffsetInfo", "UtcTimeOffset", 0, 0, 0, 0, 0},
+            {rule_mandatory, "AuditControlInfo", "TotalCharge", 0, 0, 0, 0, 0},
+            {rule_mandatory, "AuditControlInfo", "TotalTaxValue", 0, 0, 0, 0, 0},
+            {rule_mandatory, "AuditControlInfo", "TotalDiscountValue", 0, 0, 0, 0, 0},
+            {rule_mandatory, "AuditControlInfo", "CallEventDetailsCount", 0, 0, 0, 0, 0},
+            {rule_mandatory, "MobileOriginatedCall", "MoBasicCallInformation", 0, 0, 0, 0, 0},
+            {rule_mandatory, "MobileOriginatedCall", "LocationInformation", 0, 0, 0, 0, 0},
+            {rule_mandatory, "MobileOriginatedCall", "BasicServiceUsedList", 0, 0, 0, 0, 0},
+            {rule_mandatory, "MobileTerminatedCall", "MtBasicCallInformation", 0, 0, 0, 0, 0},
+            {rule_mandatory, "MobileTerminatedCall", "LocationInformation", 0, 0, 0, 0, 0},
+            {rule_mandatory, "MobileTerminatedCall", "BasicServiceUsedList", 0, 0, 0, 0, 0},
+            {rule_mandatory, "GprsCall", "GprsBasicCallInformation", 0, 0, 0, 0, 0},
+            {rule_mandatory, "GprsCall", "GprsLocationInformation", 0, 0, 0, 0, 0},
+            {rule_mandatory, "GprsCall", "GprsServiceUsed", 0, 0, 0, 0, 0},
+            {rule_mandatory, "CallEventStartTimeStamp", "LocalTimeStamp", 0, 0, 0, 0, 0},
+            {rule_mandatory, "CallEventStartTimeStamp", "UtcTimeOffsetCode", 0, 0, 0, 0, 0},
+            {rule_mandatory, "ChargeDetail", "ChargeType", 0, 0, 0, 0, 0},
+            {rule_mandatory, "ChargeDetail", "Charge", 0, 0, 0, 0, 0},
+            {rule_range, 0, "SpecificationVersionNumber", 3, 3, 0, 0, 0},
+            {rule_range, 0, "ReleaseVersionNumber", 11, 11, 0, 0, 0},
+            {rule_range, 0, "TapDecimalPlaces", 0, 6, 0, 0, 0},
+            {rule_range, 0, "Charge", 0, 0x7FFFFFFFFFFFFFFFLL, 0, 0, 0},
+            {rule_range, 0, "TotalCallEventDuration", 0, 0x7FFFFFFFFFFFFFFFLL, 0, 0, 0},
+            {rule_range, 0, "ChargeableUnits", 0, 0x7FFFFFFFFFFFFFFFLL, 0, 0, 0},
+            {rule_range, 0, "DataVolumeIncoming", 0, 0x7FFFFFFFFFFFFFFFLL, 0, 0, 0},
+            {rule_range, 0, "DataVolumeOutgoing", 0, 0x7FFFFFFFFFFFFFFFLL, 0, 0, 0},
+            {rule_range, 0, "UtcTimeOffsetCode", 0, 0x7FFFFFFFFFFFFFFFLL, 0, 0, 0},
+            {rule_range, 0, "ExchangeRateCode", 0, 0x7FFFFFFFFFFFFFFFLL, 0, 0, 0},
+            {rule_range, 0, "TaxCode", 0, 0x7FFFFFFFFFFFFFFFLL, 0, 0, 0},
+            {rule_range, 0, "RecEntityCode", 0, 0x7FFFFFFFFFFFFFFFLL, 0, 0, 0},
+            {rule_total, "ChargeDetail", "Charge", 0, 0, "TotalCharge", "ChargeType", "00"},
+            {rule_total, "TaxInformation", "TaxValue", 0, 0, "TotalTaxValue", 0, 0},
+            {rule_total, "DiscountInformation", "Discount", 0, 0, "TotalDiscountValue", 0, 0},
+            {rule_count, "CallEventDetailList", 0, 0, 0, "CallEventDetailsCount", 0, 0},
+        };
+    }
+
+    //! TAP semantic validator.
+    //! The rules for a Version/Release are compiled once into flat tag-indexed tables;
+    //! run() then checks a whole batch in one pass over the BER data, without building a tree.
+    //! A compiled validator is immutable and can be shared between threads.
+    template<int Version, int Release>
+    class tap_validator
+    {
+    public:
+
+        //! Compiles the default rules of the Version/Release.
+        tap_validator()
+        {
+            const tap_rule *begin = internal::rule_tables<Version, Release>::rules;
+            const tap_rule *end = begin;
+            while (end->group || end->element)
+                ++end;
+            compile(begin, end);
+        }
+
+        //! Compiles a custom rule set.
+        //! Rules naming elements unknown to the Version/Release table are ignored;
+        //! several range rules on one element are all checked.
+        tap_validator(const tap_rule *begin, const tap_rule *end)
+        {
+            compile(begin, end);
+        }
+
+        //! Checks size bytes of BER data against the rules.
+        //! \param failures Receives one record per failed check.
+        //! \param result Receives the error if the data is not well-formed BER, in which case checking stops.
+        //! \return true if the data is well-formed and no check failed.
+        template<class Byte>
+        bool run(const Byte *data, std::size_t size,
+                 std::vector<tap_rule_failure> &failures,
+                 rapidasn1::parse_result &result) const
+        {
+            std::size_t first_failure = failures.size();
+            runner<Byte> handler(*this, data, failures);
+            if (!rapidasn1::walk<rapidasn1::parse_default>(data, size, handler, result))
+                return false;
+            handler.finish();
+            return failures.size() == first_failure;
+        }
+
+    private:
+
+        enum interest
+        {
+            interest_required = 0x01,       // Group with mandatory children
+            interest_range = 0x02,          // Element with a range rule
+            interest_total = 0x04,          // Element taking part in a total or count rule
+        };
+
+        struct range_op
+        {
+            const tap_rule *rule;
+            long long min;
+            long long max;
+        };
+
+        struct total_op
+        {
+            const tap_rule *rule;
+            std::size_t group;
+            std::size_t element;            // 0 for count rules
+            std::size_t declared;
+            std::size_t condition;
+            std::string condition_value;
+        };
+
+        void compile(const tap_rule *begin, const tap_rule *end)
+        {
+            std::fill(m_interest, m_interest + 1024, 0);
+            std::fill(m_required_begin, m_required_begin + 1025, 0);
+            std::fill(m_ranges_begin, m_ranges_begin + 1025, 0);
+            m_list_tag = tag("CallEventDetailList");
+
+            // Mandatory children are laid out grouped by parent tag, and ranges by element tag
+            std::vector<std::size_t> count(1024, 0), ranges(1024, 0);
+            for (const tap_rule *rule = begin; rule != end; ++rule)
+            {
+                if (rule->kind == rule_mandatory && tag(rule->group) && tag(rule->element) &&
+                    count[tag(rule->group)] < 64)
+                    ++count[tag(rule->group)];
+                else if (rule->kind == rule_range && tag(rule->element))
+                    ++ranges[tag(rule->element)];
+            }
+            for (std::size_t t = 0; t < 1024; ++t)
+            {
+                m_required_begin[t + 1] = m_required_begin[t] + count[t];
+                m_ranges_begin[t + 1] = m_ranges_begin[t] + ranges[t];
+            }
+            m_required.resize(m_required_begin[1024]);
+            m_ranges.resize(m_ranges_begin[1024]);
+            std::fill(count.begin(), count.end(), 0);
+            std::fill(ranges.begin(), ranges.end(), 0);
+
+            for (const tap_rule *rule = begin; rule != end; ++rule)
+            {
+                std::size_t group = tag(rule->group);
+                std::size_t element = tag(rule->element);
+                switch (rule->kind)
+                {
+                    case rule_mandatory:
+                    {
+                        if (!group || !element || count[group] == 64)
+                            break;
+                        m_required[m_required_begin[group] + count[group]] = std::make_pair(element, rule);
+                        ++count[group];
+                        m_interest[group] |= interest_required;
+                    }break;
+                    case rule_range:
+                    {
+                        if (!element)
+                            break;
+                        range_op op = {rule, rule->min, rule->max};
+                        m_ranges[m_ranges_begin[element] + ranges[element]++] = op;
+                        m_interest[element] |= interest_range;
+                    }break;
+                    case rule_total:
+                    case rule_count:
+                    {
+                        total_op op;
+                        op.rule = rule;
+                        op.group = group;
+                        op.element = rule->kind == rule_total ? element : 0;
+                        op.declared = tag(rule->total);
+                        op.condition = rule->condition ? tag(rule->condition) : 0;
+                        if (op.condition)
+                            op.condition_value = rule->condition_value;
+                        if (!op.group || !op.declared || (rule->kind == rule_total && !op.element))
+                            break;
+                        m_totals.push_back(op);
+                        m_interest[op.group] |= interest_total;
+                        m_interest[op.declared] |= interest_total;
+                        if (op.element)
+                            m_interest[op.element] |= interest_total;
+                        if (op.condition)
+                            m_interest[op.condition] |= interest_total;
+                    }break;
+                }
+            }
+        }
+
+        static std::size_t tag(const char *name)
+        {
+            return name ? find_tap_tag<Version, Release>(name, std::strlen(name)) : 0;
+        }
+
+        // Walk handler holding the state of one run
+        template<class Byte>
+        class runner
+        {
+        public:
+
+            runner(const tap_validator &program, const Byte *data, std::vector<tap_rule_failure> &failures)
+                : m_program(program)
+                , m_data(data)
+                , m_failures(failures)
+                , m_record(tap_rule_failure::npos)
+                , m_record_depth(0)
+                , m_records(0)
+                , m_totals(program.m_totals.size())
+            {
+            }
+
+            bool begin_group(std::size_t tag, std::size_t offset, std::size_t depth)
+            {
+                if (depth && m_stack[depth-1].tag == m_program.m_list_tag)
+                {
+                    m_record = m_records++;
+                    m_record_depth = depth;
+                }
+                child(tag, depth);
+
+                frame &f = m_stack[depth];
+                f.tag = tag;
+                f.offset = offset;
+                f.present = 0;
+                if (tag < 1024 && (m_program.m_interest[tag] & interest_total))
+                {
+                    for (std::size_t i = 0; i < m_totals.size(); ++i)
+                        if (m_program.m_totals[i].group == tag)
+                        {
+                            m_totals[i].pending = 0;
+                            m_totals[i].matched = !m_program.m_totals[i].condition;
+                        }
+                }
+                return true;
+            }
+
+            void end_group(std::size_t tag, std::size_t, std::size_t depth)
+            {
+                if (tag < 1024 && (m_program.m_interest[tag] & interest_required))
+                {
+                    const frame &f = m_stack[depth];
+                    std::size_t begin = m_program.m_required_begin[tag];
+                    std::size_t count = m_program.m_required_begin[tag + 1] - begin;
+                    for (std::size_t i = 0; i < count; ++i)
+                        if (!(f.present & (1ULL << i)))
+                            fail(f.offset, m_program.m_required[begin + i].first, m_program.m_required[begin + i].second, 0);
+                }
+                if (tag < 1024 && (m_program.m_interest[tag] & interest_total))
+                {
+                    for (std::size_t i = 0; i < m_totals.size(); ++i)
+                        if (m_program.m_totals[i].group == tag && m_totals[i].matched)
+                            m_totals[i].sum += m_totals[i].pending;
+                }
+                if (depth == m_record_depth && m_record != tap_rule_failure::npos)
+                    m_record = tap_rule_failure::npos;
+            }
+
+            void value(std::size_t tag, const Byte *value, std::size_t size, std::size_t depth)
+            {
+                child(tag, depth);
+                if (tag >= 1024 || !m_program.m_interest[tag])
+                    return;
+
+                std::size_t offset = value - m_data;
+                unsigned char interest = m_program.m_interest[tag];
+                long long number = 0;
+                if (interest & (interest_range | interest_total))
+                {
+                    // Conditions compare octets; everything else needs an integer
+                    bool integer = (interest & interest_range) || !is_condition(tag);
+                    if (integer)
+                    {
+                        if (size == 0 || size > 8)
+                        {
+                            fail(offset, tag, 0, 0);
+                            return;
+                        }
+                        number = asn1_parser::binary2Int<rapidasn1::parse_non_validating>(value, size);
+                    }
+                }
+
+                if (interest & interest_range)
+                {
+                    for (std::size_t i = m_program.m_ranges_begin[tag]; i < m_program.m_ranges_begin[tag + 1]; ++i)
+                    {
+                        const range_op &op = m_program.m_ranges[i];
+                        if (number < op.min || number > op.max)
+                            fail(offset, tag, op.rule, number);
+                    }
+                }
+
+                if (interest & interest_total)
+                {
+                    std::size_t parent = depth ? m_stack[depth-1].tag : 0;
+                    for (std::size_t i = 0; i < m_totals.size(); ++i)
+                    {
+                        const total_op &op = m_program.m_totals[i];
+                        state &st = m_totals[i];
+                        if (op.declared == tag)
+                        {
+                            st.declared = number;
+                            st.declared_offset = offset;
+                            st.declared_seen = true;
+                        }
+                        else if (parent == op.group && op.element == tag)
+                            st.pending += number;
+                        else if (parent == op.group && op.condition == tag)
+                            st.matched = op.condition_value.size() == size &&
+                                         std::memcmp(op.condition_value.data(), value, size) == 0;
+                    }
+                }
+            }
+
+            //! Checks the batch-level totals once the whole batch has been walked
+            void finish()
+            {
+                m_record = tap_rule_failure::npos;
+                for (std::size_t i = 0; i < m_totals.size(); ++i)
+                {
+                    const total_op &op = m_program.m_totals[i];
+                    const state &st = m_totals[i];
+                    if (st.declared_seen && st.declared != st.sum)
+                        fail(st.declared_offset, op.declared, op.rule, st.sum);
+                }
+            }
+
+        private:
+
+            struct frame
+            {
+                std::size_t tag;
+                std::size_t offset;
+                unsigned long long present;     // One bit per mandatory child seen
+            };
+
+            struct state
+            {
+                state()
+                    : sum(0), pending(0), declared(0), declared_offset(0)
+                    , matched(false), declared_seen(false)
+                {
+                }
+                long long sum;
+                long long pending;              // Sum within the current group, added at its end if matched
+                long long declared;
+                std::size_t declared_offset;
+                bool matched;
+                bool declared_seen;
+            };
+
+            // Records a child of the group at depth-1 for mandatory and count rules
+            void child(std::size_t tag, std::size_t depth)
+            {
+                if (!depth)
+                    return;
+                frame &parent = m_stack[depth-1];
+                if (parent.tag >= 1024 || !m_program.m_interest[parent.tag])
+                    return;
+                if (m_program.m_interest[parent.tag] & interest_required)
+                {
+                    std::size_t begin = m_program.m_required_begin[parent.tag];
+                    std::size_t count = m_program.m_required_begin[parent.tag + 1] - begin;
+                    for (std::size_t i = 0; i < count; ++i)
+                        if (m_program.m_required[begin + i].first == tag)
+                            parent.present |= 1ULL << i;
+                }
+                if (m_program.m_interest[parent.tag] & interest_total)
+                {
+                    for (std::size_t i = 0; i < m_totals.size(); ++i)
+                        if (m_program.m_totals[i].group == parent.tag && !m_program.m_totals[i].element)
+                            ++m_totals[i].sum;
+                }
+            }
+
+            bool is_condition(std::size_t tag) const
+            {
+                for (std::size_t i = 0; i < m_program.m_totals.size(); ++i)
+                    if (m_program.m_totals[i].condition == tag)
+                        return true;
+                return false;
+            }
+
+            void fail(std::size_t offset, std::size_t tag, const tap_rule *rule, long long value)
+            {
+                tap_rule_failure failure = {m_record, offset, tag, rule, value};
+                m_failures.push_back(failure);
+            }
+
+            const tap_validator &m_program;
+            const Byte *m_data;
+            std::vector<tap_rule_failure> &m_failures;
+            std::size_t m_record;
+            std::size_t m_record_depth;
+            std::size_t m_records;
+            std::vector<state> m_totals;
+            frame m_stack[BOOST_PROPERTY_TREE_RAPIDASN1_VALIDATE_DEPTH];
+        };
+
+        unsigned char m_interest[1024];                                     // interest flags by tag
+        std::size_t m_required_begin[1025];                                 // first mandatory child by parent tag
+        std::vector<std::pair<std::size_t, const tap_rule *> > m_required;  // mandatory children, grouped by parent
+        std::size_t m_ranges_begin[1025];                                   // first range by element tag
+        std::vector<range_op> m_ranges;                                     // ranges, grouped by element
+        std::vector<total_op> m_totals;
+        std::size_t m_list_tag;                                             // CallEventDetailList, whose children are records
+    };
+
+}}}}
+
+#endif
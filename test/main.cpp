@@ -1,12 +1,35 @@
+// Small chunks so that parsing overlaps decompression in test_read_compressed
+#define BOOST_PROPERTY_TREE_ASN1_READ_CHUNK_SIZE 4096
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/xml_parser.hpp>
 #include "asn1_parser.hpp"
 #include "detail/rapidasn1.hpp"
 #include <fstream>
 #include <iostream>
+#include <boost/property_tree/json_parser.hpp>
+#include <sstream>
+#include <iterator>
+#include <map>
+#include <vector>
+#include <algorithm>
 #include <assert.h>
+#include <stdlib.h>
+#include <unistd.h>
 typedef unsigned char Byte;
 
+std::vector<char> load_file(const std::string &filename)
+{
+    std::ifstream stream(filename.c_str(), std::ios::in | std::ios::binary);
+    return std::vector<char>(std::istreambuf_iterator<char>(stream.rdbuf()),
+                             std::istreambuf_iterator<char>());
+}
+
+void write_file(const std::string &filename, const std::vector<unsigned char> &data)
+{
+    std::ofstream stream(filename.c_str(), std::ios::out | std::ios::binary);
+    stream.write((const char*)&data[0], data.size());
+}
+
 
 // Loads debug_settings structure from the specified XML file
 void load(const std::string &filename)
@@ -119,7 +142,13 @@ void test_rapidasn1()
     unsigned char buff3[] = {0x5B, 0xC2};
     std::string v(buff3, buff3+sizeof(buff3));
     test_binary2Int(v, 23490);
-    
+
+    // Sizes outside 1 to 8 octets read as 0 without validation
+    unsigned char wide[9] = {0x01};
+    using boost::property_tree::detail::rapidasn1::parse_non_validating;
+    assert(boost::property_tree::asn1_parser::binary2Int<parse_non_validating>(wide, sizeof(wide)) == 0);
+    assert(boost::property_tree::asn1_parser::binary2Int<parse_non_validating>(wide, 0) == 0);
+    assert(boost::property_tree::asn1_parser::binary2Int<parse_non_validating>(wide, 8) == 0x0100000000000000LL);
 }
 
 void test_asn1file()
@@ -127,17 +156,1661 @@ void test_asn1file()
     try{
         load2("CDAFGAWDNKDM05958");
     }   
-    catch(boost::property_tree::detail::rapidasn1::parse_error &e)
+    catch(boost::property_tree::asn1_parser::asn1_parser_error &e)
     {
         std::cout << e.what() << std::endl;
-        std::cout << e.where() << std::endl;
     }
 }
 
+// BER group with a definite length
+std::vector<unsigned char> ber_group(unsigned char identifier, const std::vector<unsigned char> &content)
+{
+    std::vector<unsigned char> out(1, identifier);
+    if (content.size() < 0x80)
+        out.push_back((unsigned char)content.size());
+    else
+    {
+        out.push_back(0x82);
+        out.push_back((unsigned char)(content.size() >> 8));
+        out.push_back((unsigned char)content.size());
+    }
+    out.insert(out.end(), content.begin(), content.end());
+    return out;
+}
+
+// MobileOriginatedCall holding an Imsi under levels nested groups
+std::vector<unsigned char> nested_call_event(std::size_t levels)
+{
+    unsigned char imsi[] = {0x5F, 0x81, 0x01, 0x08, 0x23, 0x80, 0x21, 0x00, 0x00, 0x00, 0x00, 0x1F};
+    std::vector<unsigned char> content(imsi, imsi + sizeof(imsi));
+    for (std::size_t i = 0; i < levels; ++i)
+        content = ber_group(0x64, content);
+    return ber_group(0x69, content);
+}
+
+// TransferBatch whose CallEventDetailList holds nested_call_event(levels)
+std::vector<unsigned char> nested_batch(std::size_t levels)
+{
+    return ber_group(0x61, ber_group(0x63, nested_call_event(levels)));
+}
+
+// Same data and children, except that siblings of different names may come in any order
+bool same_document(const boost::property_tree::ptree &a, const boost::property_tree::ptree &b)
+{
+    typedef boost::property_tree::ptree ptree;
+    if (a.data() != b.data() || a.size() != b.size())
+        return false;
+    std::map<std::string, std::vector<const ptree *> > children;
+    for (ptree::const_iterator it = b.begin(); it != b.end(); ++it)
+        children[it->first].push_back(&it->second);
+    std::map<std::string, std::size_t> seen;
+    for (ptree::const_iterator it = a.begin(); it != a.end(); ++it)
+    {
+        std::size_t index = seen[it->first]++;
+        const std::vector<const ptree *> &same_name = children[it->first];
+        if (index >= same_name.size() || !same_document(it->second, *same_name[index]))
+            return false;
+    }
+    return true;
+}
+
+void test_tap_emitter(const std::string &filename)
+{
+    using boost::property_tree::ptree;
+    std::vector<char> v = load_file(filename);
+    boost::property_tree::detail::rapidasn1::asn1_tree<Byte> tree;
+    tree.parse<1>((const Byte*)&v[0], v.size());
+
+    ptree pt, new_pt;
+    boost::property_tree::asn1_parser::read_asn1(filename, pt);
+    boost::property_tree::asn1_parser::tap_parser::trans_asn1_ptree<3, 11>(pt, new_pt);
+
+    std::stringstream xml;
+    boost::property_tree::asn1_parser::tap_parser::write_tap_xml<3, 11>(xml, tree);
+    ptree xml_pt;
+    read_xml(xml, xml_pt);
+
+    // Same document as write_xml, but in the order of the data
+    std::stringstream expected;
+    write_xml(expected, new_pt);
+    ptree expected_pt;
+    read_xml(expected, expected_pt);
+    assert(same_document(xml_pt, expected_pt));
+    assert(xml_pt.get_child("TransferBatch.CallEventDetailList").size() == 195);
+
+    // A BcdString longer than the buffer, through the smallest buffer
+    std::vector<unsigned char> imsi(44, 0x12);
+    imsi[0] = 0x5F;
+    imsi[1] = 0x81;
+    imsi[2] = 0x01;
+    imsi[3] = 40;
+    boost::property_tree::detail::rapidasn1::asn1_tree<Byte> long_bcd;
+    long_bcd.parse<1>(&imsi[0], imsi.size());
+    std::stringstream small;
+    {
+        boost::property_tree::asn1_parser::tap_parser::output_buffer out(small, 64);
+        boost::property_tree::asn1_parser::tap_parser::write_tap_xml<3, 11>(out, long_bcd);
+    }
+    std::string digits;
+    for (int i = 0; i < 40; ++i)
+        digits += "12";
+    assert(small.str().find("<Imsi>" + digits + "</Imsi>") != std::string::npos);
+
+    std::stringstream json;
+    boost::property_tree::asn1_parser::tap_parser::write_tap_json<3, 11>(json, tree);
+    ptree json_pt;
+    read_json(json, json_pt);
+    assert(json_pt.get<std::string>("TransferBatch.BatchControlInfo.Sender") ==
+           new_pt.get<std::string>("TransferBatch.BatchControlInfo.Sender"));
+
+    // A ChargeDetail with three Charges, of 1, 9 and no octets, then a Sender with a Latin-1 octet
+    unsigned char odd[] = {0x7F, 0x3F, 19, 0x5F, 0x3E, 1, 5, 0x5F, 0x3E, 9, 1, 2, 3, 4, 5, 6, 7, 8, 9, 0x5F, 0x3E, 0,
+                           0x5F, 0x81, 0x44, 3, 'A', 0xE9, 'B'};
+    boost::property_tree::detail::rapidasn1::asn1_tree<Byte> odd_tree;
+    odd_tree.parse<1>(odd, sizeof(odd));
+    std::stringstream odd_xml, odd_json;
+    boost::property_tree::asn1_parser::tap_parser::write_tap_xml<3, 11>(odd_xml, odd_tree);
+    assert(odd_xml.str().find("<ChargeDetail><Charge>5</Charge><Charge>010203040506070809</Charge><Charge></Charge></ChargeDetail>") != std::string::npos);
+    boost::property_tree::asn1_parser::tap_parser::write_tap_json<3, 11>(odd_json, odd_tree);
+    assert(odd_json.str() == "{\"ChargeDetail\":{\"Charge\":[5,\"010203040506070809\",\"\"]},\"Sender\":\"A\\u00e9B\"}\n");
+    read_json(odd_json, json_pt);
+    assert(json_pt.get_child("ChargeDetail.Charge").size() == 3);
+}
+
+void test_tap_dump(const std::string &filename)
+{
+    std::vector<char> v = load_file(filename);
+    boost::property_tree::detail::rapidasn1::asn1_tree<Byte> tree;
+    tree.parse<1>((const Byte*)&v[0], v.size());
+
+    boost::property_tree::detail::rapidasn1::asn1_node<Byte> *node =
+        boost::property_tree::asn1_parser::tap_parser::find_tap_node<3, 11>(tree, "TransferBatch.BatchControlInfo");
+    assert(node && node->tag() == 4);
+
+    std::stringstream dump;
+    boost::property_tree::asn1_parser::tap_parser::write_tap_dump<3, 11>(dump, *node, 1);
+    std::string line;
+    std::getline(dump, line);
+    assert(line == "  BatchControlInfo");
+    std::getline(dump, line);
+    assert(line.compare(0, 11, "    Sender ") == 0);
+    assert(line.substr(53) == " AFGAW");
+
+    // Deep indentation and a long value, through the smallest buffer
+    std::vector<unsigned char> content(203, 'a');
+    content[0] = 0x5F;
+    content[1] = 0x82;
+    content[2] = 0x05;
+    content[3] = 0x81;
+    content[4] = 198;
+    for (int i = 0; i < 40; ++i)
+        content = ber_group(0x64, content);
+    boost::property_tree::detail::rapidasn1::asn1_tree<Byte> deep;
+    deep.parse<1>(&content[0], content.size());
+    std::stringstream small;
+    {
+        boost::property_tree::asn1_parser::tap_parser::output_buffer out(small, 64);
+        boost::property_tree::asn1_parser::tap_parser::write_tap_dump<3, 11>(out, deep);
+    }
+    std::string text = small.str();
+    std::string last = text.substr(text.rfind('\n', text.size() - 2) + 1);
+    assert(last == std::string(80, ' ') + "AccessPointNameNI ... " + std::string(198, 'a') + "\n");
+
+    // Integers that do not fit in 8 octets are shown in hex
+    unsigned char charge[] = {0x5F, 0x3E, 9, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+    boost::property_tree::detail::rapidasn1::asn1_tree<Byte> wide;
+    wide.parse<1>(charge, sizeof(charge));
+    std::stringstream wide_dump;
+    boost::property_tree::asn1_parser::tap_parser::write_tap_dump<3, 11>(wide_dump, wide);
+    assert(wide_dump.str().compare(0, 7, "Charge ") == 0);
+    assert(wide_dump.str().substr(wide_dump.str().size() - 20) == " 010203040506070809\n");
+}
+
+void test_asn1_view(const std::string &filename)
+{
+    using boost::property_tree::ptree;
+    using boost::property_tree::asn1_parser::asn1_view_ptree;
+    std::vector<char> v = load_file(filename);
+
+    asn1_view_ptree view_pt;
+    boost::property_tree::asn1_parser::read_asn1((const Byte*)&v[0], v.size(), view_pt);
+    // Sender value points into the source buffer
+    boost::string_ref sender = view_pt.get_child("1.4.196").data();
+    assert(sender.data() >= &v[0] && sender.data() < &v[0] + v.size());
+    assert(sender == "AFGAW");
+
+    ptree pt, new_pt, new_view_pt;
+    boost::property_tree::asn1_parser::read_asn1(filename, pt);
+    boost::property_tree::asn1_parser::tap_parser::trans_asn1_ptree<3, 11>(pt, new_pt);
+    boost::property_tree::asn1_parser::tap_parser::trans_asn1_ptree<3, 11>(view_pt, new_view_pt);
+    assert(new_pt == new_view_pt);
+
+    unsigned char bcd[] = {0x23, 0x80, 0x2F};
+    char digits[2 * sizeof(bcd)];
+    assert(boost::property_tree::asn1_parser::binary2BCDString<0>(bcd, sizeof(bcd), digits) == 5);
+    assert(std::string(digits, 5) == "23802");
+    assert(boost::property_tree::asn1_parser::binary2Int<0>(bcd, 2) == 0x2380);
+}
+
+void test_parse_recover(const std::string &filename)
+{
+    using boost::property_tree::detail::rapidasn1::asn1_tree;
+    using boost::property_tree::detail::rapidasn1::asn1_node;
+    using boost::property_tree::detail::rapidasn1::parse_failure;
+    std::vector<char> v = load_file(filename);
+    {
+        asn1_tree<Byte> tree;
+        tree.parse<1>((const Byte*)&v[0], v.size());
+        asn1_node<Byte> *imsi = boost::property_tree::asn1_parser::tap_parser::find_tap_node<3, 11>(tree,
+            "TransferBatch.CallEventDetailList.MobileOriginatedCall(2).MoBasicCallInformation.ChargeableSubscriber.SimChargeableSubscriber.Imsi");
+        assert(imsi);
+        // Corrupt the length of the Imsi so that it overruns its group
+        v[(const char*)imsi->value() - &v[0] - 1] = 0x7F;
+    }
+
+    bool thrown = false;
+    try
+    {
+        asn1_tree<Byte> tree;
+        tree.parse<1>((const Byte*)&v[0], v.size());
+    }
+    catch(boost::property_tree::detail::rapidasn1::parse_error &)
+    {
+        thrown = true;
+    }
+    assert(thrown);
+
+    asn1_tree<Byte> tree;
+    std::vector<parse_failure> failures;
+    assert(tree.parse_recover<1>((const Byte*)&v[0], v.size(), failures));
+    assert(failures.size() == 1);
+    assert(failures[0].tag == 199);
+    assert(failures[0].where > failures[0].offset && failures[0].where < failures[0].offset + failures[0].size);
+    asn1_node<Byte> *moc = boost::property_tree::asn1_parser::tap_parser::find_tap_node<3, 11>(tree,
+        "TransferBatch.CallEventDetailList.MobileOriginatedCall(2).MoBasicCallInformation.ChargeableSubscriber");
+    assert(moc && !moc->first_node());
+    assert((boost::property_tree::asn1_parser::tap_parser::find_tap_node<3, 11>(tree,
+        "TransferBatch.AuditControlInfo.CallEventDetailsCount")));
+
+    // Truncated data cannot be recovered, the partial tree is kept
+    failures.clear();
+    assert(!tree.parse_recover<1>((const Byte*)&v[0], v.size() / 2, failures));
+    assert(failures.size() == 2 && failures[1].size == 0);
+    asn1_node<Byte> *list = boost::property_tree::asn1_parser::tap_parser::find_tap_node<3, 11>(tree,
+        "TransferBatch.CallEventDetailList");
+    assert(list && list->first_node() && tree.first_node()->first_node(4));
+}
+
+void test_parse_result(const std::string &filename)
+{
+    using boost::property_tree::detail::rapidasn1::asn1_tree;
+    using boost::property_tree::detail::rapidasn1::parse_result;
+    std::vector<char> v = load_file(filename);
+
+    asn1_tree<Byte> tree;
+    parse_result result;
+    assert(tree.parse<1>((const Byte*)&v[0], v.size(), result));
+    assert(result.ok());
+
+    assert(!tree.parse<1>((const Byte*)&v[0], v.size() - 1, result));
+    assert(result.code == boost::property_tree::detail::rapidasn1::error_overrun);
+    assert(result.where == 4);
+
+    unsigned char varlen[] = {0x5F, 0x81, 0x44, 0x80, 0x41, 0x00, 0x00};
+    assert(!tree.parse<1>(varlen, sizeof(varlen), result));
+    assert(result.code == boost::property_tree::detail::rapidasn1::error_varlen_primitive);
+
+    boost::property_tree::ptree pt;
+    assert(!boost::property_tree::asn1_parser::read_asn1((const Byte*)&v[0], v.size() / 2, pt, result));
+    assert(pt.empty());
+    assert(boost::property_tree::asn1_parser::read_asn1((const Byte*)&v[0], v.size(), pt, result));
+    assert(pt.get<std::string>("1.4.196") == "AFGAW");
+
+    // Without a result, errors are thrown with the file name and offset
+    const unsigned char broken[] = {0x61, 0x06, 0x5F, 0x81, 0x01, 0x05, 0x01, 0x02};
+    const std::string broken_file = filename + ".broken";
+    write_file(broken_file, std::vector<unsigned char>(broken, broken + sizeof(broken)));
+    bool thrown = false;
+    try
+    {
+        boost::property_tree::asn1_parser::read_asn1(broken_file, pt);
+    }
+    catch (boost::property_tree::asn1_parser::asn1_parser_error &e)
+    {
+        assert(e.filename() == broken_file && e.offset() == 6);
+        thrown = true;
+    }
+    assert(thrown);
+    std::remove(broken_file.c_str());
+    thrown = false;
+    try
+    {
+        boost::property_tree::asn1_parser::read_asn1(broken, sizeof(broken), pt);
+    }
+    catch (boost::property_tree::asn1_parser::asn1_parser_error &e)
+    {
+        assert(e.offset() == 6);
+        thrown = true;
+    }
+    assert(thrown);
+}
+
+void test_validate(const std::string &filename)
+{
+    using boost::property_tree::detail::rapidasn1::validate;
+    using boost::property_tree::detail::rapidasn1::parse_result;
+    std::vector<char> v = load_file(filename);
+    const Byte *data = (const Byte*)&v[0];
+
+    parse_result result;
+    assert(validate<1>(data, v.size(), result));
+    assert(!validate<1>(data, v.size() - 1, result));
+    assert(result.code == boost::property_tree::detail::rapidasn1::error_overrun && result.where == 4);
+
+    // Indefinite-length groups must be closed
+    unsigned char varlen[] = {0x7F, 0x81, 0x63, 0x80, 0x5F, 0x81, 0x44, 0x01, 0x41, 0x00, 0x00};
+    assert(validate<1>(varlen, sizeof(varlen)));
+    assert(!validate<1>(varlen, sizeof(varlen) - 2, result));
+    assert(result.code == boost::property_tree::detail::rapidasn1::error_missing_end);
+
+    // Same verdicts as the parser
+    boost::property_tree::detail::rapidasn1::asn1_tree<Byte> tree;
+    for (std::size_t size = 0; size < 64; ++size)
+        assert(validate<1>(data, size) == tree.parse<1>(data, size, result));
+}
+
+// Compares two parsed trees; values of groups are compared only if group_values is set
+// and primitive nodes of full are skipped if groups_only is set
+bool same_tree(const boost::property_tree::detail::rapidasn1::asn1_node<Byte> *full,
+               const boost::property_tree::detail::rapidasn1::asn1_node<Byte> *other,
+               bool group_values, bool groups_only)
+{
+    using boost::property_tree::detail::rapidasn1::node_group;
+    const boost::property_tree::detail::rapidasn1::asn1_node<Byte> *a = full->first_node();
+    const boost::property_tree::detail::rapidasn1::asn1_node<Byte> *b = other->first_node();
+    for (; a; a = a->next_sibling())
+    {
+        if (groups_only && a->type() != node_group)
+            continue;
+        if (!b || a->tag() != b->tag() || a->type() != b->type() || a->value_size() != b->value_size())
+            return false;
+        if (a->type() == node_group ? group_values && a->value() != b->value() : a->value() != b->value())
+            return false;
+        if (!group_values && a->type() == node_group && b->value() == a->value())
+            return false;
+        if (!same_tree(a, b, group_values, groups_only))
+            return false;
+        b = b->next_sibling();
+    }
+    return !b;
+}
+
+void test_parse_flags(const std::string &filename)
+{
+    using namespace boost::property_tree::detail::rapidasn1;
+    std::vector<char> v = load_file(filename);
+    const Byte *data = (const Byte*)&v[0];
+
+    asn1_tree<Byte> reference;
+    reference.parse<parse_default>(data, v.size());
+    parse_result result;
+
+    // TAP files use definite lengths only
+    asn1_tree<Byte> tree;
+    assert(tree.parse<parse_definite_only>(data, v.size(), result));
+    assert(same_tree(&reference, &tree, true, false));
+    unsigned char varlen[] = {0x7F, 0x81, 0x63, 0x80, 0x5F, 0x81, 0x44, 0x01, 0x41, 0x00, 0x00};
+    assert(!tree.parse<parse_definite_only>(varlen, sizeof(varlen), result));
+    assert(result.code == error_bad_length && result.where == 3);
+    assert(!validate<parse_definite_only>(varlen, sizeof(varlen), result));
+    assert(result.code == error_bad_length);
+
+    // Checked data parses the same without bounds checks
+    assert(validate<parse_default>(data, v.size()));
+    tree.clear();
+    assert(tree.parse<parse_non_validating>(data, v.size(), result));
+    assert(same_tree(&reference, &tree, true, false));
+    assert(validate<parse_non_validating>(data, v.size()));
+
+    tree.clear();
+    assert(tree.parse<parse_fastest>(data, v.size(), result));
+    assert(same_tree(&reference, &tree, false, false));
+
+    // Group nodes only
+    tree.clear();
+    assert(tree.parse<parse_structure_only>(data, v.size(), result));
+    assert(same_tree(&reference, &tree, true, true));
+
+    // TAP tags above 30 need several octets
+    tree.clear();
+    assert(!tree.parse<parse_single_byte_tags>(data, v.size(), result));
+    assert(result.code == error_bad_tag);
+    assert(!validate<parse_single_byte_tags>(data, v.size(), result));
+    assert(result.code == error_bad_tag);
+    unsigned char small[] = {0x30, 0x06, 0x02, 0x01, 0x05, 0x04, 0x01, 0x41};
+    assert(tree.parse<parse_single_byte_tags | parse_definite_only>(small, sizeof(small), result));
+    assert(tree.first_node()->tag() == 16 && tree.first_node()->last_node()->tag() == 4);
+    assert(validate<parse_single_byte_tags | parse_non_validating>(small, sizeof(small)));
+    unsigned char escape[] = {0x1F, 0x01, 0x41, 0x00};
+    assert(!tree.parse<parse_single_byte_tags>(escape, sizeof(escape), result));
+    assert(result.code == error_bad_tag && result.where == 0);
+    assert(!validate<parse_single_byte_tags>(escape, sizeof(escape), result));
+    assert(result.code == error_bad_tag);
+}
+
+void test_tap_rules(const std::string &filename)
+{
+    using namespace boost::property_tree::asn1_parser::tap_parser;
+    std::vector<char> v = load_file(filename);
+    const Byte *data = (const Byte*)&v[0];
+
+    boost::property_tree::detail::rapidasn1::parse_result result;
+    std::vector<tap_rule_failure> failures;
+    tap_validator<3, 11> validator;
+    assert(validator.run(data, v.size(), failures, result) && result.ok() && failures.empty());
+
+    // A negative charge in the first call event breaks its range and the batch total
+    std::vector<char> bad(v);
+    bad[869] = (char)0xFF;
+    assert(!validator.run((const Byte*)&bad[0], bad.size(), failures, result) && result.ok());
+    assert(failures.size() == 2);
+    assert(failures[0].record == 0 && failures[0].offset == 869 && failures[0].tag == 62 && failures[0].value == -1);
+    assert(failures[1].record == tap_rule_failure::npos && failures[1].tag == 415 && failures[1].value == 23490 - 128);
+    assert(failures[1].rule->kind == rule_total);
+    failures.clear();
+
+    // Declared count off by one
+    bad = v;
+    bad[60146] = (char)0xC4;
+    assert(!validator.run((const Byte*)&bad[0], bad.size(), failures, result));
+    assert(failures.size() == 1 && failures[0].tag == 43 && failures[0].value == 195);
+    failures.clear();
+
+    // Custom rules: a Notification is required, charges are capped at 100
+    tap_rule rules[] = {
+        {rule_mandatory, "TransferBatch", "Notification", 0, 0, 0, 0, 0},
+        {rule_range, 0, "Charge", 0, 100, 0, 0, 0},
+    };
+    tap_validator<3, 11> custom(rules, rules + 2);
+    assert(!custom.run(data, v.size(), failures, result));
+    assert(failures[0].tag == 62 && failures[0].record != tap_rule_failure::npos && failures[0].value > 100);
+    assert((failures.back().tag == find_tap_tag<3, 11>("Notification") && failures.back().offset == 0));
+    failures.clear();
+
+    // Both range rules on TapDecimalPlaces are checked
+    tap_rule ranges[] = {
+        {rule_range, 0, "TapDecimalPlaces", 4, 6, 0, 0, 0},
+        {rule_range, 0, "TapDecimalPlaces", 0, 6, 0, 0, 0},
+    };
+    tap_validator<3, 11> ranged(ranges, ranges + 2);
+    assert(!ranged.run(data, v.size(), failures, result) && failures.size() == 1);
+    assert(failures[0].rule == &ranges[0] && failures[0].value == 3);
+
+    // Malformed BER stops the run
+    assert(!validator.run(data, v.size() - 1, failures, result) && !result.ok());
+}
+
+void test_tap_index(const std::string &filename)
+{
+    using namespace boost::property_tree::asn1_parser::tap_parser;
+    using boost::property_tree::detail::rapidasn1::asn1_tree;
+    using boost::property_tree::detail::rapidasn1::asn1_node;
+    std::vector<char> v = load_file(filename);
+    const Byte *data = (const Byte*)&v[0];
+
+    boost::property_tree::detail::rapidasn1::parse_result result;
+    std::vector<tap_index_entry> entries;
+    assert((build_tap_index<3, 11>(data, v.size(), 0, entries, result)));
+    assert(entries.size() == 195 && entries[0].keys == 0);
+    assert((build_tap_index<3, 11>(data, v.size(), index_imsi | index_start_time, entries, result)));
+    assert(entries.size() == 195);
+
+    // Same records as the full parse
+    asn1_tree<Byte> tree;
+    tree.parse<1>(data, v.size());
+    const asn1_node<Byte> *list = find_tap_node<3, 11>(tree, "TransferBatch.CallEventDetailList");
+    std::size_t i = 0;
+    for (const asn1_node<Byte> *call = list->first_node(); call; call = call->next_sibling(), ++i)
+        assert(call->tag() == entries[i].tag);
+    assert(i == entries.size());
+
+    write_tap_index<3, 11>(filename + ".idx", entries, v.size());
+    tap_index_reader<3, 11> reader(filename, filename + ".idx");
+    assert(reader.size() == 195);
+
+    // Decode the last call event alone and compare it with the full parse
+    asn1_tree<Byte> one;
+    asn1_node<Byte> *call = reader.decode(one, 194);
+    assert(call->tag() == list->last_node()->tag());
+    assert(call->value_size() == list->last_node()->value_size());
+    assert(std::memcmp(call->value(), list->last_node()->value(), call->value_size()) == 0);
+
+    // Keys
+    std::string imsi = reader[194].get_imsi();
+    assert(imsi.size() == 15 && reader[194].get_start_time().size() == 14);
+    std::size_t found = reader.find_imsi(imsi);
+    assert(found != reader.npos && reader[found].get_imsi() == imsi);
+    assert(reader.find_imsi("999999999999999") == reader.npos);
+
+    // An entry reaching past the end of the batch is refused
+    tap_index_entry last = entries[194];
+    entries[194].size = static_cast<boost::uint32_t>(v.size() - last.offset + 1);
+    write_tap_index<3, 11>(filename + ".idx", entries, v.size());
+    bool thrown = false;
+    try
+    {
+        tap_index_reader<3, 11> broken(filename, filename + ".idx");
+    }
+    catch (boost::property_tree::asn1_parser::asn1_parser_error &e)
+    {
+        assert(e.offset() == sizeof(tap_index_header) + 194 * sizeof(tap_index_entry));
+        thrown = true;
+    }
+    assert(thrown);
+
+    // A call event that does not parse is reported at its position in the batch
+    entries[194].size = last.size - 1;
+    write_tap_index<3, 11>(filename + ".idx", entries, v.size());
+    tap_index_reader<3, 11> short_reader(filename, filename + ".idx");
+    thrown = false;
+    try
+    {
+        asn1_tree<Byte> tree;
+        short_reader.decode(tree, 194);
+    }
+    catch (boost::property_tree::asn1_parser::asn1_parser_error &e)
+    {
+        // The content, after a 1 byte tag and a 3 byte length, overruns the entry
+        assert(e.offset() == last.offset + 4);
+        thrown = true;
+    }
+    assert(thrown);
+    std::remove((filename + ".idx").c_str());
+}
+
+void test_scan_siblings(const std::string &filename)
+{
+    using namespace boost::property_tree::asn1_parser::tap_parser;
+    using namespace boost::property_tree::detail::rapidasn1;
+    std::vector<char> v = load_file(filename);
+    const Byte *data = (const Byte*)&v[0];
+
+    // Jumping over headers finds the call events of the full walk
+    parse_result result;
+    std::vector<tap_index_entry> walked, scanned;
+    assert((build_tap_index<3, 11>(data, v.size(), index_imsi, walked, result)));
+    assert((build_tap_index<3, 11>(data, v.size(), 0, scanned, result)));
+    std::vector<std::size_t> offsets;
+    assert((scan_call_events<3, 11>(data, v.size(), offsets, result)));
+    assert(offsets.size() == walked.size() && scanned.size() == walked.size());
+    for (std::size_t i = 0; i < walked.size(); ++i)
+    {
+        assert(offsets[i] == walked[i].offset && scanned[i].offset == walked[i].offset);
+        assert(scanned[i].size == walked[i].size && scanned[i].tag == walked[i].tag);
+    }
+
+    // Cross-check against CallEventDetailsCount
+    std::size_t count = 0;
+    assert((count_call_events<3, 11>(data, v.size(), count, result)));
+    asn1_tree<Byte> tree;
+    tree.parse<parse_default>(data, v.size());
+    asn1_node<Byte> *declared = find_tap_node<3, 11>(tree, "TransferBatch.AuditControlInfo.CallEventDetailsCount");
+    assert((count == (std::size_t)boost::property_tree::asn1_parser::binary2Int<parse_default>(declared->value(), declared->value_size())));
+    assert(count == 195);
+    assert((!count_call_events<3, 11>(data, v.size() - 1, count, result)));
+    assert(result.code == error_overrun);
+
+    // End-of-contents markers are found by structure, not inside values
+    unsigned char varlen[] = {0x30, 0x80, 0x04, 0x02, 0x00, 0x00, 0x30, 0x80, 0x02, 0x01, 0x05, 0x00, 0x00,
+                              0x00, 0x00, 0x04, 0x01, 0x41, 0x00, 0x00, 0x04, 0x01, 0x42};
+    std::size_t end = 0;
+    offsets.clear();
+    assert(scan_siblings<parse_default>(varlen, sizeof(varlen), offsets, end, result));
+    assert(offsets.size() == 2 && offsets[0] == 0 && offsets[1] == 15 && end == 20);
+    assert(count_siblings<parse_default>(varlen + end, sizeof(varlen) - end, count, end, result));
+    assert(count == 1 && end == 3);
+    assert(!count_siblings<parse_default>(varlen, 13, count, end, result));
+    assert(result.code == error_missing_end);
+}
+
+void test_tap_aggregate(const std::string &filename)
+{
+    using namespace boost::property_tree::asn1_parser::tap_parser;
+    using boost::property_tree::detail::rapidasn1::asn1_tree;
+    using boost::property_tree::detail::rapidasn1::asn1_node;
+    std::vector<char> v = load_file(filename);
+    const Byte *data = (const Byte*)&v[0];
+    boost::property_tree::detail::rapidasn1::parse_result result;
+
+    tap_aggregation<3, 11> spec;
+    spec.group_by("Imsi")
+        .aggregate("ChargeDetail.Charge", aggregate_sum)
+        .aggregate("TotalCallEventDuration", aggregate_max)
+        .aggregate("DataVolumeIncoming", aggregate_count);
+    tap_aggregate_table table;
+    assert(spec.run(data, v.size(), table, result));
+
+    // Compare with the decoded tree
+    asn1_tree<Byte> tree;
+    tree.parse<1>(data, v.size());
+    const asn1_node<Byte> *list = find_tap_node<3, 11>(tree, "TransferBatch.CallEventDetailList");
+    long long charges = 0;
+    std::vector<const asn1_node<Byte>*> stack(1, list);
+    while (!stack.empty())
+    {
+        const asn1_node<Byte> *node = stack.back();
+        stack.pop_back();
+        for (const asn1_node<Byte> *child = node->first_node(); child; child = child->next_sibling())
+        {
+            if (child->tag() == 62 && node->tag() == 63)
+                charges += boost::property_tree::asn1_parser::binary2Int<0>(child->value(), child->value_size());
+            stack.push_back(child);
+        }
+    }
+    long long records = 0, sum = 0, gprs = 0;
+    for (std::size_t g = 0; g < table.size(); ++g)
+    {
+        records += table.count(g);
+        sum += table.value(g, 0);
+        gprs += table.value(g, 2);
+        assert(spec.key(table, g, 0).size() >= 14);
+    }
+    assert(records == 195 && sum == charges && gprs > 0);
+
+    // Per-record partial tables merge into the same result
+    std::vector<tap_index_entry> entries;
+    assert((build_tap_index<3, 11>(data, v.size(), 0, entries, result)));
+    tap_aggregate_table halves[2];
+    for (std::size_t i = 0; i < entries.size(); ++i)
+        assert(spec.accumulate(data + entries[i].offset, entries[i].size, halves[i % 2], result));
+    tap_aggregate_table merged;
+    merged.merge(halves[0]);
+    merged.merge(halves[1]);
+    merged.merge(tap_aggregate_table());
+    assert(merged.size() == table.size());
+    for (std::size_t g = 0; g < merged.size(); ++g)
+    {
+        std::size_t h = 0;
+        while (table.raw_key(h) != merged.raw_key(g))
+            ++h;
+        assert(merged.count(g) == table.count(h));
+        assert(merged.value(g, 0) == table.value(h, 0) && merged.value(g, 1) == table.value(h, 1));
+    }
+
+    // Counts per CallTypeLevel1
+    tap_aggregation<3, 11> by_type;
+    by_type.group_by("CallTypeLevel1");
+    tap_aggregate_table types;
+    assert(by_type.run(data, v.size(), types, result));
+    records = 0;
+    for (std::size_t g = 0; g < types.size(); ++g)
+        records += types.count(g);
+    assert(records == 195 && types.size() < 10);
+}
+
+struct Moc
+{
+    long long charge;
+    char imsi[16];
+    long long duration;
+    char msisdn[8];
+    boost::int64_t start;
+    boost::property_tree::detail::tap_parser::tap_rec_entity location;
+    boost::property_tree::detail::tap_parser::tap_exchange_rate rate;
+};
+
+namespace boost { namespace property_tree { namespace detail { namespace tap_parser {
+    template<> struct tap_record_traits<Moc>
+    {
+        template<class Binder> static void bind(Binder &b)
+        {
+            b.record("MobileOriginatedCall");
+            b("Imsi", &Moc::imsi);
+            b("ChargeDetail.Charge", &Moc::charge);
+            b("TotalCallEventDuration", &Moc::duration);
+            b("Msisdn", &Moc::msisdn);
+            b.utc_time("CallEventStartTimeStamp", &Moc::start);
+            b.resolve("NetworkLocation.RecEntityCode", &Moc::location);
+            b.resolve("ChargeInformation.ExchangeRateCode", &Moc::rate);
+        }
+    };
+}}}}
+
+void test_tap_bind(const std::string &filename)
+{
+    using namespace boost::property_tree::asn1_parser::tap_parser;
+    using boost::property_tree::detail::rapidasn1::asn1_tree;
+    using boost::property_tree::detail::rapidasn1::asn1_node;
+    std::vector<char> v = load_file(filename);
+    const Byte *data = (const Byte*)&v[0];
+    boost::property_tree::detail::rapidasn1::parse_result result;
+
+    std::vector<Moc> mocs;
+    assert((read_tap_records<3, 11>(data, v.size(), mocs, result)));
+    tap_references references;
+    assert((build_tap_references<3, 11>(data, v.size(), references, result)));
+
+    asn1_tree<Byte> tree;
+    tree.parse<1>(data, v.size());
+    const asn1_node<Byte> *list = find_tap_node<3, 11>(tree, "TransferBatch.CallEventDetailList");
+    std::size_t i = 0;
+    for (const asn1_node<Byte> *call = list->first_node(9); call; call = call->next_sibling(9), ++i)
+    {
+        assert(i < mocs.size());
+        const asn1_node<Byte> *imsi = find_tap_node<3, 11>(*call, "MoBasicCallInformation.ChargeableSubscriber.SimChargeableSubscriber.Imsi");
+        assert(imsi);
+        assert(boost::property_tree::asn1_parser::binary2BCDString<0>(imsi->value(), imsi->value_size()) == mocs[i].imsi);
+        const asn1_node<Byte> *duration = find_tap_node<3, 11>(*call, "MoBasicCallInformation.TotalCallEventDuration");
+        assert(boost::property_tree::asn1_parser::binary2Int<0>(duration->value(), duration->value_size()) == mocs[i].duration);
+        assert(std::strlen(mocs[i].msisdn) <= 7);
+        // UtcTimeOffsetCode 0 is +0430 in NetworkInfo
+        const asn1_node<Byte> *start = find_tap_node<3, 11>(*call, "MoBasicCallInformation.CallEventStartTimeStamp.LocalTimeStamp");
+        boost::int64_t local = 0;
+        assert(local_time_seconds(start->value(), start->value_size(), local));
+        assert(mocs[i].start == local - 16200);
+        // Codes resolved inline as by the tables of the header sections
+        const asn1_node<Byte> *code = find_tap_node<3, 11>(*call, "LocationInformation.NetworkLocation.RecEntityCode");
+        const tap_rec_entity *entity = references.rec_entities.find(boost::property_tree::asn1_parser::binary2Int<0>(code->value(), code->value_size()));
+        assert(entity && mocs[i].location.type == entity->type && std::strcmp(mocs[i].location.id, entity->id) == 0);
+        assert(mocs[i].rate.exchange_rate == 154161 && mocs[i].rate.decimal_places == 5);
+    }
+    assert(i == mocs.size() && i > 0);
+    assert(mocs[0].start == 1402586799 - 16200);
+}
+
+void test_tap_time()
+{
+    using namespace boost::property_tree::asn1_parser::tap_parser;
+    boost::int64_t seconds = -1;
+    assert(local_time_seconds("19700101000000", 14, seconds) && seconds == 0);
+    assert(local_time_seconds("20140613021147", 14, seconds) && seconds == 1402625507);
+    assert(local_time_seconds("20000229235959", 14, seconds) && seconds == 951868799);
+    assert(!local_time_seconds("2014061302114x", 14, seconds));
+    assert(!local_time_seconds("20141313021147", 14, seconds));
+    assert(!local_time_seconds("20140631021147", 14, seconds));
+    assert(!local_time_seconds("20140229021147", 14, seconds));
+    assert(!local_time_seconds("19000229021147", 14, seconds));
+    assert(!local_time_seconds("00000101000000", 14, seconds));
+    assert(local_time_seconds("20141231235959", 14, seconds) && seconds == 1420070399);
+    assert(local_time_seconds("00010101000000", 14, seconds) && seconds == -62135596800LL);
+    assert(!local_time_seconds("201406130211", 12, seconds));
+    boost::int32_t offset = 0;
+    assert(utc_offset_seconds("+0430", 5, offset) && offset == 16200);
+    assert(utc_offset_seconds("-0130", 5, offset) && offset == -5400);
+    assert(!utc_offset_seconds("0430", 4, offset));
+
+    tap_utc_offsets offsets;
+    offsets.set(3, 3600);
+    assert(offsets.find(3) && *offsets.find(3) == 3600);
+    assert(!offsets.find(2) && !offsets.find(4) && !offsets.find(-1));
+}
+
+void test_tap_references(const std::string &filename)
+{
+    using namespace boost::property_tree::asn1_parser::tap_parser;
+    std::vector<char> v = load_file(filename);
+    boost::property_tree::detail::rapidasn1::parse_result result;
+    tap_references references;
+    assert((build_tap_references<3, 11>((const Byte*)&v[0], v.size(), references, result)));
+
+    const tap_exchange_rate *rate = references.exchange_rates.find(0);
+    assert(rate && rate->exchange_rate == 154161 && rate->decimal_places == 5);
+    assert(!references.exchange_rates.find(1));
+    const tap_taxation *taxation = references.taxations.find(3);
+    assert(taxation && std::string(taxation->tax_type) == "01" && std::string(taxation->charge_type) == "03");
+    assert(std::string(references.taxations.find(1)->charge_type).empty());
+    const tap_rec_entity *entity = references.rec_entities.find(1);
+    assert(entity && entity->type == 3 && std::string(entity->id) == "61.5.196.68");
+    assert(references.rec_entities.find(7) && !references.rec_entities.find(8));
+    assert(references.utc_offsets.find(0) && *references.utc_offsets.find(0) == 16200);
+    assert(!references.message_descriptions.find(0));
+}
+
+void test_memory_pool(const std::string &filename)
+{
+    using namespace boost::property_tree::asn1_parser::tap_parser;
+    using boost::property_tree::detail::rapidasn1::asn1_tree;
+    std::vector<char> v = load_file(filename);
+    const Byte *data = (const Byte*)&v[0];
+
+    asn1_tree<Byte> reference;
+    reference.parse<1>(data, v.size());
+    std::ostringstream expected;
+    write_tap_dump<3, 11>(expected, reference);
+
+    // Small growing blocks, then mapped blocks on huge pages
+    asn1_tree<Byte> growing;
+    growing.set_block_size(1024, 2, 64 * 1024);
+    asn1_tree<Byte> mapped;
+    mapped.set_block_size(256 * 1024);
+    mapped.set_options(boost::property_tree::detail::rapidasn1::pool_huge_pages |
+                       boost::property_tree::detail::rapidasn1::pool_numa_local);
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        growing.parse<1>(data, v.size());
+        mapped.parse<1>(data, v.size());
+        std::ostringstream a, b;
+        write_tap_dump<3, 11>(a, growing);
+        write_tap_dump<3, 11>(b, mapped);
+        assert(a.str() == expected.str() && b.str() == expected.str());
+        growing.clear();
+        mapped.clear();
+    }
+}
+
+// Lists "path=value" of every leaf; trans_asn1_ptree orders siblings by tag, so lists are compared sorted
+void list_leaves(const boost::property_tree::ptree &pt, const std::string &path, std::vector<std::string> &out)
+{
+    for (boost::property_tree::ptree::const_iterator it = pt.begin(); it != pt.end(); ++it)
+        if (it->second.empty())
+            out.push_back(path + "." + it->first + "=" + it->second.data());
+        else
+            list_leaves(it->second, path + "." + it->first, out);
+}
+
+void list_leaves(const boost::property_tree::asn1_parser::tap_parser::tap_node &node, const std::string &path, std::vector<std::string> &out)
+{
+    for (const boost::property_tree::asn1_parser::tap_parser::tap_node *child = node.first_node(); child; child = child->next_sibling())
+        if (!child->first_node())
+            out.push_back(path + "." + child->name() + "=" + child->data());
+        else
+            list_leaves(*child, path + "." + child->name(), out);
+}
+
+void test_tap_tree(const std::string &filename)
+{
+    using namespace boost::property_tree::asn1_parser::tap_parser;
+    using boost::property_tree::detail::rapidasn1::asn1_tree;
+    std::vector<char> v = load_file(filename);
+    const Byte *data = (const Byte*)&v[0];
+
+    boost::property_tree::ptree pt, new_pt;
+    boost::property_tree::asn1_parser::read_asn1(data, v.size(), pt);
+    trans_asn1_ptree<3, 11>(pt, new_pt);
+
+    tap_tree tree;
+    {
+        asn1_tree<Byte> ber;
+        ber.parse<1>(data, v.size());
+        trans_asn1_tree<3, 11>(ber, tree);
+    }
+    std::vector<std::string> expected, leaves;
+    list_leaves(new_pt, "", expected);
+    list_leaves(tree, "", leaves);
+    std::sort(expected.begin(), expected.end());
+    std::sort(leaves.begin(), leaves.end());
+    assert(leaves == expected);
+
+    assert(tree.get("TransferBatch.BatchControlInfo.Sender") == "AFGAW");
+    assert(tree.get("TransferBatch.BatchControlInfo.SpecificationVersionNumber") == "3");
+    assert(tree.get("TransferBatch.AuditControlInfo.TotalCharge") == "23490");
+    const tap_node *list = tree.find_node("TransferBatch.CallEventDetailList");
+    const tap_node *second = list->first_node("MobileOriginatedCall")->next_sibling("MobileOriginatedCall");
+    assert(tree.find_node("TransferBatch.CallEventDetailList.MobileOriginatedCall(2)") == second);
+    assert(second->get("MoBasicCallInformation.ChargeableSubscriber.SimChargeableSubscriber.Imsi").size() == 15);
+    assert(tree.get("TransferBatch.Missing", "none") == "none");
+    tree.clear();
+    assert(!tree.first_node());
+}
+
+bool same_tap_tree(const boost::property_tree::asn1_parser::tap_parser::tap_node &a,
+                   const boost::property_tree::asn1_parser::tap_parser::tap_node &b)
+{
+    const boost::property_tree::asn1_parser::tap_parser::tap_node *x = a.first_node(), *y = b.first_node();
+    for (; x && y; x = x->next_sibling(), y = y->next_sibling())
+        if (x->element() != y->element() || x->data() != y->data() || x->integer() != y->integer() ||
+            !same_tap_tree(*x, *y))
+            return false;
+    return !x && !y;
+}
+
+void test_decode_tap(const std::string &filename)
+{
+    using namespace boost::property_tree::asn1_parser::tap_parser;
+    using boost::property_tree::detail::rapidasn1::asn1_tree;
+    using boost::property_tree::detail::rapidasn1::parse_result;
+    std::vector<char> v = load_file(filename);
+    const Byte *data = (const Byte*)&v[0];
+
+    tap_tree expected, tree;
+    asn1_tree<Byte> ber;
+    ber.parse<1>(data, v.size());
+    trans_asn1_tree<3, 11>(ber, expected);
+    parse_result result;
+    assert((decode_tap<3, 11>(data, v.size(), tree, result)));
+    assert(same_tap_tree(expected, tree));
+    assert(tree.get("TransferBatch.AuditControlInfo.TotalCharge") == "23490");
+    assert(tree.find_node("TransferBatch.AuditControlInfo.TotalCharge")->integer() == 23490);
+
+    // An empty Integer is 0, as is one longer than 8 octets
+    unsigned char empty_integer[] = {0x5F, 0x83, 0x1F, 0x00};
+    ber.parse<1>(empty_integer, sizeof(empty_integer));
+    trans_asn1_tree<3, 11>(ber, expected);
+    assert((decode_tap<3, 11>(empty_integer, sizeof(empty_integer), tree, result)));
+    assert(same_tap_tree(expected, tree));
+    assert(expected.get("TotalCharge", "none") == "0");
+
+    // Indefinite lengths and an unknown tag
+    unsigned char varlen[] = {0x61, 0x80, 0x64, 0x80, 0x9F, 0x87, 0x68, 0x01, 0x00,
+                              0x5F, 0x81, 0x44, 0x02, 'A', 'B', 0x00, 0x00, 0x00, 0x00};
+    assert((decode_tap<3, 11>(varlen, sizeof(varlen), tree, result)));
+    assert(tree.get("TransferBatch.BatchControlInfo.Sender") == "AB");
+    assert(!tree.find_node("TransferBatch.BatchControlInfo")->first_node()->next_sibling());
+
+    assert((!decode_tap<3, 11>(data, v.size() - 1, tree, result)));
+    assert(result.code == boost::property_tree::detail::rapidasn1::error_overrun && result.where == 4);
+    assert((!decode_tap<3, 11>(varlen, sizeof(varlen) - 2, tree, result)));
+    assert(result.code == boost::property_tree::detail::rapidasn1::error_missing_end);
+}
+
+void test_tap_key(const std::string &filename)
+{
+    using namespace boost::property_tree::asn1_parser::tap_parser;
+    std::vector<char> v = load_file(filename);
+
+    boost::property_tree::ptree pt, new_pt;
+    boost::property_tree::asn1_parser::read_asn1((const Byte*)&v[0], v.size(), pt);
+    trans_asn1_ptree<3, 11>(pt, new_pt);
+
+    tap_ptree<3, 11>::type interned;
+    trans_asn1_ptree<3, 11>(pt, interned);
+
+    assert(interned.get<std::string>("TransferBatch.BatchControlInfo.Sender") == "AFGAW");
+    assert(interned.get<int>("TransferBatch.AuditControlInfo.TotalCharge") == 23490);
+    assert(interned.get<std::string>("TransferBatch.BatchControlInfo.Recipient") ==
+           new_pt.get<std::string>("TransferBatch.BatchControlInfo.Recipient"));
+    assert(!interned.get_optional<std::string>("TransferBatch.NoSuchElement"));
+
+    // Trailing blanks of the table names are optional, in the path as in the table
+    assert(interned.get<std::string>("TransferBatch.BatchControlInfo.Recipient ") ==
+           new_pt.get<std::string>("TransferBatch.BatchControlInfo.Recipient"));
+    assert(interned.get<int>("TransferBatch.BatchControlInfo.SpecificationVersionNumber") ==
+           new_pt.get<int>("TransferBatch.BatchControlInfo.SpecificationVersionNumber "));
+    assert((find_tap_tag<3, 11>("SpecificationVersionNumber ") == 201 && find_tap_tag<3, 11>("Specification") == 0));
+    assert((find_tap_tag<3, 11>("TransferBatch") == 1 && find_tap_tag<3, 11>("") == 0));
+
+    // Keys are the table entries themselves
+    const tap_ptree<3, 11>::type &batch = interned.get_child("TransferBatch");
+    assert((batch.begin()->first.element() == find_tap_element<3, 11>(batch.begin()->first.id())));
+    assert((batch.count(tap_key<3, 11>(find_tap_element<3, 11>(4))) == 1));
+
+    std::size_t count = 0;
+    const tap_ptree<3, 11>::type &list = interned.get_child("TransferBatch.CallEventDetailList");
+    for (tap_ptree<3, 11>::type::const_iterator it = list.begin(); it != list.end(); ++it)
+        if (it->first.name() == "MobileOriginatedCall")
+            ++count;
+    assert(count == new_pt.get_child("TransferBatch.CallEventDetailList").count("MobileOriginatedCall"));
+}
+
+std::vector<unsigned char> deflate_data(const std::vector<char> &v, int window)
+{
+    z_stream z;
+    std::memset(&z, 0, sizeof(z));
+    deflateInit2(&z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, window, 8, Z_DEFAULT_STRATEGY);
+    std::vector<unsigned char> out(deflateBound(&z, v.size()) + 32);
+    z.next_in = (Bytef*)&v[0];
+    z.avail_in = v.size();
+    z.next_out = &out[0];
+    z.avail_out = out.size();
+    deflate(&z, Z_FINISH);
+    out.resize(z.total_out);
+    deflateEnd(&z);
+    return out;
+}
+
+void test_read_compressed(const std::string &filename)
+{
+    std::vector<char> v = load_file(filename);
+    boost::property_tree::ptree expected;
+    boost::property_tree::asn1_parser::read_asn1((const Byte*)&v[0], v.size(), expected);
+
+    std::vector<std::string> files;
+    files.push_back(filename);
+    write_file(filename + ".gz", deflate_data(v, 15 + 16));
+    files.push_back(filename + ".gz");
+    write_file(filename + ".z", deflate_data(v, 15));
+    files.push_back(filename + ".z");
+
+    // Single entry zip: local file header, then raw deflate data
+    std::vector<unsigned char> zip(30, 0);
+    zip[0] = 'P'; zip[1] = 'K'; zip[2] = 3; zip[3] = 4;
+    zip[8] = 8;
+    zip[26] = 4;
+    zip.insert(zip.end(), "data", "data" + 4);
+    std::vector<unsigned char> raw = deflate_data(v, -15);
+    zip.insert(zip.end(), raw.begin(), raw.end());
+    write_file(filename + ".zip", zip);
+    files.push_back(filename + ".zip");
+
+    std::vector<unsigned char> xz(lzma_stream_buffer_bound(v.size()));
+    std::size_t xz_size = 0;
+    lzma_easy_buffer_encode(6, LZMA_CHECK_CRC64, 0, (const uint8_t*)&v[0], v.size(), &xz[0], &xz_size, xz.size());
+    xz.resize(xz_size);
+    write_file(filename + ".xz", xz);
+    files.push_back(filename + ".xz");
+
+#if defined(BOOST_PROPERTY_TREE_ASN1_USE_ZSTD)
+    std::vector<unsigned char> zst(ZSTD_compressBound(v.size()));
+    zst.resize(ZSTD_compress(&zst[0], zst.size(), &v[0], v.size(), 3));
+    write_file(filename + ".zst", zst);
+    files.push_back(filename + ".zst");
+#endif
+
+    for (std::size_t i = 0; i < files.size(); ++i)
+    {
+        boost::property_tree::ptree pt;
+        boost::property_tree::asn1_parser::read_asn1_compressed(files[i], pt);
+        assert(pt == expected);
+    }
+
+    // Truncated compressed data is reported
+    std::vector<unsigned char> gz = deflate_data(v, 15 + 16);
+    gz.resize(gz.size() / 2);
+    write_file(filename + ".gz", gz);
+    bool thrown = false;
+    try
+    {
+        boost::property_tree::ptree pt;
+        boost::property_tree::asn1_parser::read_asn1_compressed(filename + ".gz", pt);
+    }
+    catch (boost::property_tree::asn1_parser::asn1_parser_error &)
+    {
+        thrown = true;
+    }
+    assert(thrown);
+
+    // So is a stream cut before its end when the data is not sized up front: an indefinite length,
+    // whose octets all decode, with the gzip trailer or the xz index missing
+    const unsigned char varlen[] = {0x61, 0x80, 0x5F, 0x81, 0x44, 0x02, 'A', 'B', 0x00, 0x00};
+    std::vector<char> varlen_data(varlen, varlen + sizeof(varlen));
+    gz = deflate_data(varlen_data, 15 + 16);
+    xz.resize(lzma_stream_buffer_bound(sizeof(varlen)));
+    xz_size = 0;
+    lzma_easy_buffer_encode(6, LZMA_CHECK_CRC64, 0, varlen, sizeof(varlen), &xz[0], &xz_size, xz.size());
+    xz.resize(xz_size);
+    std::vector<unsigned char> *streams[] = {&gz, &xz};
+    for (std::size_t i = 0; i < 2; ++i)
+    {
+        std::string name = filename + (i ? ".xz" : ".gz");
+        write_file(name, *streams[i]);
+        {
+            boost::property_tree::asn1_parser::decompressing_source source(name);
+            assert(source.size() == sizeof(varlen) && !source.error());
+        }
+        streams[i]->resize(streams[i]->size() - (i ? 12 : 8));
+        write_file(name, *streams[i]);
+        boost::property_tree::asn1_parser::decompressing_source source(name);
+        assert(source.size() == sizeof(varlen));
+        assert(source.error() && std::string(source.error()) == "truncated compressed data");
+    }
+
+    // Errors are positioned in the decompressed data
+    const unsigned char broken[] = {0x61, 0x06, 0x5F, 0x81, 0x01, 0x05, 0x01, 0x02};
+    write_file(filename + ".gz", deflate_data(std::vector<char>(broken, broken + sizeof(broken)), 15 + 16));
+    thrown = false;
+    try
+    {
+        boost::property_tree::ptree pt;
+        boost::property_tree::asn1_parser::read_asn1_compressed(filename + ".gz", pt);
+    }
+    catch (boost::property_tree::asn1_parser::asn1_parser_error &e)
+    {
+        // The Imsi value claims 5 bytes where 2 are left
+        assert(e.offset() == 6);
+        thrown = true;
+    }
+    assert(thrown);
+
+    // A length the file cannot hold is not allocated up front
+    const unsigned char huge[] = {0x61, 0x84, 0x40, 0x00, 0x00, 0x00, 0x01, 0x02};
+    std::vector<char> huge_data(huge, huge + sizeof(huge));
+    write_file(filename + ".gz", deflate_data(huge_data, 15 + 16));
+    write_file(filename + ".huge", std::vector<unsigned char>(huge, huge + sizeof(huge)));
+    const std::string huge_files[] = {filename + ".gz", filename + ".huge"};
+    for (std::size_t i = 0; i < 2; ++i)
+    {
+        boost::property_tree::asn1_parser::decompressing_source source(huge_files[i]);
+        assert(source.size() == sizeof(huge));
+        thrown = false;
+        try
+        {
+            boost::property_tree::ptree pt;
+            boost::property_tree::asn1_parser::read_asn1_compressed(huge_files[i], pt);
+        }
+        catch (boost::property_tree::asn1_parser::asn1_parser_error &e)
+        {
+            assert(e.offset() == 6);
+            thrown = true;
+        }
+        assert(thrown);
+    }
+    std::remove((filename + ".huge").c_str());
+
+    for (std::size_t i = 1; i < files.size(); ++i)
+        std::remove(files[i].c_str());
+}
+
+void test_async_reader(const std::string &filename)
+{
+    using namespace boost::property_tree::asn1_parser;
+    std::vector<char> v = load_file(filename);
+    boost::property_tree::ptree expected;
+    read_asn1((const Byte*)&v[0], v.size(), expected);
+
+    std::vector<std::string> files(3, filename);
+    files.insert(files.begin() + 1, filename + ".missing");
+    async_reader reader(files, 2);
+    std::size_t read = 0, failed = 0;
+    while (1)
+    {
+        boost::property_tree::ptree pt;
+        try
+        {
+            if (!read_asn1(reader, pt))
+                break;
+        }
+        catch (asn1_parser_error &)
+        {
+            ++failed;
+            continue;
+        }
+        assert(reader.size() == v.size());
+        assert(pt == expected);
+        ++read;
+    }
+    assert(read == 3 && failed == 1);
+    assert(reader.backend() != async_stream);
+
+    // Destroying a reader with files still queued stops its thread
+    async_reader unused(files, 3);
+}
+
+// Handler of for_each_call_event() checking each call event against the batch in memory
+struct call_event_checker
+{
+    const std::vector<char> *batch;
+    std::vector<boost::uint64_t> offsets;
+
+    explicit call_event_checker(const std::vector<char> *batch)
+        : batch(batch)
+    {
+    }
+
+    bool operator()(boost::uint64_t offset, const unsigned char *data, std::size_t size)
+    {
+        if (batch)
+            assert(offset + size <= batch->size() && std::memcmp(&(*batch)[offset], data, size) == 0);
+        offsets.push_back(offset);
+        return true;
+    }
+};
+
+void test_large_file(const std::string &filename)
+{
+    using namespace boost::property_tree::asn1_parser;
+    using namespace boost::property_tree::asn1_parser::tap_parser;
+    using namespace boost::property_tree::detail::rapidasn1;
+
+    // Lengths of up to 8 octets
+    unsigned char long_length[] = {0x04, 0x88, 0, 0, 0, 0, 0, 0, 0, 3, 'a', 'b', 'c'};
+    asn1_tree<Byte> tree;
+    parse_result result;
+    assert(tree.parse<parse_default>(long_length, sizeof(long_length), result));
+    assert(tree.first_node()->value_size() == 3);
+    unsigned char too_long[] = {0x04, 0x89, 0, 0, 0, 0, 0, 0, 0, 0, 3, 'a', 'b', 'c'};
+    assert(!tree.parse<parse_default>(too_long, sizeof(too_long), result));
+    assert(result.code == error_bad_length && result.where == 1);
+    unsigned char huge[] = {0x64, 0x88, 0x01, 0, 0, 0, 0, 0, 0, 0};
+    std::size_t tag = 0;
+    boost::uint64_t len = 0;
+    int is_varlen = 0;
+    parse_code code = error_none;
+    assert((boost::property_tree::detail::rapidasn1::internal::decode_header<parse_default>(huge, sizeof(huge), tag, len, is_varlen, code) == 10));
+    assert(tag == 4 && len == (1ULL << 56) && !is_varlen);
+
+    // A small window finds the call events of the in-memory scan
+    std::vector<char> v = load_file(filename);
+    std::vector<std::size_t> offsets;
+    assert((scan_call_events<3, 11>((const Byte*)&v[0], v.size(), offsets, result)));
+    mapped_file file(filename, 4096);
+    assert(file.size() == v.size());
+    call_event_checker checker(&v);
+    assert((for_each_call_event<3, 11>(file, checker) == 195));
+    assert(checker.offsets.size() == offsets.size());
+    for (std::size_t i = 0; i < offsets.size(); ++i)
+        assert(checker.offsets[i] == offsets[i]);
+
+    // Sparse batch above 4 GB: BatchControlInfo is jumped over by its 8-octet length,
+    // then an indefinite-length CallEventDetailList holds the first call event
+    const boost::uint64_t skipped = (1ULL << 32) + 100;
+    std::vector<unsigned char> head;
+    head.push_back(0x61);
+    head.push_back(0x80);
+    head.push_back(0x64);
+    head.push_back(0x88);
+    for (int shift = 56; shift >= 0; shift -= 8)
+        head.push_back(static_cast<unsigned char>(skipped >> shift));
+    std::vector<unsigned char> tail;
+    tail.push_back(0x63);
+    tail.push_back(0x80);
+    tail.insert(tail.end(), v.begin() + offsets[0], v.begin() + offsets[1]);
+    // The sparse file goes to a directory of its own under TMPDIR, removed before anything is checked
+    const char *tmp = getenv("TMPDIR");
+    std::string dir = std::string(tmp && *tmp ? tmp : "/tmp") + "/asn1_large_XXXXXX";
+    assert(mkdtemp(&dir[0]));
+    const std::string large = dir + "/" + filename + ".large";
+    bool written = false, thrown = false;
+    boost::uint64_t large_size = 0, error_offset = 0;
+    std::string error_what;
+    call_event_checker large_checker(0);
+    try
+    {
+        {
+            std::ofstream stream(large.c_str(), std::ios::out | std::ios::binary);
+            stream.write((const char*)&head[0], head.size());
+            stream.seekp(static_cast<std::streamoff>(head.size() + skipped));
+            stream.write((const char*)&tail[0], tail.size());
+            written = stream.good();
+        }
+        mapped_file large_file(large, 4096);
+        large_size = large_file.size();
+        try
+        {
+            for_each_call_event<3, 11>(large_file, large_checker);
+        }
+        catch (asn1_parser_error &e)
+        {
+            thrown = true;
+            error_offset = e.offset();
+            error_what = e.what();
+        }
+    }
+    catch (...)
+    {
+        std::remove(large.c_str());
+        rmdir(dir.c_str());
+        throw;
+    }
+    std::remove(large.c_str());
+    rmdir(dir.c_str());
+
+    const boost::uint64_t list = head.size() + skipped;
+    assert(written && large_size == list + tail.size());
+    // Without its end-of-contents marker the list is reported at the end of the file
+    assert(thrown && error_offset == large_size);
+    assert(error_what.find("at offset 4294967") != std::string::npos);
+    assert(large_checker.offsets.size() == 1 && large_checker.offsets[0] == list + 2);
+}
+
+void test_tap_money(const std::string &filename)
+{
+    using namespace boost::property_tree::asn1_parser::tap_parser;
+    std::vector<char> v = load_file(filename);
+    boost::property_tree::detail::rapidasn1::parse_result result;
+    tap_charges charges;
+    assert((read_tap_charges<3, 11>((const Byte*)&v[0], v.size(), charges, result)));
+    assert(charges.tap_decimal_places == 3 && charges.total_charge == 23490 && charges.total_tax_value == 0);
+    assert(charges.size() == charges.call_event.size() && charges.size() > 195);
+    assert(charges.call_event.back() == 194);
+
+    // Charges of ChargeType 00 add up to TotalCharge
+    assert(sum_charges(charges, 62, 0) == charges.total_charge);
+    assert(sum_charges(charges, 397) == charges.total_tax_value);
+
+    // 0.127 SDR at 1.54161 is 0.19578, 0.20 with two decimals
+    assert(charges.amount[0] == 127 && charges.tag[0] == 62 && charges.charge_type[0] == 0);
+    assert(charges.exchange_rate_code[0] == 0);
+    std::vector<boost::int64_t> local;
+    assert(convert_charges(charges, 2, local) == 0);
+    assert(local.size() == charges.size() && local[0] == 20);
+    assert(convert_charges(charges, 8, local) == 0 && local[0] == 19578447);
+
+    // Decimal places out of range and overflowing amounts are not converted
+    tap_charges broken = charges;
+    broken.tap_decimal_places = 40;
+    assert(convert_charges(broken, 2, local) == broken.size() && local[0] == 0);
+    broken.tap_decimal_places = -40;
+    assert(convert_charges(broken, 2, local) == broken.size() && local[0] == 0);
+    broken = charges;
+    broken.amount[0] = (std::numeric_limits<boost::int64_t>::max)();
+    assert(convert_charges(broken, 8, local) == 1 && local[0] == 0);
+
+    std::vector<boost::int64_t> amounts, rescaled;
+    amounts.push_back(1250);
+    amounts.push_back(-1250);
+    amounts.push_back(49);
+    assert(rescale_amounts(amounts, 3, 1, rescaled) == 0);
+    assert(rescaled[0] == 13 && rescaled[1] == -13 && rescaled[2] == 0);
+    assert(rescale_amounts(amounts, 3, 5, rescaled) == 0);
+    assert(rescaled[0] == 125000 && rescaled[1] == -125000);
+
+    // Overflowing amounts, and decimal places too far apart, are rescaled to 0
+    amounts.push_back((std::numeric_limits<boost::int64_t>::max)());
+    amounts.push_back((std::numeric_limits<boost::int64_t>::min)());
+    assert(rescale_amounts(amounts, 3, 5, rescaled) == 2);
+    assert(rescaled[0] == 125000 && rescaled[3] == 0 && rescaled[4] == 0);
+    assert(rescale_amounts(amounts, 5, 3, rescaled) == 0);
+    assert(rescaled[3] == (std::numeric_limits<boost::int64_t>::max)() / 100);
+    assert(rescale_amounts(amounts, 0, 19, rescaled) == amounts.size() && rescaled[0] == 0);
+
+    // A ChargeType that is not numeric is read as -1
+    std::size_t begin, size = v.size();
+    assert((boost::property_tree::detail::tap_parser::internal::find_call_event_list<3, 11>((const Byte*)&v[0], begin, size, result)));
+    const char charge_type[] = {0x5F, 0x47};
+    std::vector<char>::iterator type = std::search(v.begin() + begin, v.end(), charge_type, charge_type + 2);
+    assert(type != v.end() && type[2] == 2);
+    type[3] = 'X';
+    assert((read_tap_charges<3, 11>((const Byte*)&v[0], v.size(), charges, result)));
+    assert(charges.tag[0] == 62 && charges.charge_type[0] == -1);
+}
+
+// Values of the descendants of node with the given tag
+void collect_values(const boost::property_tree::detail::rapidasn1::asn1_node<Byte> *node, std::size_t tag,
+                    std::vector<std::string> &values)
+{
+    for (const boost::property_tree::detail::rapidasn1::asn1_node<Byte> *child = node->first_node(); child; child = child->next_sibling())
+    {
+        if (child->tag() == tag && !child->first_node())
+            values.push_back(std::string((const char *)child->value(), child->value_size()));
+        collect_values(child, tag, values);
+    }
+}
+
+void test_tap_filter(const std::string &filename)
+{
+    using namespace boost::property_tree::asn1_parser::tap_parser;
+    using boost::property_tree::detail::rapidasn1::asn1_tree;
+    using boost::property_tree::detail::rapidasn1::asn1_node;
+    std::vector<char> v = load_file(filename);
+    const Byte *data = (const Byte*)&v[0];
+    boost::property_tree::detail::rapidasn1::parse_result result;
+
+    std::vector<tap_index_entry> entries;
+    assert((build_tap_index<3, 11>(data, v.size(), index_imsi | index_start_time, entries, result)));
+    asn1_tree<Byte> tree;
+    tree.parse<1>(data, v.size());
+    const asn1_node<Byte> *list = find_tap_node<3, 11>(tree, "TransferBatch.CallEventDetailList");
+
+    // No predicate selects every call event
+    std::vector<std::size_t> offsets;
+    tap_filter<3, 11> all;
+    assert(all.select(data, v.size(), offsets, result) && offsets.size() == 195);
+    for (std::size_t i = 0; i < offsets.size(); ++i)
+        assert(offsets[i] == entries[i].offset);
+
+    // Imsi prefix, against the decoded digits
+    std::string prefix = entries[0].get_imsi().substr(0, 9);
+    tap_filter<3, 11> imsi;
+    imsi.bcd_prefix("Imsi", prefix).once();
+    assert(imsi.select(data, v.size(), offsets, result));
+    std::size_t expected = 0;
+    for (std::size_t i = 0, j = 0; i < entries.size(); ++i)
+        if (entries[i].get_imsi().compare(0, prefix.size(), prefix) == 0)
+        {
+            ++expected;
+            assert(j < offsets.size() && offsets[j++] == entries[i].offset);
+        }
+    assert(expected == offsets.size() && expected > 0);
+    tap_filter<3, 11> none, none_once;
+    none.bcd_prefix("Imsi", "999");
+    assert(none.select(data, v.size(), offsets, result) && offsets.empty());
+    none_once.bcd_prefix("Imsi", "999").once();
+    assert(none_once.select(data, v.size(), offsets, result) && offsets.empty());
+
+    // A failing once() predicate rejects the call event without reading the rest of it,
+    // here a group with a truncated value
+    std::vector<unsigned char> call = nested_call_event(0);
+    unsigned char truncated[] = {0x64, 0x04, 0x84, 0x05, 'a', 'b'};
+    call.insert(call.end(), truncated, truncated + sizeof(truncated));
+    call[1] += sizeof(truncated);
+    assert(!none.match(&call[0], call.size(), result) && !result.ok());
+    assert(!none_once.match(&call[0], call.size(), result) && result.ok());
+
+    // Time window on the start time
+    std::string low = entries[10].get_start_time(), high = entries[20].get_start_time();
+    if (high < low)
+        std::swap(low, high);
+    tap_filter<3, 11> window;
+    window.octet_range("CallEventStartTimeStamp.LocalTimeStamp", low, high);
+    assert(window.select(data, v.size(), offsets, result));
+    expected = 0;
+    for (std::size_t i = 0; i < entries.size(); ++i)
+        expected += entries[i].get_start_time() >= low && entries[i].get_start_time() <= high;
+    assert(expected == offsets.size() && expected >= 2);
+
+    // Integer range and OctString set on GprsCall, against the full parse
+    std::vector<std::string> apn(1, "internet");
+    tap_filter<3, 11> gprs;
+    gprs.record("GprsCall").one_of("AccessPointNameNI", apn).integer_range("TotalCallEventDuration", 60, 3600);
+    assert(gprs.select(data, v.size(), offsets, result));
+    std::size_t gprs_call = find_tap_tag<3, 11>("GprsCall");
+    std::size_t apn_tag = find_tap_tag<3, 11>("AccessPointNameNI");
+    std::size_t duration_tag = find_tap_tag<3, 11>("TotalCallEventDuration");
+    std::size_t i = 0, j = 0;
+    expected = 0;
+    for (const asn1_node<Byte> *call = list->first_node(); call; call = call->next_sibling(), ++i)
+    {
+        std::vector<std::string> apns, durations;
+        collect_values(call, apn_tag, apns);
+        collect_values(call, duration_tag, durations);
+        bool in_range = false;
+        for (std::size_t k = 0; k < durations.size(); ++k)
+        {
+            long long duration = boost::property_tree::asn1_parser::binary2Int<0>(
+                (const unsigned char *)durations[k].data(), durations[k].size());
+            in_range = in_range || (duration >= 60 && duration <= 3600);
+        }
+        if (call->tag() == gprs_call && std::find(apns.begin(), apns.end(), "internet") != apns.end() && in_range)
+        {
+            ++expected;
+            assert(j < offsets.size() && offsets[j++] == entries[i].offset);
+        }
+    }
+    assert(expected == offsets.size() && expected > 0 && expected < 195);
+
+    // Single call event
+    const Byte *last = data + entries[194].offset;
+    assert(all.match(last, entries[194].size, result) && result.ok());
+    assert(!none.match(last, entries[194].size, result) && result.ok());
+
+    bool thrown = false;
+    try
+    {
+        tap_filter<3, 11>().equals("NoSuchElement", "x");
+    }
+    catch (const boost::property_tree::asn1_parser::asn1_parser_error &)
+    {
+        thrown = true;
+    }
+    assert(thrown);
+}
+
+void test_tap_fingerprint(const std::string &filename)
+{
+    using namespace boost::property_tree::asn1_parser::tap_parser;
+    namespace internal = boost::property_tree::asn1_parser::tap_parser::internal;
+    std::vector<char> v = load_file(filename);
+    const Byte *data = (const Byte*)&v[0];
+    boost::property_tree::detail::rapidasn1::parse_result result;
+
+    // Reference values of XXH64
+    assert(internal::xxh64((const unsigned char *)"", 0, 0) == 0xEF46DB3751D8E999ULL);
+    assert(internal::xxh64((const unsigned char *)"a", 1, 0) == 0xD24EC4F1A98C6E5BULL);
+    assert(internal::xxh64((const unsigned char *)"abc", 3, 0) == 0x44BC2CF5AD770999ULL);
+
+    // Raw octets: one fingerprint per call event, the same as over each call event alone
+    std::vector<tap_fingerprint> fingerprints;
+    std::vector<std::size_t> offsets, scanned;
+    tap_fingerprinter<3, 11> raw;
+    assert(raw.fingerprint_call_events(data, v.size(), fingerprints, result, &offsets));
+    assert((scan_call_events<3, 11>(data, v.size(), scanned, result) && offsets == scanned));
+    assert(fingerprints.size() == 195);
+    tap_fingerprint one;
+    assert(raw.fingerprint(data + offsets[1], offsets[2] - offsets[1], one, result) && one == fingerprints[1]);
+
+    tap_dedup_set day;
+    std::size_t unique = 0;
+    for (std::size_t i = 0; i < fingerprints.size(); ++i)
+        unique += day.insert(fingerprints[i]);
+    assert(unique == day.size() && day.size() > 1);
+
+    // The same batch again is all duplicates
+    for (std::size_t i = 0; i < fingerprints.size(); ++i)
+        assert(!day.insert(fingerprints[i]) && day.contains(fingerprints[i]));
+
+    // Key fields: duplicates of the raw octets are duplicates of the keys
+    tap_fingerprinter<3, 11> keyed;
+    keyed.key("Imsi").key("CallEventStartTimeStamp.LocalTimeStamp").key("TotalCallEventDuration");
+    std::vector<tap_fingerprint> keys;
+    assert(keyed.fingerprint_call_events(data, v.size(), keys, result));
+    assert(keys.size() == 195 && keys[0] != fingerprints[0]);
+    tap_dedup_set keyed_set;
+    for (std::size_t i = 0; i < keys.size(); ++i)
+        keyed_set.insert(keys[i]);
+    assert(keyed_set.size() <= day.size() && keyed_set.size() > 1);
+
+    // Persisted and merged
+    day.save(filename + ".dup");
+    tap_dedup_set loaded;
+    loaded.load(filename + ".dup");
+    assert(loaded.size() == day.size());
+    for (std::size_t i = 0; i < fingerprints.size(); ++i)
+        assert(loaded.contains(fingerprints[i]));
+    loaded.merge(keyed_set);
+    assert(loaded.size() == day.size() + keyed_set.size() && loaded.contains(keys[0]));
+    std::remove((filename + ".dup").c_str());
+
+    bool thrown = false;
+    try
+    {
+        loaded.load(filename);
+    }
+    catch (const boost::property_tree::asn1_parser::asn1_parser_error &)
+    {
+        thrown = true;
+    }
+    assert(thrown);
+}
+
+// Compares a translated tree with its snapshot, node by node
+template<class Node>
+bool same_snapshot(const boost::property_tree::asn1_parser::tap_parser::tap_node &a, const Node &b)
+{
+    using namespace boost::property_tree::asn1_parser::tap_parser;
+    if (a.tag() != b.tag() || a.name() != b.name() || a.data() != b.data() || b.value()[b.value_size()])
+        return false;
+    if ((b.type() == Integer || b.type() == Integer64) && b.integer() != std::strtoll(b.value(), 0, 10))
+        return false;
+    const tap_node *x = a.first_node();
+    const Node *y = b.first_node();
+    for (; x && y; x = x->next_sibling(), y = y->next_sibling())
+        if (y->parent() != &b || !same_snapshot(*x, *y))
+            return false;
+    return !x && !y && (!a.first_node() || b.last_node()->tag() == a.last_node()->tag());
+}
+
+void test_tap_snapshot(const std::string &filename)
+{
+    using namespace boost::property_tree::asn1_parser::tap_parser;
+    using boost::property_tree::detail::rapidasn1::asn1_tree;
+    std::vector<char> v = load_file(filename);
+    const Byte *data = (const Byte*)&v[0];
+
+    tap_tree tree;
+    {
+        asn1_tree<Byte> ber;
+        ber.parse<1>(data, v.size());
+        trans_asn1_tree<3, 11>(ber, tree);
+    }
+
+    write_tap_snapshot<3, 11>(filename + ".snap", tree);
+    {
+        tap_snapshot<3, 11> snapshot(filename + ".snap");
+        assert(snapshot.validate());
+        assert(same_snapshot(tree, *snapshot.root()));
+        assert(snapshot.get("TransferBatch.BatchControlInfo.Sender") == "AFGAW");
+        assert(snapshot.find_node("TransferBatch.AuditControlInfo.TotalCharge")->integer() == 23490);
+        const tap_snapshot_node<3, 11> *list = snapshot.find_node("TransferBatch.CallEventDetailList");
+        const tap_snapshot_node<3, 11> *second = list->first_node("MobileOriginatedCall")->next_sibling("MobileOriginatedCall");
+        assert(snapshot.find_node("TransferBatch.CallEventDetailList.MobileOriginatedCall(2)") == second);
+        assert(second->parent() == list && second->name() == tree.find_node("TransferBatch.CallEventDetailList.MobileOriginatedCall(2)")->name());
+        assert(snapshot.get("TransferBatch.Missing", "none") == "none");
+    }
+
+    // The image works wherever it lies
+    std::vector<char> image;
+    build_tap_snapshot<3, 11>(tree, image);
+    std::vector<boost::uint64_t> moved(image.size() / 8 + 1);
+    std::memcpy(&moved[0], &image[0], image.size());
+    tap_snapshot<3, 11> relocated(&moved[0], image.size());
+    assert(relocated.size() > 195 && relocated.validate());
+    assert(same_snapshot(tree, *relocated.root()));
+    tree.clear();
+
+    // Corruption is caught by validate(); another version by the header
+    std::vector<boost::uint64_t> intact(moved);
+    boost::int32_t *fields = reinterpret_cast<boost::int32_t *>(&moved[0]) + 8;  // tag, type, parent, first_node, last_node, next_sibling
+    fields[3] = 0x7FFFFFFF;
+    assert(!relocated.validate());
+    // Links against document order, and unknown types, are corruption too
+    moved = intact;
+    fields[12 + 2] = 1;
+    assert(!relocated.validate());
+    moved = intact;
+    fields[12 + 5] = -1;
+    assert(!relocated.validate());
+    moved = intact;
+    fields[12 + 3] = fields[12 + 4] + 1;
+    assert(!relocated.validate());
+    moved = intact;
+    fields[12 + 1] = 9;
+    assert(!relocated.validate());
+    moved = intact;
+    assert(relocated.validate());
+    bool thrown = false;
+    try
+    {
+        tap_snapshot<3, 12> other(filename + ".snap");
+    }
+    catch (const boost::property_tree::asn1_parser::asn1_parser_error &)
+    {
+        thrown = true;
+    }
+    assert(thrown);
+    std::remove((filename + ".snap").c_str());
+}
+
+// Values one level below the deepest group walk() accepts are rejected, not passed to handlers
+void test_deep_nesting()
+{
+    using namespace boost::property_tree::asn1_parser::tap_parser;
+    using namespace boost::property_tree::detail::rapidasn1;
+    const std::size_t max_depth = BOOST_PROPERTY_TREE_RAPIDASN1_VALIDATE_DEPTH;
+    parse_result result;
+
+    // In a batch, the Imsi is at depth levels + 3; in a call event alone, at levels + 1
+    std::vector<unsigned char> deepest = nested_batch(max_depth - 4), too_deep = nested_batch(max_depth - 3);
+    std::vector<unsigned char> record = nested_call_event(max_depth - 1);
+    assert(validate<parse_default>(&deepest[0], deepest.size(), result));
+    assert(!validate<parse_default>(&too_deep[0], too_deep.size(), result) && result.code == error_too_deep);
+
+    tap_aggregation<3, 11> spec;
+    spec.group_by("Imsi");
+    tap_aggregate_table table;
+    assert(spec.run(&deepest[0], deepest.size(), table, result) && table.size() == 1);
+    assert(!spec.run(&too_deep[0], too_deep.size(), table, result) && result.code == error_too_deep);
+    assert(!spec.accumulate(&record[0], record.size(), table, result) && result.code == error_too_deep);
+
+    std::vector<Moc> mocs;
+    assert((read_tap_records<3, 11>(&deepest[0], deepest.size(), mocs, result)));
+    assert(mocs.size() == 1 && std::string(mocs[0].imsi) == "238021000000001");
+    assert(!(read_tap_records<3, 11>(&too_deep[0], too_deep.size(), mocs, result)) && result.code == error_too_deep);
+
+    // Call events are walked on their own by tap_filter
+    std::vector<std::size_t> offsets;
+    tap_filter<3, 11> filter;
+    filter.bcd_prefix("Imsi", "238021");
+    assert(filter.select(&deepest[0], deepest.size(), offsets, result) && offsets.size() == 1);
+    assert(!filter.match(&record[0], record.size(), result) && result.code == error_too_deep);
+
+    tap_fingerprinter<3, 11> keyed;
+    keyed.key("Imsi");
+    std::vector<tap_fingerprint> fingerprints;
+    tap_fingerprint fingerprint;
+    assert(keyed.fingerprint_call_events(&deepest[0], deepest.size(), fingerprints, result) && fingerprints.size() == 1);
+    assert(!keyed.fingerprint(&record[0], record.size(), fingerprint, result) && result.code == error_too_deep);
+}
+
 int main()
 {
     // load("test.xml");
     load2("CDAFGAWDNKDM05958");
+    test_tap_emitter("CDAFGAWDNKDM05958");
+    test_tap_dump("CDAFGAWDNKDM05958");
+    test_asn1_view("CDAFGAWDNKDM05958");
+    test_parse_recover("CDAFGAWDNKDM05958");
+    test_parse_result("CDAFGAWDNKDM05958");
+    test_validate("CDAFGAWDNKDM05958");
+    test_parse_flags("CDAFGAWDNKDM05958");
+    test_tap_rules("CDAFGAWDNKDM05958");
+    test_tap_index("CDAFGAWDNKDM05958");
+    test_scan_siblings("CDAFGAWDNKDM05958");
+    test_tap_aggregate("CDAFGAWDNKDM05958");
+    test_tap_bind("CDAFGAWDNKDM05958");
+    test_tap_time();
+    test_tap_references("CDAFGAWDNKDM05958");
+    test_tap_money("CDAFGAWDNKDM05958");
+    test_tap_filter("CDAFGAWDNKDM05958");
+    test_tap_fingerprint("CDAFGAWDNKDM05958");
+    test_tap_snapshot("CDAFGAWDNKDM05958");
+    test_deep_nesting();
+    test_memory_pool("CDAFGAWDNKDM05958");
+    test_tap_tree("CDAFGAWDNKDM05958");
+    test_tap_key("CDAFGAWDNKDM05958");
+    test_decode_tap("CDAFGAWDNKDM05958");
+    test_read_compressed("CDAFGAWDNKDM05958");
+    test_async_reader("CDAFGAWDNKDM05958");
+    test_large_file("CDAFGAWDNKDM05958");
     
     // test_asn1file();
     
@@ -0,0 +1,323 @@
+// ----------------------------------------------------------------------------
+// Copyright (C) 2015-2016 zunceng@gmail.com
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+// For more information, see www.boost.org
+// ----------------------------------------------------------------------------
+
+// Compares the TAP translations, call event counting and record binding on a synthetic corpus:
+//
+//     tap3_bench <batch> [batches] [factor]
+//
+// The corpus holds <batches> copies of <batch>, each with its call events repeated <factor> times.
+// Built as tap3_bench_generated (make -C tools tap3_bench_generated), it also times the
+// decoder generated by tap3_codegen.
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include "asn1_parser.hpp"
+#ifdef TAP3_BENCH_GENERATED
+#include "tap3_decoder_3_11.hpp"
+#endif
+
+using namespace boost::property_tree;
+using namespace boost::property_tree::detail;
+namespace internal = boost::property_tree::detail::tap_parser::internal;
+using namespace boost::property_tree::asn1_parser::tap_parser;
+
+typedef std::vector<unsigned char> batch;
+
+// Finds the call event list: offset of its header, of its content and of its end
+struct list_finder
+{
+    std::size_t begin, content, end;
+
+    bool begin_group(std::size_t tag, std::size_t offset, std::size_t depth)
+    {
+        if (depth == 1 && tag == 3)
+            begin = offset;
+        return depth == 0;
+    }
+    void end_group(std::size_t tag, std::size_t offset, std::size_t depth)
+    {
+        if (depth == 1 && tag == 3)
+            end = offset;
+    }
+    void value(std::size_t, const unsigned char *, std::size_t, std::size_t)
+    {
+    }
+};
+
+std::size_t identifier_size(const unsigned char *identifier)
+{
+    std::size_t size = 1;
+    if ((identifier[0] & 0x1F) == 0x1F)
+        while (identifier[size++] & 0x80)
+            ;
+    return size;
+}
+
+std::size_t length_size(const unsigned char *length)
+{
+    return (length[0] & 0x80) ? 1 + (length[0] & 0x7F) : 1;
+}
+
+void append_header(batch &out, const unsigned char *identifier, std::size_t identifier_size, std::size_t len)
+{
+    out.insert(out.end(), identifier, identifier + identifier_size);
+    out.push_back(0x84);
+    for (int shift = 24; shift >= 0; shift -= 8)
+        out.push_back(static_cast<unsigned char>(len >> shift));
+}
+
+// Repeats the call events of a definite-length batch factor times
+batch synthesize(const batch &sample, std::size_t factor)
+{
+    list_finder finder;
+    rapidasn1::parse_result result;
+    if (!rapidasn1::walk<rapidasn1::parse_default>(&sample[0], sample.size(), finder, result))
+        return batch();
+
+    // Headers of TransferBatch and CallEventDetailList
+    std::size_t top_tag = identifier_size(&sample[0]);
+    std::size_t top_content = top_tag + length_size(&sample[top_tag]);
+    std::size_t list_tag = identifier_size(&sample[finder.begin]);
+    finder.content = finder.begin + list_tag + length_size(&sample[finder.begin + list_tag]);
+
+    std::size_t events = finder.end - finder.content;
+    std::size_t list_size = list_tag + 5 + events * factor;
+    std::size_t top_size = (finder.begin - top_content) + list_size + (sample.size() - finder.end);
+
+    batch out;
+    append_header(out, &sample[0], top_tag, top_size);
+    out.insert(out.end(), sample.begin() + top_content, sample.begin() + finder.begin);
+    append_header(out, &sample[finder.begin], list_tag, events * factor);
+    for (std::size_t i = 0; i < factor; ++i)
+        out.insert(out.end(), sample.begin() + finder.content, sample.begin() + finder.end);
+    out.insert(out.end(), sample.begin() + finder.end, sample.end());
+    return out;
+}
+
+std::size_t count_nodes(const tap_node &node)
+{
+    std::size_t count = 0;
+    for (const tap_node *child = node.first_node(); child; child = child->next_sibling())
+        count += 1 + count_nodes(*child);
+    return count;
+}
+
+std::size_t count_nodes(const ptree &pt)
+{
+    std::size_t count = 0;
+    for (ptree::const_iterator it = pt.begin(); it != pt.end(); ++it)
+        count += 1 + count_nodes(it->second);
+    return count;
+}
+
+// Reports the best of rounds runs over the corpus
+template<class Function>
+void run(const char *name, const std::vector<batch> &corpus, std::size_t bytes, int rounds, Function f)
+{
+    double best = 0;
+    std::size_t nodes = 0;
+    for (int round = 0; round < rounds; ++round)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        nodes = 0;
+        for (std::size_t i = 0; i < corpus.size(); ++i)
+            nodes += f(corpus[i]);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (!round || seconds < best)
+            best = seconds;
+    }
+    std::cout << name << ": " << best * 1000 << " ms, " << bytes / best / 1e6 << " MB/s, "
+              << nodes << " nodes" << std::endl;
+}
+
+std::size_t by_ptree(const batch &b)
+{
+    ptree pt, new_pt;
+    asn1_parser::read_asn1(&b[0], b.size(), pt);
+    trans_asn1_ptree<3, 11>(pt, new_pt);
+    return count_nodes(new_pt);
+}
+
+std::size_t by_tree(const batch &b)
+{
+    rapidasn1::asn1_tree<unsigned char> ber;
+    ber.parse<rapidasn1::parse_default>(&b[0], b.size());
+    tap_tree tree;
+    trans_asn1_tree<3, 11>(ber, tree);
+    return count_nodes(tree);
+}
+
+std::size_t by_table(const batch &b)
+{
+    tap_tree tree;
+    tree.set_block_size(1 << 20, 2);
+    rapidasn1::parse_result result;
+    internal::decode_state state = {&b[0], 0, &result};
+    std::size_t pos = 0;
+    internal::decode_generic<3, 11>(tree, tree, state, pos, b.size(), false);
+    return count_nodes(tree);
+}
+
+#ifdef TAP3_BENCH_GENERATED
+std::size_t by_generated(const batch &b)
+{
+    tap_tree tree;
+    tree.set_block_size(1 << 20, 2);
+    rapidasn1::parse_result result;
+    decode_tap<3, 11>(&b[0], b.size(), tree, result);
+    return count_nodes(tree);
+}
+#endif
+
+// Fields of MobileOriginatedCall, read by tap_binding and by moc_switch
+struct bench_moc
+{
+    long long charge;
+    char imsi[16];
+    long long duration;
+    char msisdn[8];
+};
+
+namespace boost { namespace property_tree { namespace detail { namespace tap_parser {
+    template<> struct tap_record_traits<bench_moc>
+    {
+        template<class Binder> static void bind(Binder &b)
+        {
+            b.record("MobileOriginatedCall");
+            b("Imsi", &bench_moc::imsi);
+            b("ChargeDetail.Charge", &bench_moc::charge);
+            b("TotalCallEventDuration", &bench_moc::duration);
+            b("Msisdn", &bench_moc::msisdn);
+        }
+    };
+}}}}
+
+// The binding of bench_moc written by hand, with the 3.11 tags as constants dispatched by a switch:
+// what a binding resolved at compile time would reduce to
+struct moc_switch
+{
+    std::vector<bench_moc> *records;
+    bool in_list;
+    unsigned seen;
+    std::size_t tags[BOOST_PROPERTY_TREE_RAPIDASN1_VALIDATE_DEPTH];
+
+    bool begin_group(std::size_t tag, std::size_t, std::size_t depth)
+    {
+        tags[depth] = tag;
+        if (depth == 1)
+            return in_list = tag == 3;
+        if (depth == 2)
+        {
+            if (tag != 9)
+                return false;
+            records->push_back(bench_moc());
+            seen = 0;
+        }
+        return true;
+    }
+    void end_group(std::size_t, std::size_t, std::size_t)
+    {
+    }
+    void value(std::size_t tag, const unsigned char *value, std::size_t size, std::size_t depth)
+    {
+        if (!in_list || depth <= 2)
+            return;
+        bench_moc &moc = records->back();
+        switch (tag)
+        {
+            case 129:       // Imsi
+                if (!(seen & 1))
+                    internal::set_chars<3, 11>(moc.imsi, value, size, sizeof(moc.imsi), tag);
+                seen |= 1;
+                break;
+            case 62:        // Charge, of ChargeDetail
+                if (!(seen & 2) && tags[depth - 1] == 63)
+                {
+                    internal::set_integer<long long>(&moc.charge, value, size, sizeof(moc.charge));
+                    seen |= 2;
+                }
+                break;
+            case 223:       // TotalCallEventDuration
+                if (!(seen & 4))
+                    internal::set_integer<long long>(&moc.duration, value, size, sizeof(moc.duration));
+                seen |= 4;
+                break;
+            case 152:       // Msisdn
+                if (!(seen & 8))
+                    internal::set_chars<3, 11>(moc.msisdn, value, size, sizeof(moc.msisdn), tag);
+                seen |= 8;
+                break;
+        }
+    }
+};
+
+std::size_t by_binding(const batch &b)
+{
+    static const tap_binding<3, 11, bench_moc> binding;
+    std::vector<bench_moc> records;
+    rapidasn1::parse_result result;
+    binding.read(&b[0], b.size(), records, result);
+    return records.size();
+}
+
+std::size_t by_switch(const batch &b)
+{
+    std::vector<bench_moc> records;
+    moc_switch handler = {&records, false, 0, {0}};
+    rapidasn1::parse_result result;
+    rapidasn1::walk<rapidasn1::parse_default>(&b[0], b.size(), handler, result);
+    return records.size();
+}
+
+std::size_t by_scan(const batch &b)
+{
+    rapidasn1::parse_result result;
+    std::size_t count = 0;
+    count_call_events<3, 11>(&b[0], b.size(), count, result);
+    return count;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        std::cerr << "usage: tap3_bench <batch> [batches] [factor]\n";
+        return 2;
+    }
+    std::ifstream stream(argv[1], std::ios::in | std::ios::binary);
+    batch sample((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+    std::size_t batches = argc > 2 ? std::atoi(argv[2]) : 50;
+    std::size_t factor = argc > 3 ? std::atoi(argv[3]) : 10;
+    batch synthetic = sample.empty() ? batch() : synthesize(sample, factor);
+    if (synthetic.empty())
+    {
+        std::cerr << argv[1] << ": cannot read batch\n";
+        return 1;
+    }
+
+    std::vector<batch> corpus(batches, synthetic);
+    std::size_t bytes = batches * synthetic.size();
+    std::cout << batches << " batches of " << synthetic.size() << " bytes" << std::endl;
+    run("read_asn1 + trans_asn1_ptree", corpus, bytes, 1, by_ptree);
+    run("asn1_tree + trans_asn1_tree ", corpus, bytes, 5, by_tree);
+    run("decode_generic (table)      ", corpus, bytes, 5, by_table);
+#ifdef TAP3_BENCH_GENERATED
+    run("decode_tap (generated)      ", corpus, bytes, 5, by_generated);
+#endif
+    run("count_call_events           ", corpus, bytes, 5, by_scan);
+    run("tap_binding                 ", corpus, bytes, 5, by_binding);
+    run("switch on constant tags     ", corpus, bytes, 5, by_switch);
+    return 0;
+}
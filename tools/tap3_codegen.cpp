@@ -0,0 +1,232 @@
+// ----------------------------------------------------------------------------
+// Copyright (C) 2015-2016 zunceng@gmail.com
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+// For more information, see www.boost.org
+// ----------------------------------------------------------------------------
+
+// Generates the tap_decoder<Version, Release> specialisation of detail/tap3_decoder.hpp:
+//
+//     tap3_codegen <version> <release> <batch>... > tap3_decoder_<version>_<release>.hpp
+//
+// Include the output after detail/tap3_decoder.hpp, with detail/ on the include path.
+// No generated decoder is shipped: on the sample batches it was no faster than the table.
+//
+// The lookup table gives the type of each tag but not which children a group may have,
+// so these are learned from the sample batches. Each group gets a function with a switch
+// over the children seen in the samples, with their conversion inlined; any other child
+// falls back to the table lookup, so the decoder stays correct for batches unlike the samples.
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include "detail/rapidasn1.hpp"
+#include "detail/tap3_parser_read.hpp"
+
+using namespace boost::property_tree::detail;
+using namespace boost::property_tree::detail::tap_parser;
+
+typedef std::map<std::size_t, std::set<std::size_t> > children_map;     // Group tag (0 for the top level) -> child tags
+
+// Walk handler recording the children of every known group
+template<int Version, int Release>
+class learner
+{
+public:
+
+    explicit learner(children_map &children)
+        : m_children(children)
+    {
+        m_parents[0] = 0;
+    }
+
+    bool begin_group(std::size_t tag, std::size_t, std::size_t depth)
+    {
+        const tap_element *element = find_tap_element<Version, Release>(tag);
+        if (!element)
+            return false;
+        m_children[m_parents[depth]].insert(tag);
+        m_parents[depth + 1] = tag;
+        return element->type == Group;
+    }
+
+    void end_group(std::size_t, std::size_t, std::size_t)
+    {
+    }
+
+    void value(std::size_t tag, const unsigned char *, std::size_t, std::size_t depth)
+    {
+        if (find_tap_element<Version, Release>(tag))
+            m_children[m_parents[depth]].insert(tag);
+    }
+
+private:
+
+    children_map &m_children;
+    std::size_t m_parents[BOOST_PROPERTY_TREE_RAPIDASN1_VALIDATE_DEPTH + 1];
+};
+
+std::string trimmed(const std::string &name)
+{
+    std::string::size_type end = name.find_last_not_of(' ');
+    return name.substr(0, end == std::string::npos ? 0 : end + 1);
+}
+
+// Name of the function decoding the children of tag; groups never seen with children use the table
+template<int Version, int Release>
+std::string function_name(const children_map &children, std::size_t tag)
+{
+    char generic[64];
+    std::sprintf(generic, "internal::decode_generic<%d, %d>", Version, Release);
+    if (!children.count(tag))
+        return generic;
+    return tag ? "decode_" + trimmed(find_tap_element<Version, Release>(tag)->name) : "decode_batch";
+}
+
+template<int Version, int Release>
+void emit_function(std::ostream &out, const children_map &all, std::size_t tag)
+{
+    const std::set<std::size_t> &children = all.find(tag)->second;
+    bool has_values = false;
+    for (std::set<std::size_t>::const_iterator it = children.begin(); it != children.end(); ++it)
+        has_values = has_values || find_tap_element<Version, Release>(*it)->type != Group;
+    const tap_element *table = internal::lookup_tables<Version, Release>::tap_elements;
+    char table_name[64];
+    std::sprintf(table_name, "internal::lookup_tables<%d, %d>::tap_elements", Version, Release);
+    out << "\n        // " << (tag ? trimmed(find_tap_element<Version, Release>(tag)->name) : std::string("Top level")) << "\n"
+        << "        static bool " << function_name<Version, Release>(all, tag)
+        << "(tap_tree &tree, tap_node &node, internal::decode_state &state, std::size_t &pos, std::size_t end, bool varlen)\n"
+        << "        {\n"
+        << "            if (!internal::enter_group(state, pos))\n"
+        << "                return false;\n"
+        << (has_values ? "            const unsigned char *data = state.data;\n" : "")
+        << "            internal::ber_header child;\n"
+        << "            int next;\n"
+        << "            while ((next = internal::next_child(state, pos, end, varlen, child)) > 0)\n"
+        << "            {\n"
+        << "                switch (child.tag)\n"
+        << "                {\n";
+    for (std::set<std::size_t>::const_iterator it = children.begin(); it != children.end(); ++it)
+    {
+        const tap_element *element = find_tap_element<Version, Release>(*it);
+        std::size_t index = element - table;
+        out << "                    case " << *it << ":    // " << trimmed(element->name) << "\n";
+        if (element->type == Group)
+        {
+            out << "                        if (!child.constructed)\n"
+                << "                            goto other;\n"
+                << "                        {\n"
+                << "                            tap_node *group = tree.allocate_node(" << table_name << " + " << index << ");\n"
+                << "                            node.append_node(group);\n"
+                << "                            if (!" << function_name<Version, Release>(all, *it)
+                << "(tree, *group, state, pos, child.varlen ? end : pos + child.len, child.varlen))\n"
+                << "                                return false;\n"
+                << "                        }\n"
+                << "                        continue;\n";
+            continue;
+        }
+        const char *append = element->type == BcdString ? "append_bcd"
+            : element->type == OctString ? "append_octets" : "append_integer";
+        out << "                        if (child.constructed)\n"
+            << "                            goto other;\n"
+            << "                        internal::" << append << "(tree, node, " << table_name << " + " << index << ", data + pos, child.len);\n"
+            << "                        pos += child.len;\n"
+            << "                        continue;\n";
+    }
+    out << "                    default:\n"
+        << "                    other:\n"
+        << "                        if (!internal::decode_child(tree, node, state, pos, end, child,\n"
+        << "                                                    find_tap_element<" << Version << ", " << Release << ">(child.tag),\n"
+        << "                                                    &internal::decode_generic<" << Version << ", " << Release << ">))\n"
+        << "                            return false;\n"
+        << "                }\n"
+        << "            }\n"
+        << "            --state.depth;\n"
+        << "            return next == 0;\n"
+        << "        }\n";
+}
+
+template<int Version, int Release>
+int generate(int argc, char *argv[])
+{
+    children_map children;
+    for (int i = 3; i < argc; ++i)
+    {
+        std::ifstream stream(argv[i], std::ios::in | std::ios::binary);
+        std::vector<char> batch((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+        learner<Version, Release> handler(children);
+        rapidasn1::parse_result result;
+        if (!stream || batch.empty()
+            || !rapidasn1::walk<rapidasn1::parse_default>(reinterpret_cast<const unsigned char *>(&batch[0]), batch.size(), handler, result))
+        {
+            std::cerr << argv[i] << ": cannot read batch\n";
+            return 1;
+        }
+    }
+
+    char guard[64];
+    std::sprintf(guard, "BOOST_PROPERTY_TREE_TAP3_DECODER_%d_%d_HPP_INCLUDED", Version, Release);
+    std::ostream &out = std::cout;
+    out << "// ----------------------------------------------------------------------------\n"
+           "// Copyright (C) 2015-2016 zunceng@gmail.com\n"
+           "//\n"
+           "// Distributed under the Boost Software License, Version 1.0.\n"
+           "// (See accompanying file LICENSE_1_0.txt or copy at\n"
+           "// http://www.boost.org/LICENSE_1_0.txt)\n"
+           "//\n"
+           "// For more information, see www.boost.org\n"
+           "// ----------------------------------------------------------------------------\n"
+           "// Generated by tools/tap3_codegen " << Version << " " << Release << " from " << argc - 3
+        << " sample batch(es); do not edit.\n"
+           "#ifndef " << guard << "\n"
+           "#define " << guard << "\n"
+           "\n"
+           "#include \"tap3_decoder.hpp\"\n"
+           "\n"
+           "namespace boost { namespace property_tree { namespace detail {namespace tap_parser{\n"
+           "\n"
+           "    //! Decoder of TAP " << Version << "." << Release << " batches, with one function per group.\n"
+           "    template<>\n"
+           "    struct tap_decoder<" << Version << ", " << Release << ">\n"
+           "    {\n"
+           "        //! Decodes the size bytes of state.data as children of tree\n"
+           "        static bool decode(tap_tree &tree, internal::decode_state &state, std::size_t size)\n"
+           "        {\n"
+           "            std::size_t pos = 0;\n"
+           "            return decode_batch(tree, tree, state, pos, size, false);\n"
+           "        }\n"
+           "\n"
+           "    private:\n";
+    for (children_map::const_iterator it = children.begin(); it != children.end(); ++it)
+        emit_function<Version, Release>(out, children, it->first);
+    out << "    };\n"
+           "\n"
+           "}}}}\n"
+           "\n"
+           "#endif\n";
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 4)
+    {
+        std::cerr << "usage: tap3_codegen <version> <release> <batch>...\n";
+        return 2;
+    }
+    int version = std::atoi(argv[1]);
+    int release = std::atoi(argv[2]);
+    if (version == 3 && release == 11)
+        return generate<3, 11>(argc, argv);
+    std::cerr << "no lookup table for TAP " << version << "." << release << "\n";
+    return 2;
+}